@@ -24,6 +24,7 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <random>
@@ -144,11 +145,3 @@ inline const char* theEigenVersion = STR(EIGEN_WORLD_VERSION) "." STR(EIGEN_MAJO
 
 #include "JrBoostLib/Profile.h"
 #include "JrBoostLib/Tools.h"
-
-
-#ifdef _MSC_VER
-// MSVS 2019 is not very good at autovectorizing code
-#define USE_INTEL_INTRINSICS 1
-#else
-#define USE_INTEL_INTRINSICS 0
-#endif
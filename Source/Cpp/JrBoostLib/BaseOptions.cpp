@@ -85,4 +85,6 @@ void BaseOptions::setPruneFactor(double p)
 
 void BaseOptions::setSaveMemory(bool b) { saveMemory_ = b; }
 
+void BaseOptions::setSinglePrecision(bool b) { singlePrecision_ = b; }
+
 void BaseOptions::setTest(size_t n) { test_ = n; }
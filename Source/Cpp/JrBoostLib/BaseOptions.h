@@ -11,7 +11,7 @@
 // variables: topVariableCount, usedVariableRatio, selectVariablesByLevel
 // nodes: minNodeSize, minNodeWeight, minNodeGain
 // post-processing: pruneFactor
-// other: saveMemory, test
+// other: saveMemory, singlePrecision, test
 
 
 class BaseOptions {   // POD class, so no need for virtual destructor
@@ -35,6 +35,7 @@ public:
     double minNodeGain() const { return minNodeGain_; }
     double pruneFactor() const { return pruneFactor_; }
     bool saveMemory() const { return saveMemory_; }
+    bool singlePrecision() const { return singlePrecision_; }
     size_t test() const { return test_; }
 
     void setForestSize(size_t n);
@@ -51,6 +52,7 @@ public:
     void setMinNodeGain(double g);
     void setPruneFactor(double p);
     void setSaveMemory(bool b);
+    void setSinglePrecision(bool b);
     void setTest(size_t n);
 
 private:
@@ -68,5 +70,6 @@ private:
     double minNodeGain_{0.0};
     double pruneFactor_{0.0};
     bool saveMemory_{false};
+    bool singlePrecision_{false};   // the tree trainer stores w and w * y of each sample as float, see WyPack
     bool test_{0};
 };
@@ -8,6 +8,7 @@
 
 #include "Base128Encoding.h"
 #include "OmpParallel.h"
+#include "PairVariables.h"
 #include "Tree.h"
 
 
@@ -24,6 +25,41 @@ void BasePredictor::predict(CRefXXfc inData, double c, RefXd outData) const
     predict_(inData, c, outData);
 }
 
+void BasePredictor::predict(
+    const vector<CRefXXfc>& inDataBlocks, const PairVariables& pairs, double c, RefXd outData) const
+{
+    if (size(inDataBlocks) == 1 && pairs.pairCount() == 0) {
+        predict(inDataBlocks[0], c, outData);
+        return;
+    }
+
+    // gather the few variables that are used, instead of concatenating the blocks,
+    // and compute the values of the pair variables that are used
+
+    const vector<const float*> columns = inDataColumns(inDataBlocks);
+    const size_t sampleCount = static_cast<size_t>(outData.rows());
+    const size_t variableCount = variableCount_();
+
+    ArrayXu8 used = ArrayXu8::Zero(variableCount);
+    usedVariables_(used);
+
+    ArrayXs newIndices = ArrayXs::Zero(variableCount);
+    ArrayXXfc usedInData(sampleCount, used.cast<size_t>().sum());
+    size_t k = 0;
+    for (size_t j = 0; j != variableCount; ++j) {
+        if (!used(j))
+            continue;
+        newIndices(j) = k;
+        if (j < size(columns))
+            usedInData.col(k) = Eigen::Map<const ArrayXf>(columns[j], sampleCount);
+        else
+            pairs.values(j - size(columns), columns, sampleCount, usedInData.col(k).data());
+        ++k;
+    }
+
+    reindexVariables_(newIndices)->predict(usedInData, c, outData);
+}
+
 
 unique_ptr<BasePredictor> BasePredictor::load_(istream& is, int version)
 {
@@ -59,16 +95,35 @@ unique_ptr<BasePredictor> ZeroPredictor::createInstance() { return makeUnique<Ze
 
 void ZeroPredictor::predict_(CRefXXfc /*inData*/, double /*c*/, RefXd /*outData*/) const {}
 
-double ZeroPredictor::predictOne_(CRefXf inData) const { return 0.0; }
+double ZeroPredictor::predictOne_(const float* /*inData*/, ptrdiff_t /*stride*/) const { return 0.0; }
+
+void ZeroPredictor::predictPermuted_(
+    CRefXXfc /*inData*/, size_t /*j*/, CRefXf /*permutedColumn*/, double /*c*/, RefXd /*outData*/) const
+{
+}
+
+double ZeroPredictor::maxAbsPrediction_() const { return 0.0; }
 
 size_t ZeroPredictor::variableCount_() const { return 0; }
 
 void ZeroPredictor::variableWeights_(double /*c*/, RefXd /*weights*/) const {}
 
+void ZeroPredictor::usedVariables_(RefXu8 /*used*/) const {}
+
 unique_ptr<BasePredictor> ZeroPredictor::reindexVariables_(CRefXs /*newIndices*/) const { return createInstance(); }
 
 void ZeroPredictor::save_(ostream& os) const { os.put('Z'); }
 
+void ZeroPredictor::saveCode_(ostream& /*os*/, double /*c*/, size_t /*indentation*/) const {}
+
+void ZeroPredictor::flatten_(double /*c*/, vector<pair<double, vector<TreeNode>>>& /*trees*/) const {}
+
+double ZeroPredictor::shapValues_(
+    const float* /*inData*/, ptrdiff_t /*stride*/, double /*c*/, double* /*shapValues*/) const
+{
+    return 0.0;
+}
+
 unique_ptr<BasePredictor> ZeroPredictor::load_(istream& /*is*/, int /*version*/) { return createInstance(); }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -84,12 +139,22 @@ unique_ptr<BasePredictor> ConstantPredictor::createInstance(double y)
 
 void ConstantPredictor::predict_(CRefXXfc /*inData*/, double c, RefXd outData) const { outData += c * y_; }
 
-double ConstantPredictor::predictOne_(CRefXf inData) const { return y_; }
+double ConstantPredictor::predictOne_(const float* /*inData*/, ptrdiff_t /*stride*/) const { return y_; }
+
+void ConstantPredictor::predictPermuted_(
+    CRefXXfc /*inData*/, size_t /*j*/, CRefXf /*permutedColumn*/, double c, RefXd outData) const
+{
+    outData += c * y_;
+}
+
+double ConstantPredictor::maxAbsPrediction_() const { return std::abs(y_); }
 
 size_t ConstantPredictor::variableCount_() const { return 0; }
 
 void ConstantPredictor::variableWeights_(double /*c*/, RefXd /*weights*/) const {}
 
+void ConstantPredictor::usedVariables_(RefXu8 /*used*/) const {}
+
 unique_ptr<BasePredictor> ConstantPredictor::reindexVariables_(CRefXs /*newIndices*/) const
 {
     return createInstance(y_);
@@ -101,6 +166,25 @@ void ConstantPredictor::save_(ostream& os) const
     os.write(reinterpret_cast<const char*>(&y_), sizeof(y_));
 }
 
+void ConstantPredictor::saveCode_(ostream& os, double c, size_t indentation) const
+{
+    os << string(4 * indentation, ' ') << "pred += " << c * y_ << ";\n";
+}
+
+void ConstantPredictor::flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const
+{
+    vector<TreeNode> nodes(1);
+    nodes[0].isLeaf = true;
+    nodes[0].y = y_;
+    trees.emplace_back(c, move(nodes));
+}
+
+double ConstantPredictor::shapValues_(
+    const float* /*inData*/, ptrdiff_t /*stride*/, double c, double* /*shapValues*/) const
+{
+    return c * y_;
+}
+
 unique_ptr<BasePredictor> ConstantPredictor::load_(istream& is, int version)
 {
     if (version < 2)
@@ -112,35 +196,63 @@ unique_ptr<BasePredictor> ConstantPredictor::load_(istream& is, int version)
 
 //----------------------------------------------------------------------------------------------------------------------
 
-StumpPredictor::StumpPredictor(size_t j, float x, float leftY, float rightY, float gain) :
-    j_{j}, x_{x}, leftY_{leftY}, rightY_{rightY}, gain_{gain}
+StumpPredictor::StumpPredictor(
+    size_t j, float x, float leftY, float rightY, float gain, size_t leftSampleCount, size_t rightSampleCount) :
+    j_{j},
+    x_{x},
+    leftY_{leftY},
+    rightY_{rightY},
+    gain_{gain},
+    leftSampleCount_{leftSampleCount},
+    rightSampleCount_{rightSampleCount}
 {
     ASSERT(std::isfinite(x) && std::isfinite(leftY) && std::isfinite(rightY));
 }
 
-unique_ptr<BasePredictor> StumpPredictor::createInstance(size_t j, float x, float leftY, float rightY, float gain)
+unique_ptr<BasePredictor> StumpPredictor::createInstance(
+    size_t j, float x, float leftY, float rightY, float gain, size_t leftSampleCount, size_t rightSampleCount)
 {
-    return makeUnique<StumpPredictor>(j, x, leftY, rightY, gain);
+    return makeUnique<StumpPredictor>(j, x, leftY, rightY, gain, leftSampleCount, rightSampleCount);
 }
 
 void StumpPredictor::predict_(CRefXXfc inData, double c, RefXd outData) const
 {
     const size_t sampleCount = inData.rows();
     for (size_t i = 0; i != sampleCount; ++i) {
-        double y = (inData(i, j_) < x_) ? leftY_ : rightY_;
+        double y = TreeTools::numericalGoesLeft(x_, false, inData(i, j_)) ? leftY_ : rightY_;
+        outData(i) += c * y;
+    }
+}
+
+double StumpPredictor::predictOne_(const float* inData, ptrdiff_t stride) const
+{
+    return TreeTools::numericalGoesLeft(x_, false, inData[j_ * stride]) ? leftY_ : rightY_;
+}
+
+void StumpPredictor::predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const
+{
+    if (j != j_) {
+        predict_(inData, c, outData);
+        return;
+    }
+    const size_t sampleCount = inData.rows();
+    for (size_t i = 0; i != sampleCount; ++i) {
+        double y = TreeTools::numericalGoesLeft(x_, false, permutedColumn(i)) ? leftY_ : rightY_;
         outData(i) += c * y;
     }
 }
 
-double StumpPredictor::predictOne_(CRefXf inData) const { return (inData(j_) < x_) ? leftY_ : rightY_; }
+double StumpPredictor::maxAbsPrediction_() const { return std::max(std::abs(leftY_), std::abs(rightY_)); }
 
 size_t StumpPredictor::variableCount_() const { return j_ + 1; }
 
 void StumpPredictor::variableWeights_(double c, RefXd weights) const { weights(j_) += c * gain_; }
 
+void StumpPredictor::usedVariables_(RefXu8 used) const { used(j_) = 1; }
+
 unique_ptr<BasePredictor> StumpPredictor::reindexVariables_(CRefXs newIndices) const
 {
-    return createInstance(newIndices(j_), x_, leftY_, rightY_, gain_);
+    return createInstance(newIndices(j_), x_, leftY_, rightY_, gain_, leftSampleCount_, rightSampleCount_);
 }
 
 void StumpPredictor::save_(ostream& os) const
@@ -151,6 +263,51 @@ void StumpPredictor::save_(ostream& os) const
     os.write(reinterpret_cast<const char*>(&leftY_), sizeof(leftY_));
     os.write(reinterpret_cast<const char*>(&rightY_), sizeof(rightY_));
     os.write(reinterpret_cast<const char*>(&gain_), sizeof(gain_));
+    base128Save(os, leftSampleCount_);
+    base128Save(os, rightSampleCount_);
+}
+
+void StumpPredictor::saveCode_(ostream& os, double c, size_t indentation) const
+{
+    const string xj = "x[" + std::to_string(j_) + " * s]";
+    os << string(4 * indentation, ' ') << "pred += (!isnan(" << xj << ") && " << xj << " < " << x_ << "f) ? "
+       << c * leftY_ << " : " << c * rightY_ << ";\n";
+}
+
+void StumpPredictor::flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const
+{
+    vector<TreeNode> nodes(3);
+    nodes[0].isLeaf = false;
+    nodes[0].y = numeric_limits<float>::quiet_NaN();
+    nodes[0].trainSampleCount = leftSampleCount_ + rightSampleCount_;
+    nodes[0].defaultLeft = false;   // missing values go right
+    nodes[0].j = j_;
+    nodes[0].x = x_;
+    nodes[0].gain = gain_;
+    nodes[0].leftChild = &nodes[1];
+    nodes[0].rightChild = &nodes[2];
+    nodes[1].isLeaf = true;
+    nodes[1].y = leftY_;
+    nodes[1].trainSampleCount = leftSampleCount_;
+    nodes[2].isLeaf = true;
+    nodes[2].y = rightY_;
+    nodes[2].trainSampleCount = rightSampleCount_;
+    trees.emplace_back(c, move(nodes));   // moving the vector does not move the nodes
+}
+
+double StumpPredictor::shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const
+{
+    if (leftSampleCount_ + rightSampleCount_ == 0)
+        throw std::runtime_error(
+            "SHAP values need the train sample counts of the tree nodes, which are missing in predictors saved by "
+            "older versions of JrBoost.");
+
+    const double leftWeight = static_cast<double>(leftSampleCount_);
+    const double rightWeight = static_cast<double>(rightSampleCount_);
+    const double expectedValue = (leftWeight * leftY_ + rightWeight * rightY_) / (leftWeight + rightWeight);
+    const double y = TreeTools::numericalGoesLeft(x_, false, inData[j_ * stride]) ? leftY_ : rightY_;
+    shapValues[j_] += c * (y - expectedValue);
+    return c * expectedValue;
 }
 
 unique_ptr<BasePredictor> StumpPredictor::load_(istream& is, int version)
@@ -163,6 +320,8 @@ unique_ptr<BasePredictor> StumpPredictor::load_(istream& is, int version)
     float leftY;
     float rightY;
     float gain;
+    size_t leftSampleCount = 0;
+    size_t rightSampleCount = 0;
 
     if (version >= 5)
         j = base128Load(is);
@@ -183,7 +342,12 @@ unique_ptr<BasePredictor> StumpPredictor::load_(istream& is, int version)
     else
         is.read(reinterpret_cast<char*>(&gain), sizeof(gain));
 
-    return createInstance(j, x, leftY, rightY, gain);
+    if (version >= 11) {
+        leftSampleCount = base128Load(is);
+        rightSampleCount = base128Load(is);
+    }
+
+    return createInstance(j, x, leftY, rightY, gain, leftSampleCount, rightSampleCount);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -200,8 +364,11 @@ unique_ptr<BasePredictor> TreePredictor::createInstance(const TreeNode* root)
     if (treeDepth == 0)
         return ConstantPredictor::createInstance(root->y);
 
-    if (treeDepth == 1)
-        return StumpPredictor::createInstance(root->j, root->x, root->leftChild->y, root->rightChild->y, root->gain);
+    // stump predictors make numerical splits and send missing values right
+    if (treeDepth == 1 && !root->defaultLeft && root->leftCategories == 0)
+        return StumpPredictor::createInstance(
+            root->j, root->x, root->leftChild->y, root->rightChild->y, root->gain, root->leftChild->trainSampleCount,
+            root->rightChild->trainSampleCount);
 
     return makeUnique<TreePredictor>(root);
 }
@@ -217,10 +384,22 @@ void TreePredictor::predict_(CRefXXfc inData, double c, RefXd outData) const
     TreeTools::predict(root, inData, c, outData);
 }
 
-double TreePredictor::predictOne_(CRefXf inData) const
+double TreePredictor::predictOne_(const float* inData, ptrdiff_t stride) const
+{
+    const TreeNode* root = data(nodes_);
+    return TreeTools::predictOne(root, inData, stride);
+}
+
+void TreePredictor::predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const
+{
+    const TreeNode* root = data(nodes_);
+    TreeTools::predictPermuted(root, inData, j, permutedColumn, c, outData);
+}
+
+double TreePredictor::maxAbsPrediction_() const
 {
     const TreeNode* root = data(nodes_);
-    return TreeTools::predictOne(root, inData);
+    return TreeTools::maxAbsLeafY(root);
 }
 
 size_t TreePredictor::variableCount_() const
@@ -235,6 +414,12 @@ void TreePredictor::variableWeights_(double c, RefXd weights) const
     TreeTools::variableWeights(root, c, weights);
 }
 
+void TreePredictor::usedVariables_(RefXu8 used) const
+{
+    const TreeNode* root = data(nodes_);
+    TreeTools::usedVariables(root, used);
+}
+
 unique_ptr<BasePredictor> TreePredictor::reindexVariables_(CRefXs newIndices) const
 {
     const TreeNode* root = data(nodes_);
@@ -249,6 +434,24 @@ void TreePredictor::save_(ostream& os) const
     TreeTools::saveTree(root, os);
 }
 
+void TreePredictor::saveCode_(ostream& os, double c, size_t indentation) const
+{
+    const TreeNode* root = data(nodes_);
+    TreeTools::saveTreeCode(root, os, c, indentation);
+}
+
+void TreePredictor::flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const
+{
+    const TreeNode* root = data(nodes_);
+    trees.emplace_back(c, TreeTools::cloneTreeDepthFirst(root));
+}
+
+double TreePredictor::shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const
+{
+    const TreeNode* root = data(nodes_);
+    return c * TreeTools::shapValues(root, inData, stride, c, shapValues);
+}
+
 unique_ptr<BasePredictor> TreePredictor::load_(istream& is, int version)
 {
     vector<TreeNode> nodes = TreeTools::loadTree(is, version);
@@ -274,15 +477,31 @@ void ForestPredictor::predict_(CRefXXfc inData, double c, RefXd outData) const
         basePredictor->predict_(inData, c, outData);
 }
 
-double ForestPredictor::predictOne_(CRefXf inData) const
+double ForestPredictor::predictOne_(const float* inData, ptrdiff_t stride) const
 {
     double pred = 0;
     for (const auto& basePredictor : basePredictors_)
-        pred += basePredictor->predictOne_(inData);
+        pred += basePredictor->predictOne_(inData, stride);
     pred /= size(basePredictors_);
     return pred;
 }
 
+void ForestPredictor::predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const
+{
+    c /= size(basePredictors_);
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->predictPermuted_(inData, j, permutedColumn, c, outData);
+}
+
+double ForestPredictor::maxAbsPrediction_() const
+{
+    double bound = 0;
+    for (const auto& basePredictor : basePredictors_)
+        bound += basePredictor->maxAbsPrediction_();
+    bound /= size(basePredictors_);
+    return bound;
+}
+
 size_t ForestPredictor::variableCount_() const
 {
     size_t n = 0;
@@ -298,6 +517,12 @@ void ForestPredictor::variableWeights_(double c, RefXd weights) const
         basePredictor->variableWeights_(c, weights);
 }
 
+void ForestPredictor::usedVariables_(RefXu8 used) const
+{
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->usedVariables_(used);
+}
+
 unique_ptr<BasePredictor> ForestPredictor::reindexVariables_(CRefXs newIndices) const
 {
     vector<unique_ptr<BasePredictor>> basePredictors;
@@ -315,6 +540,29 @@ void ForestPredictor::save_(ostream& os) const
         basePredictor->save_(os);
 }
 
+void ForestPredictor::saveCode_(ostream& os, double c, size_t indentation) const
+{
+    c /= size(basePredictors_);
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->saveCode_(os, c, indentation);
+}
+
+void ForestPredictor::flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const
+{
+    c /= size(basePredictors_);
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->flatten_(c, trees);
+}
+
+double ForestPredictor::shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const
+{
+    c /= size(basePredictors_);
+    double expectedValue = 0.0;
+    for (const auto& basePredictor : basePredictors_)
+        expectedValue += basePredictor->shapValues_(inData, stride, c, shapValues);
+    return expectedValue;
+}
+
 unique_ptr<BasePredictor> ForestPredictor::load_(istream& is, int version)
 {
     size_t n;
@@ -4,6 +4,7 @@
 
 #pragma once
 
+class PairVariables;
 struct TreeNode;
 
 
@@ -14,6 +15,9 @@ public:
     // make a prediction based on inData
     // add the prediction, multiplied by c, to outData
     void predict(CRefXXfc inData, double c, RefXd outData) const;
+    // same as above, but the indata blocks are treated as one matrix, see Dataset.h,
+    // followed by the pair variables, see PairVariables.h
+    void predict(const vector<CRefXXfc>& inDataBlocks, const PairVariables& pairs, double c, RefXd outData) const;
 
 protected:
     BasePredictor() = default;
@@ -22,12 +26,26 @@ protected:
 
 private:
     virtual void predict_(CRefXXfc inData, double c, RefXd outData) const = 0;
-    virtual double predictOne_(CRefXf inData) const = 0;
+    // inData[j * stride] is variable j
+    virtual double predictOne_(const float* inData, ptrdiff_t stride) const = 0;
+    // same as predict_(), but variable j is read from permutedColumn instead of from inData
+    virtual void predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const = 0;
+    // upper bound for the absolute value of the prediction
+    virtual double maxAbsPrediction_() const = 0;
     virtual size_t variableCount_() const = 0;
     // add the variable importance weights, multiplied by c, to weights
     virtual void variableWeights_(double c, RefXd weights) const = 0;
+    // set used(j) to 1 for each variable j that is used
+    virtual void usedVariables_(RefXu8 used) const = 0;
     virtual unique_ptr<BasePredictor> reindexVariables_(CRefXs newIndices) const = 0;
     virtual void save_(ostream& os) const = 0;
+    // write C statements that add the prediction, multiplied by c, to the variable pred
+    virtual void saveCode_(ostream& os, double c, size_t indentation) const = 0;
+    // append the trees (each tree stored with the root first) and their multipliers, multiplied by c, to trees
+    virtual void flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const = 0;
+    // add the SHAP values of the sample, multiplied by c, to shapValues (inData[j * stride] is variable j)
+    // and return the expected value of the prediction, multiplied by c
+    virtual double shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const = 0;
 
     static unique_ptr<BasePredictor> load_(istream& is, int version);
 
@@ -47,11 +65,17 @@ private:
     ZeroPredictor() = default;
 
     virtual void predict_(CRefXXfc inData, double c, RefXd outData) const;
-    virtual double predictOne_(CRefXf inData) const;
+    virtual double predictOne_(const float* inData, ptrdiff_t stride) const;
+    virtual void predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const;
+    virtual double maxAbsPrediction_() const;
     virtual size_t variableCount_() const;
     virtual void variableWeights_(double c, RefXd weights) const;
+    virtual void usedVariables_(RefXu8 used) const;
     virtual unique_ptr<BasePredictor> reindexVariables_(CRefXs newIndices) const;
     virtual void save_(ostream& os) const;
+    virtual void saveCode_(ostream& os, double c, size_t indentation) const;
+    virtual void flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const;
+    virtual double shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const;
 
     static unique_ptr<BasePredictor> load_(istream& is, int version);
 
@@ -71,11 +95,17 @@ private:
     ConstantPredictor(double y);
 
     virtual void predict_(CRefXXfc inData, double c, RefXd outData) const;
-    virtual double predictOne_(CRefXf inData) const;
+    virtual double predictOne_(const float* inData, ptrdiff_t stride) const;
+    virtual void predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const;
+    virtual double maxAbsPrediction_() const;
     virtual size_t variableCount_() const;
     virtual void variableWeights_(double c, RefXd weights) const;
+    virtual void usedVariables_(RefXu8 used) const;
     virtual unique_ptr<BasePredictor> reindexVariables_(CRefXs newIndices) const;
     virtual void save_(ostream& os) const;
+    virtual void saveCode_(ostream& os, double c, size_t indentation) const;
+    virtual void flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const;
+    virtual double shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const;
 
     static unique_ptr<BasePredictor> load_(istream& is, int version);
 
@@ -91,18 +121,26 @@ private:
 
 class StumpPredictor : public BasePredictor {   // immutable class
 public:
-    static unique_ptr<BasePredictor> createInstance(size_t j, float x, float leftY, float rightY, float gain);
+    static unique_ptr<BasePredictor> createInstance(
+        size_t j, float x, float leftY, float rightY, float gain, size_t leftSampleCount, size_t rightSampleCount);
     virtual ~StumpPredictor() = default;
 
 private:
-    StumpPredictor(size_t j, float x, float leftY, float rightY, float gain);
+    StumpPredictor(
+        size_t j, float x, float leftY, float rightY, float gain, size_t leftSampleCount, size_t rightSampleCount);
 
     virtual void predict_(CRefXXfc inData, double c, RefXd outData) const;
-    virtual double predictOne_(CRefXf inData) const;
+    virtual double predictOne_(const float* inData, ptrdiff_t stride) const;
+    virtual void predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const;
+    virtual double maxAbsPrediction_() const;
     virtual size_t variableCount_() const;
     virtual void variableWeights_(double c, RefXd weights) const;
+    virtual void usedVariables_(RefXu8 used) const;
     virtual unique_ptr<BasePredictor> reindexVariables_(CRefXs newIndices) const;
     virtual void save_(ostream& os) const;
+    virtual void saveCode_(ostream& os, double c, size_t indentation) const;
+    virtual void flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const;
+    virtual double shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const;
 
     static unique_ptr<BasePredictor> load_(istream& is, int version);
 
@@ -112,6 +150,8 @@ private:
     float leftY_;
     float rightY_;
     float gain_;
+    size_t leftSampleCount_;    // number of train samples, 0 if unknown
+    size_t rightSampleCount_;
 
 private:
     friend class MakeUniqueHelper<StumpPredictor>;
@@ -131,11 +171,17 @@ private:
     TreePredictor(vector<TreeNode>&& nodes);
 
     virtual void predict_(CRefXXfc inData, double c, RefXd outData) const;
-    virtual double predictOne_(CRefXf inData) const;
+    virtual double predictOne_(const float* inData, ptrdiff_t stride) const;
+    virtual void predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const;
+    virtual double maxAbsPrediction_() const;
     virtual size_t variableCount_() const;
     virtual void variableWeights_(double c, RefXd weights) const;
+    virtual void usedVariables_(RefXu8 used) const;
     virtual unique_ptr<BasePredictor> reindexVariables_(CRefXs newIndices) const;
     virtual void save_(ostream& os) const;
+    virtual void saveCode_(ostream& os, double c, size_t indentation) const;
+    virtual void flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const;
+    virtual double shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const;
 
     static unique_ptr<BasePredictor> load_(istream& is, int version);
 
@@ -158,11 +204,17 @@ private:
     ForestPredictor(vector<unique_ptr<BasePredictor>>&& basePredictors);
 
     virtual void predict_(CRefXXfc inData, double c, RefXd outData) const;
-    virtual double predictOne_(CRefXf inData) const;
+    virtual double predictOne_(const float* inData, ptrdiff_t stride) const;
+    virtual void predictPermuted_(CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData) const;
+    virtual double maxAbsPrediction_() const;
     virtual size_t variableCount_() const;
     virtual void variableWeights_(double c, RefXd weights) const;
+    virtual void usedVariables_(RefXu8 used) const;
     virtual unique_ptr<BasePredictor> reindexVariables_(CRefXs newIndices) const;
     virtual void save_(ostream& os) const;
+    virtual void saveCode_(ostream& os, double c, size_t indentation) const;
+    virtual void flatten_(double c, vector<pair<double, vector<TreeNode>>>& trees) const;
+    virtual double shapValues_(const float* inData, ptrdiff_t stride, double c, double* shapValues) const;
 
     static unique_ptr<BasePredictor> load_(istream& is, int version);
 
@@ -24,3 +24,5 @@ void BoostOptions::setEta(double eta)
 }
 
 void BoostOptions::setFastExp(bool b) { fastExp_ = b; }
+
+void BoostOptions::setFastLogitExp(bool b) { fastLogitExp_ = b; }
@@ -17,16 +17,22 @@ public:
     double gamma() const { return gamma_; }
     size_t iterationCount() const { return iterationCount_; }
     double eta() const { return eta_; }
+    // Ada boost uses fastExp() (see FastExp.h), with relative error < 3%
     bool fastExp() const { return fastExp_; }
+    // logit and regularized logit boost use approxExp<8>() and approxLog1p<8>() (see FastMath.h),
+    // with relative error < 1e-8, instead of std::exp() and std::pow()
+    bool fastLogitExp() const { return fastLogitExp_; }
 
     void setGamma(double gamma);
     void setIterationCount(size_t n);
     void setEta(double eta);
     void setFastExp(bool b);
+    void setFastLogitExp(bool b);
 
 private:
     double gamma_{1.0};
     size_t iterationCount_{1000};
     double eta_{0.1};
     bool fastExp_{true};
+    bool fastLogitExp_{false};
 };
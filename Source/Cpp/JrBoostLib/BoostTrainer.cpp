@@ -8,39 +8,67 @@
 
 #include "BasePredictor.h"
 #include "BoostOptions.h"
+#include "Dataset.h"
 #include "FastExp.h"
+#include "FastMath.h"
+#include "PairPredictor.h"
 #include "Predictor.h"
+#include "SimdLevel.h"
 #include "TreeTrainer.h"
 
 
-BoostTrainer::BoostTrainer(ArrayXXfc inData, ArrayXu8 outData, optional<ArrayXd> weights, optional<ArrayXu8> strata) :
+SIMD_TARGET_AVX512 double adaFastExpAvx512_(
+    size_t sampleCount, const double* pF, const double* pOutData, const double* pWeights, double* pAdjWeights);
+SIMD_TARGET_AVX2 double adaFastExpAvx2_(
+    size_t sampleCount, const double* pF, const double* pOutData, const double* pWeights, double* pAdjWeights);
+double adaFastExp_(
+    size_t sampleCount, const double* pF, const double* pOutData, const double* pWeights, double* pAdjWeights);
+
+//----------------------------------------------------------------------------------------------------------------------
+
+BoostTrainer::BoostTrainer(
+    shared_ptr<const Dataset> dataset, ArrayXu8 outData, optional<ArrayXd> weights, optional<ArrayXu8> strata) :
     sampleCount_{
-        (validateData_(inData, outData, weights, strata),   // do validation before anything else
-         static_cast<size_t>(inData.rows()))},
-    variableCount_{static_cast<size_t>(inData.cols())},
-    inData_{std::move(inData)},
+        (validateData_(dataset.get(), outData, weights, strata),   // do validation before anything else
+         dataset->sampleCount())},
+    variableCount_{dataset->variableCount()},
+    dataset_{std::move(dataset)},
+    inDataBlocks_{dataset_->inDataBlocks()},
     outData_{2.0 * outData.cast<double>() - 1.0},
     weights_{std::move(weights)},
     strata_{strata ? std::move(*strata) : std::move(outData)},
-    globaLogOddsRatio_{getGlobalLogOddsRatio_()},
-    treeTrainer_{TreeTrainer::createInstance(inData_, strata_)}
+    globaLogOddsRatio_{getGlobalLogOddsRatio_()}
+{
+}
+
+BoostTrainer::BoostTrainer(
+    ArrayXXfc inData, ArrayXu8 outData, optional<ArrayXd> weights, optional<ArrayXu8> strata,
+    optional<ArrayXu8> categorical) :
+    BoostTrainer(
+        std::make_shared<const Dataset>(std::move(inData), std::move(categorical)), std::move(outData),
+        std::move(weights), std::move(strata))
+{
+}
+
+BoostTrainer::BoostTrainer(
+    vector<ArrayXXfc> inDataBlocks, ArrayXu8 outData, optional<ArrayXd> weights, optional<ArrayXu8> strata,
+    optional<ArrayXu8> categorical) :
+    BoostTrainer(
+        std::make_shared<const Dataset>(std::move(inDataBlocks), std::move(categorical)), std::move(outData),
+        std::move(weights), std::move(strata))
 {
 }
 
 BoostTrainer::~BoostTrainer() = default;
 
 
-void BoostTrainer::validateData_(CRefXXfc inData, CRefXu8 outData, optional<CRefXd> weights, optional<CRefXu8> strata)
+void BoostTrainer::validateData_(
+    const Dataset* dataset, CRefXu8 outData, optional<CRefXd> weights, optional<CRefXu8> strata)
 {
-    const size_t sampleCount = static_cast<size_t>(inData.rows());
-    const size_t variableCount = static_cast<size_t>(inData.cols());
+    if (dataset == nullptr)
+        throw std::invalid_argument("Train dataset is missing.");
 
-    if (sampleCount == 0)
-        throw std::invalid_argument("Train indata has 0 samples.");
-    if (variableCount == 0)
-        throw std::invalid_argument("Train indata has 0 variables.");
-    if (!inData.isFinite().all())
-        throw std::invalid_argument("Train indata has values that are infinity or NaN.");
+    const size_t sampleCount = dataset->sampleCount();
 
     if (static_cast<size_t>(outData.rows()) != sampleCount)
         throw std::invalid_argument("Train indata and outdata have different numbers of samples.");
@@ -95,12 +123,19 @@ shared_ptr<Predictor> BoostTrainer::train(const BoostOptions& opt, size_t thread
         threadCount = omp_get_max_threads();
 
     double gamma = opt.gamma();
+    shared_ptr<Predictor> pred;
     if (gamma == 1.0)
-        return trainAda_(opt, threadCount);
+        pred = trainAda_(opt, threadCount);
     else if (gamma == 0.0)
-        return trainLogit_(opt, threadCount);
+        pred = trainLogit_(opt, threadCount);
     else
-        return trainRegularizedLogit_(opt, threadCount);
+        pred = trainRegularizedLogit_(opt, threadCount);
+
+    // the trees refer to pair variable k as variable variableCount_ + k
+    const PairVariables& pairs = dataset_->pairs();
+    if (pairs.pairCount() != 0)
+        pred = PairPredictor::createInstance(pred, variableCount_, pairs);
+    return pred;
 }
 
 //......................................................................................................................
@@ -152,136 +187,175 @@ shared_ptr<Predictor> BoostTrainer::trainAda_(const BoostOptions& opt, size_t th
         }
 
         else {
+            // The versions do not compute the same function. The AVX-512 version uses fastExp(__m512d), which sets
+            // all 52 mantissa bits, while the AVX2 and scalar versions use fastExp(__m256d) and its scalar form
+            // approxExp<1>(), which only set the upper 20 mantissa bits. Both have relative error < 0.03, and they
+            // differ by a relative amount < 5e-7. That can change the choice between nearly equal splits, and then
+            // the trained predictors differ between the SIMD levels (predictions by up to 0.26 in a test with
+            // gamma = 1).
+            const SimdLevel level = ::simdLevel();
+            if (level == SimdLevel::AVX512)
+                adjWeightSum = adaFastExpAvx512_(sampleCount, pF, pOutData, pWeights, pAdjWeights);
+            else if (level == SimdLevel::AVX2)
+                adjWeightSum = adaFastExpAvx2_(sampleCount, pF, pOutData, pWeights, pAdjWeights);
+            else
+                adjWeightSum = adaFastExp_(sampleCount, pF, pOutData, pWeights, pAdjWeights);
+        }
 
-            // Visual C++ fails to autovectorize the fastExp() function with AVX2
-            // (or the fastExp() function with AVX-512F + AVX-512DQ). Thus we do manual vectorization.
+        if (!std::isfinite(adjWeightSum))
+            overflow_(opt);
 
-#if USE_INTEL_INTRINSICS && defined(__AVX512F__) && defined(__AVX512DQ__)
+        unique_ptr<BasePredictor> basePred
+            = dataset_->treeTrainer_->train(outData_, adjWeights, strata_, opt, threadCount);
+        basePred->predict(inDataBlocks_, dataset_->pairs(), eta, F);
+        basePredictors.push_back(move(basePred));
+    }
 
-            // WARNING: NOT TESTED!
+    return BoostPredictor::createInstance(globaLogOddsRatio_, 2 * eta, move(basePredictors));
+}
 
-            size_t i = 0;
-            __m512d adjWeightSum8 = _mm512_setzero_pd();
+//......................................................................................................................
 
-            if (pWeights == nullptr) {
-                for (; i + 8 <= sampleCount; i += 8) {
-                    const __m512d F8 = _mm512_load_pd(pF + i);
-                    const __m512d y8 = _mm512_load_pd(pOutData + i);
-                    __m512d x8 = _mm512_mul_pd(F8, y8);
-                    x8 = _mm512_xor_pd(x8, _mm512_set1_pd(-0.0));   // x8 = -x8
-                    x8 = fastExp(x8);
-                    _mm512_store_pd(pAdjWeights + i, x8);
-                    adjWeightSum8 = _mm512_add_pd(adjWeightSum8, x8);
-                }
-            }
-            else {
-                for (; i + 8 <= sampleCount; i += 8) {
-                    const __m512d F8 = _mm512_load_pd(pF + i);
-                    const __m512d y8 = _mm512_load_pd(pOutData + i);
-                    const __m512d w8 = _mm512_loadu_pd(pWeights + i);   // allocated by client, alignment unknown
-                    __m512d x8 = _mm512_mul_pd(F8, y8);
-                    x8 = _mm512_xor_pd(x8, _mm512_set1_pd(-0.0));   // x8 = -x8
-                    x8 = fastExp(x8);
-                    x8 = _mm512_mul_pd(x8, w8);
-                    _mm512_store_pd(pAdjWeights + i, x8);
-                    adjWeightSum8 = _mm512_add_pd(adjWeightSum8, x8);
-                }
-            }
+// The fastExp() loop of Ada boost: sets adjWeights = weights * fastExp(-F * outData) and returns the sum of adjWeights.
+// There is one version for each SIMD level; trainAda_() selects the version at runtime (see SimdLevel.h).
+//
+// Visual C++ fails to autovectorize the fastExp() function with AVX2
+// (or the fastExp() function with AVX-512F + AVX-512DQ). Thus we do manual vectorization.
 
-            adjWeightSum = std::accumulate(std::begin(adjWeightSum8.m512d_f64), std::end(adjWeightSum8.m512d_f64), 0.0);
+SIMD_TARGET_AVX512 double adaFastExpAvx512_(
+    size_t sampleCount, const double* pF, const double* pOutData, const double* pWeights, double* pAdjWeights)
+{
+    size_t i = 0;
+    __m512d adjWeightSum8 = _mm512_setzero_pd();
+
+    if (pWeights == nullptr) {
+        for (; i + 8 <= sampleCount; i += 8) {
+            const __m512d F8 = _mm512_loadu_pd(pF + i);
+            const __m512d y8 = _mm512_loadu_pd(pOutData + i);
+            __m512d x8 = _mm512_mul_pd(F8, y8);
+            x8 = _mm512_xor_pd(x8, _mm512_set1_pd(-0.0));   // x8 = -x8
+            x8 = fastExp(x8);
+            _mm512_storeu_pd(pAdjWeights + i, x8);
+            adjWeightSum8 = _mm512_add_pd(adjWeightSum8, x8);
+        }
+    }
+    else {
+        for (; i + 8 <= sampleCount; i += 8) {
+            const __m512d F8 = _mm512_loadu_pd(pF + i);
+            const __m512d y8 = _mm512_loadu_pd(pOutData + i);
+            const __m512d w8 = _mm512_loadu_pd(pWeights + i);
+            __m512d x8 = _mm512_mul_pd(F8, y8);
+            x8 = _mm512_xor_pd(x8, _mm512_set1_pd(-0.0));   // x8 = -x8
+            x8 = fastExp(x8);
+            x8 = _mm512_mul_pd(x8, w8);
+            _mm512_storeu_pd(pAdjWeights + i, x8);
+            adjWeightSum8 = _mm512_add_pd(adjWeightSum8, x8);
+        }
+    }
 
-            if (pWeights == nullptr) {
-                for (; i != sampleCount; ++i) {
-                    const double x = fastExp(-pF[i] * pOutData[i]);
-                    pAdjWeights[i] = x;
-                    adjWeightSum += x;
-                }
-            }
-            else {
-                for (; i != sampleCount; ++i) {
-                    double x = fastExp(-pF[i] * pOutData[i]);
-                    x *= pWeights[i];
-                    pAdjWeights[i] = x;
-                    adjWeightSum += x;
-                }
-            }
+    double adjWeightSum = _mm512_reduce_add_pd(adjWeightSum8);
 
-#elif USE_INTEL_INTRINSICS && defined(__AVX2__)
+    if (pWeights == nullptr) {
+        for (; i != sampleCount; ++i) {
+            const double x = fastExp(-pF[i] * pOutData[i]);
+            pAdjWeights[i] = x;
+            adjWeightSum += x;
+        }
+    }
+    else {
+        for (; i != sampleCount; ++i) {
+            double x = fastExp(-pF[i] * pOutData[i]);
+            x *= pWeights[i];
+            pAdjWeights[i] = x;
+            adjWeightSum += x;
+        }
+    }
 
-            size_t i = 0;
-            __m256d adjWeightSum4 = _mm256_setzero_pd();
+    return adjWeightSum;
+}
 
-            if (pWeights == nullptr) {
-                for (; i + 4 <= sampleCount; i += 4) {
-                    const __m256d F4 = _mm256_load_pd(pF + i);
-                    const __m256d y4 = _mm256_load_pd(pOutData + i);
-                    __m256d x4 = _mm256_mul_pd(F4, y4);
-                    x4 = _mm256_xor_pd(x4, _mm256_set1_pd(-0.0));   // x4 = -x4
-                    x4 = fastExp(x4);
-                    _mm256_store_pd(pAdjWeights + i, x4);
-                    adjWeightSum4 = _mm256_add_pd(adjWeightSum4, x4);
-                }
-            }
-            else {
-                for (; i + 4 <= sampleCount; i += 4) {
-                    const __m256d F4 = _mm256_load_pd(pF + i);
-                    const __m256d y4 = _mm256_load_pd(pOutData + i);
-                    const __m256d w4 = _mm256_loadu_pd(pWeights + i);   // allocated by client, alignment unknown
-                    __m256d x4 = _mm256_mul_pd(F4, y4);
-                    x4 = _mm256_xor_pd(x4, _mm256_set1_pd(-0.0));   // x4 = -x4
-                    x4 = fastExp(x4);
-                    x4 = _mm256_mul_pd(x4, w4);
-                    _mm256_store_pd(pAdjWeights + i, x4);
-                    adjWeightSum4 = _mm256_add_pd(adjWeightSum4, x4);
-                }
-            }
 
-            adjWeightSum = std::accumulate(std::begin(adjWeightSum4.m256d_f64), std::end(adjWeightSum4.m256d_f64), 0.0);
+SIMD_TARGET_AVX2 double adaFastExpAvx2_(
+    size_t sampleCount, const double* pF, const double* pOutData, const double* pWeights, double* pAdjWeights)
+{
+    size_t i = 0;
+    __m256d adjWeightSum4 = _mm256_setzero_pd();
+
+    if (pWeights == nullptr) {
+        for (; i + 4 <= sampleCount; i += 4) {
+            const __m256d F4 = _mm256_loadu_pd(pF + i);
+            const __m256d y4 = _mm256_loadu_pd(pOutData + i);
+            __m256d x4 = _mm256_mul_pd(F4, y4);
+            x4 = _mm256_xor_pd(x4, _mm256_set1_pd(-0.0));   // x4 = -x4
+            x4 = fastExp(x4);
+            _mm256_storeu_pd(pAdjWeights + i, x4);
+            adjWeightSum4 = _mm256_add_pd(adjWeightSum4, x4);
+        }
+    }
+    else {
+        for (; i + 4 <= sampleCount; i += 4) {
+            const __m256d F4 = _mm256_loadu_pd(pF + i);
+            const __m256d y4 = _mm256_loadu_pd(pOutData + i);
+            const __m256d w4 = _mm256_loadu_pd(pWeights + i);
+            __m256d x4 = _mm256_mul_pd(F4, y4);
+            x4 = _mm256_xor_pd(x4, _mm256_set1_pd(-0.0));   // x4 = -x4
+            x4 = fastExp(x4);
+            x4 = _mm256_mul_pd(x4, w4);
+            _mm256_storeu_pd(pAdjWeights + i, x4);
+            adjWeightSum4 = _mm256_add_pd(adjWeightSum4, x4);
+        }
+    }
 
-            if (pWeights == nullptr) {
-                for (; i != sampleCount; ++i) {
-                    const double x = fastExp(-pF[i] * pOutData[i]);
-                    pAdjWeights[i] = x;
-                    adjWeightSum += x;
-                }
-            }
-            else {
-                for (; i != sampleCount; ++i) {
-                    double x = fastExp(-pF[i] * pOutData[i]);
-                    x *= pWeights[i];
-                    pAdjWeights[i] = x;
-                    adjWeightSum += x;
-                }
-            }
+    double s[4];
+    _mm256_storeu_pd(s, adjWeightSum4);
+    double adjWeightSum = std::accumulate(std::begin(s), std::end(s), 0.0);
 
-#else
-            if (pWeights == nullptr) {
-                for (size_t i = 0; i != sampleCount; ++i) {
-                    const double x = fastExp(-pF[i] * pOutData[i]);
-                    pAdjWeights[i] = x;
-                    adjWeightSum += x;
-                }
-            }
-            else {
-                for (size_t i = 0; i != sampleCount; ++i) {
-                    double x = fastExp(-pF[i] * pOutData[i]);
-                    x *= pWeights[i];
-                    pAdjWeights[i] = x;
-                    adjWeightSum += x;
-                }
-            }
-#endif
-        }   // end if (!opt.fastExp())
+    if (pWeights == nullptr) {
+        for (; i != sampleCount; ++i) {
+            const double x = approxExp<1>(-pF[i] * pOutData[i]);
+            pAdjWeights[i] = x;
+            adjWeightSum += x;
+        }
+    }
+    else {
+        for (; i != sampleCount; ++i) {
+            double x = approxExp<1>(-pF[i] * pOutData[i]);
+            x *= pWeights[i];
+            pAdjWeights[i] = x;
+            adjWeightSum += x;
+        }
+    }
 
-        if (!std::isfinite(adjWeightSum))
-            overflow_(opt);
+    return adjWeightSum;
+}
 
-        unique_ptr<BasePredictor> basePred = treeTrainer_->train(outData_, adjWeights, opt, threadCount);
-        basePred->predict(inData_, eta, F);
-        basePredictors.push_back(move(basePred));
+
+double adaFastExp_(
+    size_t sampleCount, const double* pF, const double* pOutData, const double* pWeights, double* pAdjWeights)
+{
+    double adjWeightSum = 0.0;
+
+    // GCC autovectorizes approxExp<1>(), the scalar version of fastExp(__m256d) (see FastMath.h)
+
+    if (pWeights == nullptr) {
+        PRAGMA_OMP_SIMD_SUM(adjWeightSum)
+        for (size_t i = 0; i != sampleCount; ++i) {
+            const double x = approxExp<1>(-pF[i] * pOutData[i]);
+            pAdjWeights[i] = x;
+            adjWeightSum += x;
+        }
+    }
+    else {
+        PRAGMA_OMP_SIMD_SUM(adjWeightSum)
+        for (size_t i = 0; i != sampleCount; ++i) {
+            double x = approxExp<1>(-pF[i] * pOutData[i]);
+            x *= pWeights[i];
+            pAdjWeights[i] = x;
+            adjWeightSum += x;
+        }
     }
 
-    return BoostPredictor::createInstance(globaLogOddsRatio_, 2 * eta, move(basePredictors));
+    return adjWeightSum;
 }
 
 //......................................................................................................................
@@ -308,35 +382,70 @@ shared_ptr<Predictor> BoostTrainer::trainLogit_(const BoostOptions& opt, size_t
 
         double absAdjOutDataSum = 0.0;
 
-        // Visual C++ does autovectorize the following two loops
+        if (!opt.fastLogitExp()) {
+
+            // Visual C++ does autovectorize the following two loops
 
-        if (pWeights == nullptr) {
-            for (size_t i = 0; i != sampleCount; ++i) {
-                const double x = std::exp(-pF[i] * pOutData[i]);
-                const double z = pOutData[i] * (x + 1.0);
-                pAdjOutData[i] = z;
-                absAdjOutDataSum += std::abs(z);
-                const double u = x / square(x + 1.0);
-                pAdjWeights[i] = u;
+            if (pWeights == nullptr) {
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = std::exp(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0);
+                    pAdjOutData[i] = z;
+                    absAdjOutDataSum += std::abs(z);
+                    const double u = x / square(x + 1.0);
+                    pAdjWeights[i] = u;
+                }
+            }
+            else {
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = std::exp(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0);
+                    pAdjOutData[i] = z;
+                    absAdjOutDataSum += std::abs(z);
+                    double u = x / square(x + 1.0);
+                    u *= pWeights[i];
+                    pAdjWeights[i] = u;
+                }
             }
         }
+
         else {
-            for (size_t i = 0; i != sampleCount; ++i) {
-                const double x = std::exp(-pF[i] * pOutData[i]);
-                const double z = pOutData[i] * (x + 1.0);
-                pAdjOutData[i] = z;
-                absAdjOutDataSum += std::abs(z);
-                double u = x / square(x + 1.0);
-                u *= pWeights[i];
-                pAdjWeights[i] = u;
+
+            // The adjusted outdata and weights are smooth functions of x, so we use the approximate exp with
+            // relative error < 1e-8 rather than the much cruder fastExp() of the Ada boost algorithm.
+            // GCC autovectorizes the following two loops (see FastMath.h).
+
+            if (pWeights == nullptr) {
+                PRAGMA_OMP_SIMD_SUM(absAdjOutDataSum)
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = approxExp<8>(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0);
+                    pAdjOutData[i] = z;
+                    absAdjOutDataSum += std::abs(z);
+                    const double u = x / square(x + 1.0);
+                    pAdjWeights[i] = u;
+                }
             }
-        }
+            else {
+                PRAGMA_OMP_SIMD_SUM(absAdjOutDataSum)
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = approxExp<8>(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0);
+                    pAdjOutData[i] = z;
+                    absAdjOutDataSum += std::abs(z);
+                    double u = x / square(x + 1.0);
+                    u *= pWeights[i];
+                    pAdjWeights[i] = u;
+                }
+            }
+        }   // end if (!opt.fastLogitExp())
 
         if (!std::isfinite(absAdjOutDataSum))
             overflow_(opt);
 
-        unique_ptr<BasePredictor> basePred = treeTrainer_->train(adjOutData, adjWeights, opt, threadCount);
-        basePred->predict(inData_, eta, F);
+        unique_ptr<BasePredictor> basePred
+            = dataset_->treeTrainer_->train(adjOutData, adjWeights, strata_, opt, threadCount);
+        basePred->predict(inDataBlocks_, dataset_->pairs(), eta, F);
         basePredictors[k] = move(basePred);
     }
 
@@ -368,35 +477,69 @@ shared_ptr<Predictor> BoostTrainer::trainRegularizedLogit_(const BoostOptions& o
 
         double adjWeightSum = 0.0;
 
-        // Visual C++ does autovectorize the following two loops
+        if (!opt.fastLogitExp()) {
 
-        if (pWeights == nullptr) {
-            for (size_t i = 0; i != sampleCount; ++i) {
-                const double x = std::exp(-pF[i] * pOutData[i]);
-                const double z = pOutData[i] * (x + 1.0) / (gamma * x + 1.0);
-                pAdjOutData[i] = z;
-                const double u = x * (gamma * x + 1.0) * std::pow(x + 1.0, gamma - 2.0);
-                pAdjWeights[i] = u;
-                adjWeightSum += u;
+            // Visual C++ does autovectorize the following two loops
+
+            if (pWeights == nullptr) {
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = std::exp(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0) / (gamma * x + 1.0);
+                    pAdjOutData[i] = z;
+                    const double u = x * (gamma * x + 1.0) * std::pow(x + 1.0, gamma - 2.0);
+                    pAdjWeights[i] = u;
+                    adjWeightSum += u;
+                }
+            }
+            else {
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = std::exp(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0) / (gamma * x + 1.0);
+                    pAdjOutData[i] = z;
+                    double u = x * (gamma * x + 1.0) * std::pow(x + 1.0, gamma - 2.0);
+                    u *= pWeights[i];
+                    pAdjWeights[i] = u;
+                    adjWeightSum += u;
+                }
             }
         }
+
         else {
-            for (size_t i = 0; i != sampleCount; ++i) {
-                const double x = std::exp(-pF[i] * pOutData[i]);
-                const double z = pOutData[i] * (x + 1.0) / (gamma * x + 1.0);
-                pAdjOutData[i] = z;
-                double u = x * (gamma * x + 1.0) * std::pow(x + 1.0, gamma - 2.0);
-                u *= pWeights[i];
-                pAdjWeights[i] = u;
-                adjWeightSum += u;
+
+            // As in trainLogit_(), with (x + 1)^(gamma - 2) = exp((gamma - 2) * log(1 + x)).
+            // GCC autovectorizes the following two loops (see FastMath.h).
+
+            if (pWeights == nullptr) {
+                PRAGMA_OMP_SIMD_SUM(adjWeightSum)
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = approxExp<8>(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0) / (gamma * x + 1.0);
+                    pAdjOutData[i] = z;
+                    const double u = x * (gamma * x + 1.0) * approxExp<8>((gamma - 2.0) * approxLog1p<8>(x));
+                    pAdjWeights[i] = u;
+                    adjWeightSum += u;
+                }
             }
-        }
+            else {
+                PRAGMA_OMP_SIMD_SUM(adjWeightSum)
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const double x = approxExp<8>(-pF[i] * pOutData[i]);
+                    const double z = pOutData[i] * (x + 1.0) / (gamma * x + 1.0);
+                    pAdjOutData[i] = z;
+                    double u = x * (gamma * x + 1.0) * approxExp<8>((gamma - 2.0) * approxLog1p<8>(x));
+                    u *= pWeights[i];
+                    pAdjWeights[i] = u;
+                    adjWeightSum += u;
+                }
+            }
+        }   // end if (!opt.fastLogitExp())
 
         if (!std::isfinite(adjWeightSum))
             overflow_(opt);
 
-        unique_ptr<BasePredictor> basePred = treeTrainer_->train(adjOutData, adjWeights, opt, threadCount);
-        basePred->predict(inData_, eta, F);
+        unique_ptr<BasePredictor> basePred
+            = dataset_->treeTrainer_->train(adjOutData, adjWeights, strata_, opt, threadCount);
+        basePred->predict(inDataBlocks_, dataset_->pairs(), eta, F);
         basePredictors[k] = move(basePred);
     }
 
@@ -5,15 +5,27 @@
 #pragma once
 
 class BoostOptions;
+class Dataset;
 class Predictor;
-class TreeTrainer;
 
 
+// The indata must be dense (ArrayXXfc or blocks of ArrayXXfc); there is no sparse indata format.
+// For sparse indata the tree trainer saves memory only in its presorted lists of samples, which leave out the samples
+// with value zero (see TreeTrainerImpl.cpp); the indata itself takes its full size.
+
 class BoostTrainer {   // immutable class
 public:
+    // the dataset can be shared with other boost trainers; it is presorted only once
     BoostTrainer(
-        ArrayXXfc inData, ArrayXu8 outData, optional<ArrayXd> weights = std::nullopt,
+        shared_ptr<const Dataset> dataset, ArrayXu8 outData, optional<ArrayXd> weights = std::nullopt,
         optional<ArrayXu8> strata = std::nullopt);
+    BoostTrainer(
+        ArrayXXfc inData, ArrayXu8 outData, optional<ArrayXd> weights = std::nullopt,
+        optional<ArrayXu8> strata = std::nullopt, optional<ArrayXu8> categorical = std::nullopt);
+    // the indata blocks are treated as one matrix, see Dataset.h
+    BoostTrainer(
+        vector<ArrayXXfc> inDataBlocks, ArrayXu8 outData, optional<ArrayXd> weights = std::nullopt,
+        optional<ArrayXu8> strata = std::nullopt, optional<ArrayXu8> categorical = std::nullopt);
     BoostTrainer(const BoostTrainer&) = delete;
     BoostTrainer& operator=(const BoostTrainer&) = delete;
     ~BoostTrainer();
@@ -22,7 +34,8 @@ public:
 
 
 private:
-    static void validateData_(CRefXXfc inData, CRefXu8 outData, optional<CRefXd> weights, optional<CRefXu8> strata);
+    static void
+    validateData_(const Dataset* dataset, CRefXu8 outData, optional<CRefXd> weights, optional<CRefXu8> strata);
     double getGlobalLogOddsRatio_() const;
 
     shared_ptr<Predictor> trainAda_(const BoostOptions& opt, size_t threadCount) const;
@@ -33,10 +46,10 @@ private:
 private:
     const size_t sampleCount_;
     const size_t variableCount_;
-    const ArrayXXfc inData_;
+    const shared_ptr<const Dataset> dataset_;
+    const vector<CRefXXfc> inDataBlocks_;   // the indata blocks of dataset_
     const ArrayXd outData_;
     const optional<ArrayXd> weights_;
     const ArrayXu8 strata_;
     const double globaLogOddsRatio_;
-    const unique_ptr<TreeTrainer> treeTrainer_;
 };
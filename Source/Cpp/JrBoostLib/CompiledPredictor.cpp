@@ -0,0 +1,146 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "CompiledPredictor.h"
+
+#include "OmpParallel.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+
+namespace {
+
+void* loadLibrary_(const string& libraryPath)
+{
+#ifdef _WIN32
+    return LoadLibraryA(libraryPath.c_str());
+#else
+    return dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+void* loadFunction_(void* library, const char* name)
+{
+#ifdef _WIN32
+    return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+    return dlsym(library, name);
+#endif
+}
+
+void freeLibrary_(void* library)
+{
+#ifdef _WIN32
+    FreeLibrary(static_cast<HMODULE>(library));
+#else
+    dlclose(library);
+#endif
+}
+
+}   // namespace
+
+//----------------------------------------------------------------------------------------------------------------------
+
+shared_ptr<Predictor> CompiledPredictor::createInstance(shared_ptr<Predictor> predictor, const string& libraryPath)
+{
+    return makeShared<CompiledPredictor>(predictor, libraryPath);
+}
+
+CompiledPredictor::CompiledPredictor(shared_ptr<Predictor> predictor, const string& libraryPath) :
+    Predictor(predictor->variableCount()), predictor_(predictor), library_(loadLibrary_(libraryPath))
+{
+    if (library_ == nullptr)
+        throw std::runtime_error("Unable to load the library " + libraryPath + ".");
+
+    auto variableCount = reinterpret_cast<VariableCountFunction_>(loadFunction_(library_, "jrboostVariableCount"));
+    auto fingerprint = reinterpret_cast<FingerprintFunction_>(loadFunction_(library_, "jrboostFingerprint"));
+    predict_ = reinterpret_cast<PredictFunction_>(loadFunction_(library_, "jrboostPredict"));
+    if (variableCount == nullptr || fingerprint == nullptr || predict_ == nullptr) {
+        freeLibrary_(library_);
+        throw std::runtime_error("The library " + libraryPath + " is not a compiled JrBoost predictor.");
+    }
+    if (variableCount() != predictor->variableCount() || fingerprint() != predictor->fingerprint_()) {
+        freeLibrary_(library_);
+        throw std::runtime_error("The library " + libraryPath + " was not compiled from this predictor.");
+    }
+}
+
+CompiledPredictor::~CompiledPredictor() { freeLibrary_(library_); }
+
+
+ArrayXd CompiledPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const ptrdiff_t rowStride = inData.innerStride();
+    const ptrdiff_t colStride = inData.outerStride();
+    ArrayXd pred(sampleCount);
+
+    const size_t minSampleCountPerThread = 256;
+    threadCount = std::min(threadCount, divideRoundUp(sampleCount, minSampleCountPerThread));
+    if (threadCount <= 1) {
+        predict_(inData.data(), rowStride, colStride, sampleCount, pred.data());
+        return pred;
+    }
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        const size_t id = omp_get_thread_num();
+        const size_t iBegin = (sampleCount * id) / threadCount;
+        const size_t iEnd = (sampleCount * (id + 1)) / threadCount;
+        predict_(inData.data() + iBegin * rowStride, rowStride, colStride, iEnd - iBegin, pred.data() + iBegin);
+    }
+    END_OMP_PARALLEL
+
+    return pred;
+}
+
+void CompiledPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
+{
+    predict_(inData, rowStride, colStride, sampleCount, outData);
+}
+
+ArrayXf CompiledPredictor::variableWeightsImpl_() const { return predictor_->variableWeightsImpl_(); }
+
+void CompiledPredictor::usedVariablesImpl_(RefXu8 used) const { predictor_->usedVariablesImpl_(used); }
+
+// the compiled code has the variable indices built in, so the reindexed predictor is not compiled
+shared_ptr<Predictor> CompiledPredictor::reindexVariablesImpl_(CRefXs newIndices) const
+{
+    return predictor_->reindexVariablesImpl_(newIndices);
+}
+
+// the compiled code can not be reindexed, so the reindexed predictor is a reindexed source predictor
+bool CompiledPredictor::reindexesEfficiently_() const { return false; }
+
+void CompiledPredictor::saveImpl_(ostream& os) const { predictor_->saveImpl_(os); }
+
+size_t CompiledPredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    return predictor_->saveCodeImpl_(os, functionCount);
+}
+
+shared_ptr<Predictor> CompiledPredictor::quantizeImpl_() const { return predictor_->quantizeImpl_(); }
+
+shared_ptr<Predictor> CompiledPredictor::flattenImpl_() const { return predictor_->flattenImpl_(); }
+
+ArrayXXdc CompiledPredictor::shapValuesImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    return predictor_->shapValuesImpl_(inData, threadCount);
+}
+
+ArrayXd CompiledPredictor::permutationImportanceImpl_(
+    CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+    const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const
+{
+    return predictor_->permutationImportanceImpl_(inData, outData, lossFun, permutations, weights, threadCount);
+}
@@ -0,0 +1,48 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "Predictor.h"
+
+// A predictor that uses a shared library (.dll or .so) compiled from the C source code written by
+// Predictor::saveCode(). The compiled code is used for prediction. Everything else is delegated to the source predictor.
+// Saving a compiled predictor saves the source predictor.
+// The constructor checks that the library was compiled from the code of the source predictor; the code contains a hash
+// of the saved source predictor.
+
+class CompiledPredictor : public Predictor {   // immutable class
+public:
+    static shared_ptr<Predictor> createInstance(shared_ptr<Predictor> predictor, const string& libraryPath);
+
+private:
+    CompiledPredictor(shared_ptr<Predictor> predictor, const string& libraryPath);
+
+    virtual ~CompiledPredictor();
+    virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
+    virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
+    virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
+    virtual bool reindexesEfficiently_() const;
+    virtual void saveImpl_(ostream& os) const;
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
+    virtual ArrayXXdc shapValuesImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual ArrayXd permutationImportanceImpl_(
+        CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+        const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const;
+
+    using VariableCountFunction_ = size_t (*)();
+    using FingerprintFunction_ = uint64_t (*)();
+    using PredictFunction_ = void (*)(const float*, ptrdiff_t, ptrdiff_t, size_t, double*);
+
+    shared_ptr<Predictor> predictor_;
+    void* library_;
+    PredictFunction_ predict_;
+
+    friend class MakeSharedHelper<CompiledPredictor>;
+};
@@ -0,0 +1,90 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "Dataset.h"
+
+#include "Tree.h"
+#include "TreeTrainer.h"
+
+
+Dataset::Dataset(ArrayXXfc inData, optional<ArrayXu8> categorical, PairVariables pairs) :
+    Dataset(singleBlock_(std::move(inData)), std::move(categorical), std::move(pairs))
+{
+}
+
+Dataset::Dataset(vector<ArrayXXfc> inDataBlocks, optional<ArrayXu8> categorical, PairVariables pairs) :
+    sampleCount_{
+        (validateData_(inDataBlocks, categorical, pairs),   // do validation before anything else
+         static_cast<size_t>(inDataBlocks[0].rows()))},
+    variableCount_{std::accumulate(
+        begin(inDataBlocks), end(inDataBlocks), size_t{0},
+        [](size_t n, const ArrayXXfc& block) { return n + static_cast<size_t>(block.cols()); })},
+    inDataBlocks_{std::move(inDataBlocks)},
+    pairs_{std::move(pairs)},
+    categorical_{initCategorical_(std::move(categorical), variableCount_, pairs_.pairCount())},
+    treeTrainer_{TreeTrainer::createInstance(this->inDataBlocks(), categorical_, pairs_)}
+{
+}
+
+Dataset::~Dataset() = default;
+
+
+vector<ArrayXXfc> Dataset::singleBlock_(ArrayXXfc inData)
+{
+    vector<ArrayXXfc> inDataBlocks;
+    inDataBlocks.push_back(std::move(inData));   // an initializer list would copy the indata
+    return inDataBlocks;
+}
+
+// the pair variables are not categorical
+ArrayXu8 Dataset::initCategorical_(optional<ArrayXu8> categorical, size_t variableCount, size_t pairCount)
+{
+    ArrayXu8 allCategorical = ArrayXu8::Zero(variableCount + pairCount);
+    if (categorical)
+        allCategorical.head(variableCount) = *categorical;
+    return allCategorical;
+}
+
+void Dataset::validateData_(
+    const vector<ArrayXXfc>& inDataBlocks, optional<CRefXu8> categorical, const PairVariables& pairs)
+{
+    if (inDataBlocks.empty())
+        throw std::invalid_argument("Train indata has 0 blocks.");
+
+    const size_t sampleCount = static_cast<size_t>(inDataBlocks[0].rows());
+    size_t variableCount = 0;
+    for (const auto& block : inDataBlocks) {
+        if (static_cast<size_t>(block.rows()) != sampleCount)
+            throw std::invalid_argument("Train indata blocks have different numbers of samples.");
+        variableCount += static_cast<size_t>(block.cols());
+    }
+
+    if (sampleCount == 0)
+        throw std::invalid_argument("Train indata has 0 samples.");
+    if (variableCount == 0)
+        throw std::invalid_argument("Train indata has 0 variables.");
+    for (const auto& block : inDataBlocks) {
+        if (block.isInf().any())
+            throw std::invalid_argument("Train indata has values that are infinity.");
+    }
+    pairs.validate(variableCount);
+
+    if (categorical) {
+        if (static_cast<size_t>(categorical->rows()) != variableCount)
+            throw std::invalid_argument("Train indata and categorical flags have different numbers of variables.");
+        const vector<const float*> columns = inDataColumns(vector<CRefXXfc>(begin(inDataBlocks), end(inDataBlocks)));
+        const float maxCategoryCount = static_cast<float>(TreeTools::maxCategoryCount);
+        for (size_t j = 0; j != variableCount; ++j) {
+            if ((*categorical)(j) == 0)
+                continue;
+            const auto x = Eigen::Map<const ArrayXf>(columns[j], sampleCount);
+            if (!(x.isNaN() || (x >= 0.0f && x < maxCategoryCount && x == x.floor())).all())
+                throw std::invalid_argument(
+                    "Train indata has categorical values that are not integers in the range 0 to "
+                    + std::to_string(TreeTools::maxCategoryCount - 1) + " or missing (NaN).");
+        }
+    }
+}
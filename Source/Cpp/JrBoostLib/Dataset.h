@@ -0,0 +1,52 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "PairVariables.h"
+
+class TreeTrainer;
+
+
+// The train indata together with the presorted samples of each variable.
+// Presorting is the expensive part of setting up training, so one dataset can be shared by many boost trainers
+// with different outdata, weights and strata (e.g. one trainer per outcome, or per permutation of the labels).
+// The indata can be given as several blocks with the same samples (e.g. expression data and derived features).
+// The blocks are treated as one matrix, with the variables of the first block first, then the variables of the second
+// block, and so on, but they are never concatenated.
+// Pair variables (see PairVariables.h) can be added after the variables of the indata; they are presorted once,
+// but their values are never stored.
+
+class Dataset {   // immutable class
+public:
+    Dataset(
+        ArrayXXfc inData, optional<ArrayXu8> categorical = std::nullopt, PairVariables pairs = PairVariables());
+    Dataset(
+        vector<ArrayXXfc> inDataBlocks, optional<ArrayXu8> categorical = std::nullopt,
+        PairVariables pairs = PairVariables());
+    Dataset(const Dataset&) = delete;
+    Dataset& operator=(const Dataset&) = delete;
+    ~Dataset();
+
+    size_t sampleCount() const { return sampleCount_; }
+    size_t variableCount() const { return variableCount_; }   // not including the pair variables
+    const PairVariables& pairs() const { return pairs_; }
+    vector<CRefXXfc> inDataBlocks() const { return vector<CRefXXfc>(begin(inDataBlocks_), end(inDataBlocks_)); }
+
+private:
+    static vector<ArrayXXfc> singleBlock_(ArrayXXfc inData);
+    static void validateData_(
+        const vector<ArrayXXfc>& inDataBlocks, optional<CRefXu8> categorical, const PairVariables& pairs);
+    static ArrayXu8 initCategorical_(optional<ArrayXu8> categorical, size_t variableCount, size_t pairCount);
+
+    const size_t sampleCount_;
+    const size_t variableCount_;
+    const vector<ArrayXXfc> inDataBlocks_;
+    const PairVariables pairs_;
+    const ArrayXu8 categorical_;                  // categorical_(j) != 0 if variable j is categorical
+    const unique_ptr<TreeTrainer> treeTrainer_;   // owns the presorted samples
+
+    friend class BoostTrainer;
+    friend class MultinomialTrainer;
+};
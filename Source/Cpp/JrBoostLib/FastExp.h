@@ -33,6 +33,8 @@
 #include <cstring>
 #include <immintrin.h>
 
+#include "SimdLevel.h"
+
 //------------------------------------------------------------------------------
 
 // The double precision versions of fastExp(x) behave as follows:
@@ -70,7 +72,7 @@ inline double fastExp(double x)
     return x;
 }
 
-inline __m512d fastExp(__m512d x8)   // requires AVX-512F + AVX-512DQ
+SIMD_TARGET_AVX512 inline __m512d fastExp(__m512d x8)   // requires AVX-512F + AVX-512DQ
 {
     const double a = (1LL << 52) / 0.6931471805599453;
     const double b = (1LL << 52) * (1023 - 0.0436774489036);
@@ -90,7 +92,7 @@ inline __m512d fastExp(__m512d x8)   // requires AVX-512F + AVX-512DQ
     return x8;
 }
 
-inline __m256d fastExp(__m256d x4)   // requires AVX2
+SIMD_TARGET_AVX2 inline __m256d fastExp(__m256d x4)   // requires AVX2
 {
     // AVX2 does not support conversion from double to int64_t.
     // This implementation avoids that conversion.
@@ -162,7 +164,7 @@ inline float fastExp(float x)
     return x;
 }
 
-inline __m512 fastExp(__m512 x16)   // requires AVX-512F + AVX-512DQ
+SIMD_TARGET_AVX512 inline __m512 fastExp(__m512 x16)   // requires AVX-512F + AVX-512DQ
 {
     constexpr float a = (1 << 23) / 0.6931472f;
     constexpr float b = (1 << 23) * (127 - 0.04368f) + 0.5f;
@@ -182,7 +184,7 @@ inline __m512 fastExp(__m512 x16)   // requires AVX-512F + AVX-512DQ
     return x16;
 }
 
-inline __m256 fastExp(__m256 x8)   // requires AVX2
+SIMD_TARGET_AVX2 inline __m256 fastExp(__m256 x8)   // requires AVX2
 {
     constexpr float a = (1 << 23) / 0.6931472f;
     constexpr float b = (1 << 23) * (127 - 0.04368f) + 0.5f;
@@ -0,0 +1,220 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+// Approximate double precision exp, log and log1p with selectable accuracy.
+//
+// The functions are written as branch-free scalar code without library calls and without conversions between double
+// and int64_t (AVX2 has no such instructions), so that the compiler can vectorize loops that call them
+// (GCC does it in loops marked with PRAGMA_OMP_SIMD_SUM below, also without -ffast-math).
+// The bits of the floating point numbers are manipulated with memcpy, as in FastExp.h.
+//
+// The template parameter DIGITS selects the accuracy:
+//     DIGITS = 1:  relative error < 0.03 (exp only, Schraudolph's method, same as fastExp() in FastExp.h with AVX2)
+//     DIGITS = 4:  relative error < 1e-4
+//     DIGITS = 8:  relative error < 1e-8
+//     DIGITS = 14: relative error < 1e-14
+// For log and log1p the bounds apply to the parts computed with a polynomial; see the comments below.
+//
+// approxExp(x) underflows and overflows as exp(x) does. The functions do not handle NaN.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// PRAGMA_OMP_SIMD_SUM(x) marks a loop for vectorization with sum reduction of the variable x.
+// #pragma omp simd requires OpenMP 4.0; Visual C++ only supports OpenMP 2.0, and then the macro expands to nothing.
+
+#if defined(_OPENMP) && _OPENMP >= 201307
+#define PRAGMA_OMP_SIMD_SUM_IMPL_(x) _Pragma(#x)
+#define PRAGMA_OMP_SIMD_SUM(x) PRAGMA_OMP_SIMD_SUM_IMPL_(omp simd reduction(+ : x))
+#else
+#define PRAGMA_OMP_SIMD_SUM(x)
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace FastMathImpl_ {
+
+inline uint64_t toBits(double x)
+{
+    uint64_t n;
+    std::memcpy(&n, &x, 8);
+    return n;
+}
+
+inline double fromBits(uint64_t n)
+{
+    double x;
+    std::memcpy(&x, &n, 8);
+    return x;
+}
+
+// adding (and then subtracting) 1.5 * 2^52 rounds a double with absolute value < 2^51 to an integer,
+// and leaves the integer in the low bits of the binary representation
+constexpr double magic = 6755399441055744.0;
+
+// coefficients of the Taylor polynomial of exp: 1 / k!
+template<int N>
+constexpr std::array<double, N + 1> makeExpCoefficients()
+{
+    std::array<double, N + 1> c{};
+    c[0] = 1.0;
+    for (int k = 1; k <= N; ++k)
+        c[k] = c[k - 1] / k;
+    return c;
+}
+
+template<int N>
+inline constexpr std::array<double, N + 1> expCoefficients = makeExpCoefficients<N>();
+
+// coefficients of the series log((1 + s) / (1 - s)) = 2 * (s + s^3 / 3 + s^5 / 5 + ...): 2 / (2k + 1)
+template<int N>
+constexpr std::array<double, N + 1> makeLogCoefficients()
+{
+    std::array<double, N + 1> c{};
+    for (int k = 0; k <= N; ++k)
+        c[k] = 2.0 / (2 * k + 1);
+    return c;
+}
+
+template<int N>
+inline constexpr std::array<double, N + 1> logCoefficients = makeLogCoefficients<N>();
+
+// c[I] + c[I + 1] * x + c[I + 2] * x^2 + ... evaluated with Horner's method;
+// the recursion is unrolled at compile time, which the vectorizer needs
+template<size_t I, size_t M>
+inline double horner(const std::array<double, M>& c, double x)
+{
+    if constexpr (I + 1 == M)
+        return c[I];
+    else
+        return horner<I + 1>(c, x) * x + c[I];
+}
+
+// degree of the polynomial of exp and number of terms of the series of log
+template<int DIGITS>
+struct Degrees;
+
+template<>
+struct Degrees<4> {
+    static constexpr int exp = 5;
+    static constexpr int log = 2;
+};
+
+template<>
+struct Degrees<8> {
+    static constexpr int exp = 7;
+    static constexpr int log = 4;
+};
+
+template<>
+struct Degrees<14> {
+    static constexpr int exp = 11;
+    static constexpr int log = 8;
+};
+
+}   // namespace FastMathImpl_
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// x = k * log(2) + r with integer k and |r| <= log(2) / 2, and exp(x) = 2^k * exp(r),
+// where exp(r) is given by its Taylor polynomial (Cody and Waite 1980).
+
+template<int DIGITS>
+inline double approxExp(double x)
+{
+    using namespace FastMathImpl_;
+
+    if constexpr (DIGITS == 1) {
+
+        // the scalar version of fastExp(__m256d) in FastExp.h
+
+        const double a = (1 << 20) / 0.6931471805599453;
+        const double b = (1 << 20) * (1023 - 0.0436774489036) + 0.5;
+        double y = a * x + b;
+        y = std::max(0.0, y);
+        y = std::min(y, static_cast<double>(2047 << 20));
+        const int32_t m = static_cast<int32_t>(y);
+        const uint64_t n = static_cast<uint64_t>(static_cast<uint32_t>(m)) << 32;
+        return fromBits(n);
+    }
+
+    else {
+        const double log2e = 1.4426950408889634;
+        const double ln2Hi = 0.693145751953125;   // the first 20 bits of log(2)
+        const double ln2Lo = 1.4286068203094173e-06;
+
+        // exp(x) underflows to 0 for x < -745.2 and overflows to infinity for x > 709.8, so we clamp x to
+        // [-750, 750]. The clamping is done on the binary representation of |x|, with integer min; clamping with
+        // floating point min and max gives branches, and then GCC duplicates code and gives up vectorization.
+        const double x0 = std::copysign(fromBits(std::min(toBits(std::abs(x)), toBits(750.0))), x);
+
+        // kBits holds k in its low bits; k is recovered as a double without int64_t to double conversion
+        const uint64_t kBits = toBits(x0 * log2e + magic);
+        const double k = fromBits(kBits) - magic;
+        const double r = (x0 - k * ln2Hi) - k * ln2Lo;
+
+        const double p = horner<0>(expCoefficients<Degrees<DIGITS>::exp>, r);
+
+        // Multiply by 2^k = 2^k1 * 2^k2 with k1 = k / 2 rounded and k2 = k - k1.
+        // 2^k1 and 2^k2 are normal numbers, so the multiplications give the correct result also when it
+        // underflows to a subnormal number or 0, or overflows to infinity.
+        const uint64_t k1Bits = toBits(0.5 * k + magic);
+        const double k2 = k - (fromBits(k1Bits) - magic);
+        const uint64_t k2Bits = toBits(k2 + magic);
+        const double twoK1 = fromBits((k1Bits - toBits(magic) + 1023) << 52);
+        const double twoK2 = fromBits((k2Bits - toBits(magic) + 1023) << 52);
+
+        return p * twoK1 * twoK2;
+    }
+}
+
+
+// x = 2^e * m with integer e and sqrt(1/2) <= m < sqrt(2), and log(x) = e * log(2) + log(m),
+// where log(m) is given by the series in s = (m - 1) / (m + 1).
+// The bound on the relative error applies to log(m); the error of e * log(2) is at most a few ulps.
+// x must be positive and finite (not subnormal).
+
+template<int DIGITS>
+inline double approxLog(double x)
+{
+    using namespace FastMathImpl_;
+
+    const double ln2 = 0.6931471805599453;
+    const uint64_t mantissaMask = (uint64_t{1} << 52) - 1;
+
+    // m is the mantissa of x scaled to [1, 2) or, if it is greater than sqrt(2), to [sqrt(1/2), 1);
+    // e is the exponent of x, obtained as a double without int64_t to double conversion.
+    // The choice is made with integer comparison and selection between constants;
+    // selection between computed floating point values gives branches that GCC does not vectorize.
+    const uint64_t bits = toBits(x);
+    const uint64_t mantissa = bits & mantissaMask;
+    const bool b = mantissa > (toBits(1.4142135623730951) & mantissaMask);
+    const double m = fromBits(mantissa | toBits(b ? 0.5 : 1.0));
+    const double e = fromBits((bits >> 52) | toBits(4503599627370496.0)) - (4503599627370496.0 + (b ? 1022.0 : 1023.0));
+
+    const double s = (m - 1.0) / (m + 1.0);
+    const double s2 = s * s;
+    const double p = horner<0>(logCoefficients<Degrees<DIGITS>::log>, s2);
+
+    return e * ln2 + s * p;
+}
+
+
+// log(1 + x) for x > -1, accurate also for small x;
+// u = 1 + x is rounded, and the term (x - (u - 1)) / u corrects for the rounding error.
+// x must be finite.
+
+template<int DIGITS>
+inline double approxLog1p(double x)
+{
+    const double u = 1.0 + x;
+    return approxLog<DIGITS>(u) + (x - (u - 1.0)) / u;
+}
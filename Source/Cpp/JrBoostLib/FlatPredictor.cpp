@@ -0,0 +1,474 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "FlatPredictor.h"
+
+#include "Base128Encoding.h"
+#include "MappedFile.h"
+#include "OmpParallel.h"
+#include "QuantizedPredictor.h"
+#include "Tree.h"
+
+
+shared_ptr<Predictor> FlatPredictor::createInstance(
+    double c0, const vector<pair<double, vector<TreeNode>>>& trees, const ArrayXf& variableWeights)
+{
+    if (static_cast<size_t>(variableWeights.size()) > maxVariableCount_)
+        throw std::runtime_error("The predictor has too many variables to be flattened.");
+
+    vector<Tree_> flatTrees;
+    vector<Node_> flatNodes;
+    flatTrees.reserve(size(trees));
+    for (const auto& [c, nodes] : trees) {
+        flatTrees.push_back({size(flatNodes), c});
+        initNodes_(data(nodes), flatNodes);
+    }
+    vector<Member_> members{{size(trees), c0, 1.0}};
+    return makeShared<FlatPredictor>(false, move(members), variableWeights, move(flatTrees), move(flatNodes));
+}
+
+FlatPredictor::FlatPredictor(
+    bool isUnion, vector<Member_>&& members, const ArrayXf& variableWeights, vector<Tree_>&& trees,
+    vector<Node_>&& nodes) :
+    Predictor(variableWeights.size()),
+    isUnion_(isUnion),
+    members_(move(members)),
+    variableWeights_(variableWeights),
+    ownedTrees_(move(trees)),
+    ownedNodes_(move(nodes)),
+    trees_(data(ownedTrees_)),
+    treeCount_(size(ownedTrees_)),
+    nodes_(data(ownedNodes_)),
+    nodeCount_(size(ownedNodes_))
+{
+}
+
+FlatPredictor::FlatPredictor(
+    bool isUnion, vector<Member_>&& members, const ArrayXf& variableWeights, shared_ptr<const MappedFile> mappedFile,
+    const Tree_* trees, size_t treeCount, const Node_* nodes, size_t nodeCount) :
+    Predictor(variableWeights.size()),
+    isUnion_(isUnion),
+    members_(move(members)),
+    variableWeights_(variableWeights),
+    mappedFile_(mappedFile),
+    trees_(trees),
+    treeCount_(treeCount),
+    nodes_(nodes),
+    nodeCount_(nodeCount)
+{
+}
+
+void FlatPredictor::initNodes_(const TreeNode* node, vector<Node_>& nodes)
+{
+    const size_t k = size(nodes);
+    nodes.emplace_back();
+
+    if (node->isLeaf) {
+        nodes[k] = {0, 0, 0.0f, node->y};
+        return;
+    }
+
+    initNodes_(node->leftChild, nodes);
+    const size_t rightChild = size(nodes) - k;
+    initNodes_(node->rightChild, nodes);
+
+    const bool isCategorical = (node->leftCategories != 0);
+    nodes[k] = {
+        Node_::makeJFlags(node->j, isCategorical, node->defaultLeft), static_cast<uint32_t>(rightChild), node->x,
+        0.0f};
+    if (isCategorical)
+        std::memcpy(&nodes[k].x, &node->leftCategories, sizeof(node->leftCategories));
+}
+
+uint64_t FlatPredictor::leftCategories_(const Node_& node)
+{
+    static_assert(offsetof(Node_, y) == offsetof(Node_, x) + sizeof(float));
+    uint64_t leftCategories;
+    std::memcpy(&leftCategories, &node.x, sizeof(leftCategories));
+    return leftCategories;
+}
+
+bool FlatPredictor::goesLeft_(const Node_& node, float x)
+{
+    if (node.isCategorical())
+        return TreeTools::categoryGoesLeft(leftCategories_(node), node.defaultLeft(), x);
+    return TreeTools::numericalGoesLeft(node.x, node.defaultLeft(), x);
+}
+
+shared_ptr<Predictor> FlatPredictor::merge_(const vector<shared_ptr<Predictor>>& predictors, bool isUnion)
+{
+    vector<const FlatPredictor*> flatPredictors;
+    size_t variableCount = 0;
+    for (const auto& predictor : predictors) {
+        const FlatPredictor* flatPredictor = dynamic_cast<const FlatPredictor*>(predictor.get());
+        if (flatPredictor == nullptr || (size(flatPredictor->members_) > 1 && flatPredictor->isUnion_ != isUnion))
+            return nullptr;
+        flatPredictors.push_back(flatPredictor);
+        variableCount = std::max(variableCount, flatPredictor->variableCount());
+    }
+
+    // same variable weights as EnsemblePredictor and UnionPredictor
+    const size_t predictorCount = size(predictors);
+    ArrayXf variableWeights = ArrayXf::Zero(variableCount);
+    vector<Member_> members;
+    vector<Tree_> trees;
+    vector<Node_> nodes;
+    for (const FlatPredictor* flatPredictor : flatPredictors) {
+        variableWeights(Eigen::seqN(0, flatPredictor->variableCount())) += flatPredictor->variableWeights_;
+        for (Member_ member : flatPredictor->members_) {
+            member.weight = isUnion ? 1.0 : member.weight / predictorCount;
+            members.push_back(member);
+        }
+        for (size_t k = 0; k != flatPredictor->treeCount_; ++k)
+            trees.push_back({flatPredictor->trees_[k].root + size(nodes), flatPredictor->trees_[k].c});
+        nodes.insert(end(nodes), flatPredictor->nodes_, flatPredictor->nodes_ + flatPredictor->nodeCount_);
+    }
+    if (!isUnion)
+        variableWeights /= static_cast<float>(predictorCount);
+
+    return makeShared<FlatPredictor>(isUnion, move(members), variableWeights, move(trees), move(nodes));
+}
+
+vector<pair<double, vector<TreeNode>>> FlatPredictor::toTrees_(size_t treeBegin, size_t treeEnd) const
+{
+    vector<pair<double, vector<TreeNode>>> trees;
+    trees.reserve(treeEnd - treeBegin);
+    for (size_t k = treeBegin; k != treeEnd; ++k) {
+        const size_t root = trees_[k].root;
+        const size_t end = (k + 1 == treeCount_) ? nodeCount_ : trees_[k + 1].root;
+        vector<TreeNode> nodes(end - root);
+        for (size_t i = 0; i != end - root; ++i) {
+            const Node_& flatNode = nodes_[root + i];
+            TreeNode& node = nodes[i];
+            node.isLeaf = (flatNode.rightChild == 0);
+            node.y = node.isLeaf ? flatNode.y : numeric_limits<float>::quiet_NaN();
+            if (!node.isLeaf) {
+                node.defaultLeft = flatNode.defaultLeft();
+                node.j = flatNode.j();
+                node.x = flatNode.isCategorical() ? numeric_limits<float>::quiet_NaN() : flatNode.x;
+                node.leftCategories = flatNode.isCategorical() ? leftCategories_(flatNode) : 0;
+                node.gain = numeric_limits<float>::quiet_NaN();
+                node.leftChild = &nodes[i + 1];
+                node.rightChild = &nodes[i + flatNode.rightChild];
+            }
+        }
+        trees.emplace_back(trees_[k].c, move(nodes));
+    }
+    return trees;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+ArrayXd FlatPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t blockCount = divideRoundUp(sampleCount, blockSize_);
+    ArrayXd pred(sampleCount);
+    if (blockCount == 0)
+        return pred;
+
+    threadCount = std::min(threadCount, blockCount);
+    std::atomic<size_t> nextBlock = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        while (true) {
+            const size_t block = nextBlock++;
+            if (block >= blockCount)
+                break;
+            const size_t iBegin = block * blockSize_;
+            const size_t iEnd = std::min(iBegin + blockSize_, sampleCount);
+            predictBlock_(inData, iBegin, iEnd, pred);
+        }
+    }
+    END_OMP_PARALLEL
+
+    return pred;
+}
+
+void FlatPredictor::predictBlock_(CRefXXfc inData, size_t iBegin, size_t iEnd, RefXd pred) const
+{
+    // one tree at a time for all samples in the block, so that each tree stays in the cache
+
+    const ptrdiff_t s = inData.outerStride();
+    const size_t n = iEnd - iBegin;
+    double memberPred[blockSize_];
+
+    pred(Eigen::seqN(iBegin, n)) = isUnion_ ? 1.0 : 0.0;
+    size_t k = 0;
+    for (const Member_& member : members_) {
+        std::fill(memberPred, memberPred + n, member.c0);
+        for (const size_t kEnd = k + member.treeCount; k != kEnd; ++k) {
+            const Node_* root = nodes_ + trees_[k].root;
+            const double c = trees_[k].c;
+            for (size_t i = 0; i != n; ++i) {
+                const float* x = inData.data() + iBegin + i;
+                const Node_* node = root;
+                while (node->rightChild != 0) {
+                    const float xj = x[node->j() * s];
+                    node += goesLeft_(*node, xj) ? 1 : node->rightChild;
+                }
+                memberPred[i] += c * node->y;
+            }
+        }
+
+        for (size_t i = 0; i != n; ++i) {
+            const double p = 1.0 / (1.0 + std::exp(-memberPred[i]));
+            if (isUnion_)
+                pred(iBegin + i) *= 1.0 - p;
+            else
+                pred(iBegin + i) += member.weight * p;
+        }
+    }
+
+    if (isUnion_)
+        pred(Eigen::seqN(iBegin, n)) = 1.0 - pred(Eigen::seqN(iBegin, n));
+}
+
+void FlatPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
+{
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const float* x = inData + static_cast<ptrdiff_t>(i) * rowStride;
+        double pred = isUnion_ ? 1.0 : 0.0;
+        size_t k = 0;
+        for (const Member_& member : members_) {
+            double memberPred = member.c0;
+            for (const size_t kEnd = k + member.treeCount; k != kEnd; ++k) {
+                const Node_* node = nodes_ + trees_[k].root;
+                while (node->rightChild != 0) {
+                    const float xj = x[node->j() * colStride];
+                    node += goesLeft_(*node, xj) ? 1 : node->rightChild;
+                }
+                memberPred += trees_[k].c * node->y;
+            }
+            const double p = 1.0 / (1.0 + std::exp(-memberPred));
+            if (isUnion_)
+                pred *= 1.0 - p;
+            else
+                pred += member.weight * p;
+        }
+        outData[i] = isUnion_ ? 1.0 - pred : pred;
+    }
+}
+
+ArrayXf FlatPredictor::variableWeightsImpl_() const { return variableWeights_; }
+
+void FlatPredictor::usedVariablesImpl_(RefXu8 used) const
+{
+    for (size_t k = 0; k != nodeCount_; ++k) {
+        if (nodes_[k].rightChild != 0)
+            used(nodes_[k].j()) = 1;
+    }
+}
+
+shared_ptr<Predictor> FlatPredictor::reindexVariablesImpl_(CRefXs newIndices) const
+{
+    vector<Node_> nodes(nodes_, nodes_ + nodeCount_);
+    size_t newVariableCount = 0;
+    for (Node_& node : nodes) {
+        if (node.rightChild == 0)
+            continue;
+        const size_t j = newIndices(node.j());
+        if (j >= maxVariableCount_)
+            throw std::runtime_error("The predictor has too many variables to be flattened.");
+        node.setJ(j);
+        newVariableCount = std::max(newVariableCount, j + 1);
+    }
+
+    for (size_t j = 0; j != variableCount(); ++j) {
+        if (variableWeights_(j) != 0.0f)
+            newVariableCount = std::max(newVariableCount, newIndices(j) + 1);
+    }
+    ArrayXf newVariableWeights = ArrayXf::Zero(newVariableCount);
+    for (size_t j = 0; j != variableCount(); ++j) {
+        if (variableWeights_(j) != 0.0f)
+            newVariableWeights(newIndices(j)) += variableWeights_(j);
+    }
+
+    vector<Member_> members = members_;
+    vector<Tree_> trees(trees_, trees_ + treeCount_);
+    return makeShared<FlatPredictor>(isUnion_, move(members), newVariableWeights, move(trees), move(nodes));
+}
+
+size_t FlatPredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    // one function per member, followed by a function that combines the members
+
+    vector<size_t> memberFunctions;
+    size_t treeBegin = 0;
+    for (const Member_& member : members_) {
+        const size_t k = (*functionCount)++;
+        os << "static double predictor" << k << "(const float* x, ptrdiff_t s)\n{\n";
+        os << "    double pred = " << member.c0 << ";\n";
+        for (const auto& [c, nodes] : toTrees_(treeBegin, treeBegin + member.treeCount))
+            TreeTools::saveTreeCode(data(nodes), os, c, 1);
+        os << "    return 1.0 / (1.0 + exp(-pred));\n}\n\n";
+        memberFunctions.push_back(k);
+        treeBegin += member.treeCount;
+    }
+
+    if (size(members_) == 1 && !isUnion_)
+        return memberFunctions[0];
+
+    const size_t k = (*functionCount)++;
+    os << "static double predictor" << k << "(const float* x, ptrdiff_t s)\n{\n";
+    if (isUnion_) {
+        os << "    double pred = 1.0;\n";
+        for (size_t m = 0; m != size(members_); ++m)
+            os << "    pred *= 1.0 - predictor" << memberFunctions[m] << "(x, s);\n";
+        os << "    return 1.0 - pred;\n}\n\n";
+    }
+    else {
+        os << "    double pred = 0.0;\n";
+        for (size_t m = 0; m != size(members_); ++m)
+            os << "    pred += " << members_[m].weight << " * predictor" << memberFunctions[m] << "(x, s);\n";
+        os << "    return pred;\n}\n\n";
+    }
+    return k;
+}
+
+// Quantized predictors have a single member.
+// A flat predictor with several members is returned as is; it is already a compact representation of the model,
+// and the ensemble or union it was flattened from can be quantized member by member instead.
+shared_ptr<Predictor> FlatPredictor::quantizeImpl_() const
+{
+    if (size(members_) != 1 || isUnion_)
+        return sharedFromThis_();
+    return QuantizedPredictor::createInstance(sharedFromThis_(), members_[0].c0, toTrees_(0, treeCount_));
+}
+
+shared_ptr<Predictor> FlatPredictor::flattenImpl_() const { return sharedFromThis_(); }
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// The tree and node arrays are aligned relative to the start of the stream.
+// The stream starts at the beginning of the file, so they are also aligned in memory when the file is memory mapped.
+
+void FlatPredictor::saveImpl_(ostream& os) const
+{
+    static_assert(sizeof(Node_) == 16 && sizeof(Tree_) == 16);   // part of the file format
+
+    os.put('L');
+    os.put(isUnion_ ? 'U' : 'E');
+    base128Save(os, size(members_));
+    for (const Member_& member : members_) {
+        base128Save(os, member.treeCount);
+        os.write(reinterpret_cast<const char*>(&member.c0), sizeof(member.c0));
+        os.write(reinterpret_cast<const char*>(&member.weight), sizeof(member.weight));
+    }
+    base128Save(os, variableCount());
+    os.write(reinterpret_cast<const char*>(variableWeights_.data()), variableCount() * sizeof(float));
+    base128Save(os, treeCount_);
+    base128Save(os, nodeCount_);
+
+    const std::streamoff pos = os.tellp();
+    const size_t padding = (pos == -1) ? 0 : (alignment_ - (static_cast<size_t>(pos) + 1) % alignment_) % alignment_;
+    os.put(static_cast<char>(padding));
+    for (size_t i = 0; i != padding; ++i)
+        os.put(0);
+
+    os.write(reinterpret_cast<const char*>(trees_), treeCount_ * sizeof(Tree_));
+    os.write(reinterpret_cast<const char*>(nodes_), nodeCount_ * sizeof(Node_));
+}
+
+shared_ptr<Predictor> FlatPredictor::loadImpl_(istream& is, int version)
+{
+    bool isUnion = false;
+    vector<Member_> members;
+    if (version < 10) {
+        Member_ member{0, 0.0, 1.0};   // the tree count is set below
+        is.read(reinterpret_cast<char*>(&member.c0), sizeof(member.c0));
+        members.push_back(member);
+    }
+    else {
+        const int combination = is.get();
+        if (combination != 'E' && combination != 'U')
+            parseError(is);
+        isUnion = (combination == 'U');
+        const size_t memberCount = base128Load(is);
+        for (size_t m = 0; m != memberCount; ++m) {
+            Member_ member;
+            member.treeCount = base128Load(is);
+            is.read(reinterpret_cast<char*>(&member.c0), sizeof(member.c0));
+            is.read(reinterpret_cast<char*>(&member.weight), sizeof(member.weight));
+            members.push_back(member);
+        }
+    }
+
+    const size_t variableCount = base128Load(is);
+    ArrayXf variableWeights(variableCount);
+    is.read(reinterpret_cast<char*>(variableWeights.data()), variableCount * sizeof(float));
+    const size_t treeCount = base128Load(is);
+    const size_t nodeCount = base128Load(is);
+
+    if (version < 10)
+        members[0].treeCount = treeCount;
+    size_t remainingTreeCount = treeCount;
+    for (const Member_& member : members) {
+        if (member.treeCount > remainingTreeCount)
+            parseError(is);
+        remainingTreeCount -= member.treeCount;
+    }
+    if (remainingTreeCount != 0)
+        parseError(is);
+
+    const int padding = is.get();
+    if (padding < 0 || static_cast<size_t>(padding) >= alignment_)
+        parseError(is);
+    is.ignore(padding);
+
+    auto buffer = dynamic_cast<MappedStreamBuffer*>(is.rdbuf());
+    if (buffer != nullptr) {
+        const char* p = buffer->current();
+        const size_t available = buffer->file()->data() + buffer->file()->size() - p;
+        const size_t treeBytes = treeCount * sizeof(Tree_);
+        const size_t nodeBytes = nodeCount * sizeof(Node_);
+        if (treeCount > available / sizeof(Tree_) || nodeCount > available / sizeof(Node_)
+            || treeBytes + nodeBytes > available)
+            parseError(is);
+
+        if (reinterpret_cast<uintptr_t>(p) % alignment_ == 0) {
+            const Tree_* trees = reinterpret_cast<const Tree_*>(p);
+            const Node_* nodes = reinterpret_cast<const Node_*>(p + treeBytes);
+            validate_(trees, treeCount, nodes, nodeCount, variableCount, is);
+            buffer->skip(treeBytes + nodeBytes);
+            return makeShared<FlatPredictor>(
+                isUnion, move(members), variableWeights, buffer->file(), trees, treeCount, nodes, nodeCount);
+        }
+        // misaligned (the file was written to a stream without position information), fall through and copy
+    }
+
+    vector<Tree_> trees(treeCount);
+    vector<Node_> nodes(nodeCount);
+    is.read(reinterpret_cast<char*>(data(trees)), treeCount * sizeof(Tree_));
+    is.read(reinterpret_cast<char*>(data(nodes)), nodeCount * sizeof(Node_));
+    validate_(data(trees), treeCount, data(nodes), nodeCount, variableCount, is);
+    return makeShared<FlatPredictor>(isUnion, move(members), variableWeights, move(trees), move(nodes));
+}
+
+// Checks that every tree traversal stays within its tree and only reads valid variables.
+// This is a single linear pass over the node array.
+
+void FlatPredictor::validate_(
+    const Tree_* trees, size_t treeCount, const Node_* nodes, size_t nodeCount, size_t variableCount, istream& is)
+{
+    for (size_t k = 0; k != treeCount; ++k) {
+        const size_t root = trees[k].root;
+        const size_t end = (k + 1 == treeCount) ? nodeCount : trees[k + 1].root;
+        if ((k == 0 && root != 0) || root >= end || end > nodeCount)
+            parseError(is);
+        for (size_t i = root; i != end; ++i) {
+            const Node_& node = nodes[i];
+            if (node.rightChild == 0)
+                continue;
+            if (node.j() >= variableCount || node.rightChild < 2 || node.rightChild >= end - i)
+                parseError(is);
+        }
+    }
+    if (treeCount == 0 && nodeCount != 0)
+        parseError(is);
+}
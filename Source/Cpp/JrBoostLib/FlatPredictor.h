@@ -0,0 +1,124 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "Predictor.h"
+
+class MappedFile;
+struct TreeNode;
+
+// Flattened version of a boost predictor, or of an ensemble or union of boost predictors.
+// All trees are stored in one contiguous array of compact nodes and are evaluated without virtual function calls.
+// Only the variables used by the trees are read. This makes it well suited for low-latency prediction
+// with Predictor::predictUnchecked().
+//
+// The trees are grouped into members, one per boost predictor. The prediction of a member is the logistic function
+// of its constant term plus the weighted sum of its trees. The predictions of the members are then combined either
+// as a weighted mean (ensembles) or as 1 - (1 - p1) * (1 - p2) * ... (unions). A flattened boost predictor has one
+// member. Flattening an ensemble or union merges the members of its flattened predictors, provided they all combine
+// their members the same way, so nested ensembles (or nested unions) also become a single flat predictor.
+// The predictions are the same as those of the source predictor.
+//
+// Flat predictors have their own file format, with the tree and node arrays stored aligned and as is.
+// When loaded with Predictor::loadMapped(), they use the arrays in the memory mapped file directly.
+
+class FlatPredictor : public Predictor {   // immutable class
+public:
+    static shared_ptr<Predictor>
+    createInstance(double c0, const vector<pair<double, vector<TreeNode>>>& trees, const ArrayXf& variableWeights);
+
+private:
+    // The nodes are written to and read from files as is, so the layout of the bits of jFlags is fixed,
+    // rather than left to the compiler as with bit fields:
+    // bits 0 - 29 hold j, bit 30 isCategorical (0 in files saved before categorical splits)
+    // and bit 31 defaultLeft (0 in files saved before missing values were added).
+
+    struct Node_ {
+        static const uint32_t jMask = (uint32_t{1} << 30) - 1;
+        static const uint32_t isCategoricalMask = uint32_t{1} << 30;
+        static const uint32_t defaultLeftMask = uint32_t{1} << 31;
+
+        uint32_t jFlags;       // only used by interior nodes
+        uint32_t rightChild;   // offset to the right child, 0 for leaf nodes; the left child is the next node
+        float x;               // only used by numerical interior nodes
+        float y;               // only used by leaf nodes
+        // categorical interior nodes store the 64-bit leftCategories bitset in place of x and y
+
+        size_t j() const { return jFlags & jMask; }
+        bool isCategorical() const { return (jFlags & isCategoricalMask) != 0; }
+        bool defaultLeft() const { return (jFlags & defaultLeftMask) != 0; }
+        void setJ(size_t j) { jFlags = (jFlags & ~jMask) | static_cast<uint32_t>(j); }
+        static uint32_t makeJFlags(size_t j, bool isCategorical, bool defaultLeft)
+        {
+            return static_cast<uint32_t>(j) | (isCategorical ? isCategoricalMask : 0)
+                | (defaultLeft ? defaultLeftMask : 0);
+        }
+    };
+
+    struct Tree_ {
+        uint64_t root;
+        double c;
+    };
+
+    struct Member_ {
+        size_t treeCount;   // the trees of the members are stored one member after the other
+        double c0;
+        double weight;      // only used by ensembles
+    };
+
+    FlatPredictor(
+        bool isUnion, vector<Member_>&& members, const ArrayXf& variableWeights, vector<Tree_>&& trees,
+        vector<Node_>&& nodes);
+    FlatPredictor(
+        bool isUnion, vector<Member_>&& members, const ArrayXf& variableWeights,
+        shared_ptr<const MappedFile> mappedFile, const Tree_* trees, size_t treeCount, const Node_* nodes,
+        size_t nodeCount);
+    static void initNodes_(const TreeNode* node, vector<Node_>& nodes);
+    static uint64_t leftCategories_(const Node_& node);
+    static bool goesLeft_(const Node_& node, float x);
+
+    // Merges flat predictors into one flat predictor with the semantics of an ensemble (isUnion = false)
+    // or a union (isUnion = true) of them. Returns nullptr if one of the predictors is not a flat predictor
+    // or has several members combined the other way.
+    static shared_ptr<Predictor> merge_(const vector<shared_ptr<Predictor>>& predictors, bool isUnion);
+
+    virtual ~FlatPredictor() = default;
+    virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
+    virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
+    virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
+    virtual void saveImpl_(ostream& os) const;
+    static shared_ptr<Predictor> loadImpl_(istream& is, int version);
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
+
+    void predictBlock_(CRefXXfc inData, size_t iBegin, size_t iEnd, RefXd pred) const;
+    vector<pair<double, vector<TreeNode>>> toTrees_(size_t treeBegin, size_t treeEnd) const;
+    static void validate_(
+        const Tree_* trees, size_t treeCount, const Node_* nodes, size_t nodeCount, size_t variableCount, istream& is);
+
+    bool isUnion_;
+    vector<Member_> members_;
+    ArrayXf variableWeights_;
+    vector<Tree_> ownedTrees_;
+    vector<Node_> ownedNodes_;
+    shared_ptr<const MappedFile> mappedFile_;   // keeps the memory mapped file alive
+    const Tree_* trees_;                         // points into ownedTrees_ or into the memory mapped file
+    size_t treeCount_;
+    const Node_* nodes_;                         // points into ownedNodes_ or into the memory mapped file
+    size_t nodeCount_;
+
+    static const size_t maxVariableCount_ = size_t{Node_::jMask} + 1;
+    static const size_t blockSize_ = 256;
+    static const size_t alignment_ = 16;
+
+    friend class Predictor;
+    friend class EnsemblePredictor;
+    friend class UnionPredictor;
+    friend class MakeSharedHelper<FlatPredictor>;
+};
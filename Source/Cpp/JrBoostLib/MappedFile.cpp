@@ -0,0 +1,128 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& filePath) : data_(nullptr), size_(0)
+{
+    HANDLE file = CreateFileA(
+        filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Unable to open the file " + filePath + ".");
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Unable to open the file " + filePath + ".");
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) {
+        CloseHandle(file);
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        throw std::runtime_error("Unable to memory map the file " + filePath + ".");
+    data_ = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (data_ == nullptr)
+        throw std::runtime_error("Unable to memory map the file " + filePath + ".");
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+}
+
+#else
+
+MappedFile::MappedFile(const string& filePath) : data_(nullptr), size_(0)
+{
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::runtime_error("Unable to open the file " + filePath + ".");
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw std::runtime_error("Unable to open the file " + filePath + ".");
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) {
+        close(fd);
+        return;
+    }
+
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        throw std::runtime_error("Unable to memory map the file " + filePath + ".");
+    data_ = static_cast<const char*>(p);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+        munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+
+MappedStreamBuffer::MappedStreamBuffer(shared_ptr<const MappedFile> file) : file_(file)
+{
+    char* begin = const_cast<char*>(file_->data());
+    setg(begin, begin, begin + file_->size());
+}
+
+void MappedStreamBuffer::skip(size_t n)
+{
+    ASSERT(n <= static_cast<size_t>(egptr() - gptr()));
+    setg(eback(), gptr() + n, egptr());
+}
+
+MappedStreamBuffer::pos_type
+MappedStreamBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    if (!(which & std::ios_base::in))
+        return pos_type(off_type(-1));
+
+    off_type pos;
+    if (dir == std::ios_base::beg)
+        pos = off;
+    else if (dir == std::ios_base::cur)
+        pos = (gptr() - eback()) + off;
+    else
+        pos = (egptr() - eback()) + off;
+
+    if (pos < 0 || pos > egptr() - eback())
+        return pos_type(off_type(-1));
+    setg(eback(), eback() + pos, egptr());
+    return pos_type(pos);
+}
+
+MappedStreamBuffer::pos_type MappedStreamBuffer::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
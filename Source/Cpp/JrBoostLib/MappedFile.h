@@ -0,0 +1,42 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+
+class MappedFile {   // read-only memory mapped file
+public:
+    MappedFile(const string& filePath);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// Stream buffer that reads directly from a memory mapped file.
+// Loaders can use current() and skip() to access large arrays in place instead of copying them.
+
+class MappedStreamBuffer : public std::streambuf {
+public:
+    MappedStreamBuffer(shared_ptr<const MappedFile> file);
+
+    const shared_ptr<const MappedFile>& file() const { return file_; }
+    const char* current() const { return gptr(); }
+    void skip(size_t n);
+
+protected:
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which);
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+private:
+    shared_ptr<const MappedFile> file_;
+};
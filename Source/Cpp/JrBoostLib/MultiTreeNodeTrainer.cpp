@@ -0,0 +1,95 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "MultiTreeNodeTrainer.h"
+
+
+template<typename SampleIndex>
+void MultiTreeNodeTrainer<SampleIndex>::init(
+    const TreeNodeExt& node, const double* pNodeSums, size_t classCount, const BaseOptions& options)
+{
+    this->nodeSums_.init(pNodeSums, classCount);
+    this->init_(node, options);
+}
+
+
+template<typename SampleIndex>
+void MultiTreeNodeTrainer<SampleIndex>::update(
+    const float* pInDataColJ,
+    const double* pClassData,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pSortedSamplesEnd,
+    size_t j)
+{
+    this->updateImpl_(
+        pInDataColJ, ClassSampleData_{pClassData, 2 * this->nodeSums_.classCount()}, pSortedSamplesBegin,
+        pSortedSamplesEnd, j);
+}
+
+
+template<typename SampleIndex>
+void MultiTreeNodeTrainer<SampleIndex>::updateCategorical(
+    const float* pInDataColJ,
+    const double* pClassData,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pSortedSamplesEnd,
+    size_t j)
+{
+    this->updateCategoricalImpl_(
+        pInDataColJ, ClassSampleData_{pClassData, 2 * this->nodeSums_.classCount()}, pSortedSamplesBegin,
+        pSortedSamplesEnd, j);
+}
+
+
+// updates one node based on the best split found
+// returns the number of used samples in the child nodes if any, otherwise 0
+// the leaf values of the trees are set from the sums when the trees are created, see TreeTrainerImpl
+
+template<typename SampleIndex>
+size_t MultiTreeNodeTrainer<SampleIndex>::finalize(
+    TreeNodeExt** ppParentNode, TreeNodeExt** ppChildNode, double** ppChildSums) const
+{
+    TreeNodeExt* leftChildNode = this->finalize_(ppParentNode, ppChildNode);
+    if (leftChildNode == nullptr)
+        return 0;
+
+    const size_t classCount = this->nodeSums_.classCount();
+    const size_t n = 2 * classCount;
+    const double* pNodeSums = this->nodeSums_.node();
+    const double* pBestLeftSums = this->nodeSums_.bestLeft();
+    double* pLeftChildSums = *ppChildSums;
+    double* pRightChildSums = pLeftChildSums + n;
+    *ppChildSums += 2 * n;
+
+    double leftSumW = 0.0;
+    double rightSumW = 0.0;
+    for (size_t r = 0; r != n; ++r) {
+        pLeftChildSums[r] = pBestLeftSums[r];
+        pRightChildSums[r] = pNodeSums[r] - pBestLeftSums[r];
+    }
+    for (size_t q = 0; q != classCount; ++q) {
+        leftSumW += pLeftChildSums[2 * q];
+        rightSumW += pRightChildSums[2 * q];
+    }
+
+    leftChildNode->y = 0.0f;
+    leftChildNode->sumW = leftSumW;
+    leftChildNode->sumWY = 0.0;
+
+    TreeNodeExt* rightChildNode = leftChildNode + 1;
+    rightChildNode->y = 0.0f;
+    rightChildNode->sumW = rightSumW;
+    rightChildNode->sumWY = 0.0;
+
+    return this->sampleCount_;
+}
+
+//......................................................................................................................
+
+template class MultiTreeNodeTrainer<uint8_t>;
+template class MultiTreeNodeTrainer<uint16_t>;
+template class MultiTreeNodeTrainer<uint32_t>;
+template class MultiTreeNodeTrainer<uint64_t>;
@@ -0,0 +1,42 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "TreeNodeTrainerBase.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// Same as TreeNodeTrainer, but for several trees with the same splits (see TreeTrainer::trainMulti()).
+// Each sample has a weight w and an outdata value y for each of the classCount trees; the data of sample i is
+// pClassData[2 * (i * classCount + q)] = w and pClassData[2 * (i * classCount + q) + 1] = w * y for tree q.
+// The sums of a node are stored in the same way, and the score of a split is the sum of the scores of the trees.
+
+template<typename SampleIndex>
+class MultiTreeNodeTrainer : public TreeNodeTrainerBase<SampleIndex, ClassNodeSums> {   // immutable class
+public:
+    MultiTreeNodeTrainer() = default;
+    ~MultiTreeNodeTrainer() = default;
+
+    void init(const TreeNodeExt& node, const double* pNodeSums, size_t classCount, const BaseOptions& options);
+    void update(
+        const float* pInDataColJ, const double* pClassData, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pSortedSamplesEnd, size_t j);
+    void updateCategorical(
+        const float* pInDataColJ, const double* pClassData, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pSortedSamplesEnd, size_t j);
+    // also writes the sums of the child nodes to *ppChildSums
+    size_t finalize(TreeNodeExt** ppParentNode, TreeNodeExt** ppChildNode, double** ppChildSums) const;
+
+    // not really used, but required by vector<MultiTreeNodeTrainer>
+    MultiTreeNodeTrainer(const MultiTreeNodeTrainer&){};
+    MultiTreeNodeTrainer& operator=(const MultiTreeNodeTrainer&) { return *this; };
+
+private:
+    struct ClassSampleData_ {
+        const double* pClassData;
+        size_t n;   // 2 * classCount
+        const double* classSums(size_t i) const { return pClassData + i * n; }
+    };
+};
@@ -0,0 +1,191 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "MultinomialPredictor.h"
+
+#include "Base128Encoding.h"
+#include "OmpParallel.h"
+#include "Predictor.h"
+
+
+shared_ptr<MultinomialPredictor> MultinomialPredictor::createInstance(vector<shared_ptr<Predictor>> predictors)
+{
+    return makeShared<MultinomialPredictor>(move(predictors));
+}
+
+MultinomialPredictor::MultinomialPredictor(vector<shared_ptr<Predictor>> predictors) :
+    predictors_{move(predictors)},
+    variableCount_{initVariableCount_(predictors_)}
+{
+}
+
+size_t MultinomialPredictor::initVariableCount_(const vector<shared_ptr<Predictor>>& predictors)
+{
+    if (size(predictors) < 2)
+        throw std::invalid_argument("A multinomial predictor must have at least two classes.");
+    size_t variableCount = 0;
+    for (const auto& predictor : predictors) {
+        if (dynamic_cast<const BoostPredictor*>(predictor.get()) == nullptr)
+            throw std::invalid_argument("The predictors of a multinomial predictor must be boost predictors.");
+        variableCount = std::max(variableCount, predictor->variableCount());
+    }
+    return variableCount;
+}
+
+
+ArrayXXdc MultinomialPredictor::predict(CRefXXfc inData, size_t threadCount) const
+{
+    ArrayXXdc pred = scores_(inData, threadCount);
+
+    // softmax; the largest score is subtracted first to avoid overflow
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    for (size_t i = 0; i != sampleCount; ++i) {
+        auto row = pred.row(i);
+        row = (row - row.maxCoeff()).exp();
+        row /= row.sum();
+    }
+    return pred;
+}
+
+ArrayXu8 MultinomialPredictor::classify(CRefXXfc inData, size_t threadCount) const
+{
+    const ArrayXXdc scores = scores_(inData, threadCount);
+
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    ArrayXu8 classes(sampleCount);
+    for (size_t i = 0; i != sampleCount; ++i) {
+        Eigen::Index q;
+        scores.row(i).maxCoeff(&q);
+        classes(i) = static_cast<uint8_t>(q);
+    }
+    return classes;
+}
+
+ArrayXXdc MultinomialPredictor::scores_(CRefXXfc inData, size_t threadCount) const
+{
+    size_t ITEM_COUNT = 0;
+    ScopedProfiler sp(PROFILE::PREDICT, &ITEM_COUNT);
+
+    if (::currentInterruptHandler != nullptr)
+        ::currentInterruptHandler->check();
+    if (abortThreads)
+        throw ThreadAborted();
+
+    if (static_cast<size_t>(inData.cols()) < variableCount_)
+        throw std::invalid_argument("Test indata has fewer variables than train indata.");
+    if (inData.isInf().any())
+        throw std::invalid_argument("Test indata has values that are infinity.");
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    // the test data is processed in blocks of rows, as by Predictor::predict()
+
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t classCount = this->classCount();
+    const size_t blockSize = Predictor::outBlockSize_;
+    ArrayXXdc scores(sampleCount, classCount);
+    for (size_t iBegin = 0; iBegin < sampleCount; iBegin += blockSize) {
+        const size_t n = std::min(blockSize, sampleCount - iBegin);
+        for (size_t q = 0; q != classCount; ++q) {
+            const BoostPredictor* predictor = static_cast<const BoostPredictor*>(predictors_[q].get());
+            scores.col(q).segment(iBegin, n) = predictor->logOdds_(inData.middleRows(iBegin, n), threadCount);
+        }
+    }
+
+    PROFILE::SWITCH(PROFILE::ZERO, ITEM_COUNT);   // calibrate the profiling
+    ITEM_COUNT = 0;
+
+    return scores;
+}
+
+
+shared_ptr<Predictor> MultinomialPredictor::predictor(size_t q) const
+{
+    if (q >= classCount())
+        throw std::invalid_argument("The class must be less than the number of classes.");
+    return predictors_[q];
+}
+
+ArrayXf MultinomialPredictor::variableWeights() const
+{
+    ArrayXf weights = ArrayXf::Zero(variableCount_);
+    for (const auto& predictor : predictors_)
+        weights.head(predictor->variableCount()) += predictor->variableWeights();
+    return weights / static_cast<float>(classCount());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void MultinomialPredictor::save(const string& filePath) const
+{
+    ofstream ofs;
+    ofs.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+    ofs.open(filePath, std::ios::binary);
+    save(ofs);
+}
+
+void MultinomialPredictor::save(ostream& os) const
+{
+    ASSERT(os.exceptions() == (std::ios::failbit | std::ios::badbit | std::ios::eofbit));
+    os.write("JRBOOST", 7);
+    os.put(static_cast<char>(Predictor::currentFileFormatVersion_));
+    os.put('M');
+    base128Save(os, classCount());
+    for (const auto& predictor : predictors_)
+        predictor->saveImpl_(os);
+    os.put('!');
+}
+
+shared_ptr<MultinomialPredictor> MultinomialPredictor::load(const string& filePath)
+{
+    ifstream ifs;
+    ifs.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+    ifs.open(filePath, std::ios::binary);
+    return load(ifs);
+}
+
+shared_ptr<MultinomialPredictor> MultinomialPredictor::load(istream& is)
+{
+    ASSERT(is.exceptions() == (std::ios::failbit | std::ios::badbit | std::ios::eofbit));
+
+    try {
+        char sig[7];
+        is.read(sig, 7);
+        if (memcmp(sig, "JRBOOST", 7) != 0)
+            throw std::runtime_error("Not a JrBoost predictor file.");
+
+        int version = is.get();
+        if (version < 1)
+            parseError(is);
+        if (version > Predictor::currentFileFormatVersion_)
+            throw std::runtime_error(
+                "Reading this JrBoost predictor file requires a newer version of the JrBoost library.");
+        if (version < 15 || is.get() != 'M')
+            throw std::runtime_error("Not a JrBoost multinomial predictor file.");
+
+        const size_t classCount = base128Load(is);
+        if (classCount < 2)
+            parseError(is);
+        vector<shared_ptr<Predictor>> predictors(classCount);
+        for (size_t q = 0; q != classCount; ++q) {
+            if (is.get() != 'B')
+                parseError(is);
+            predictors[q] = BoostPredictor::loadImpl_(is, version);
+        }
+
+        if (is.get() != '!')
+            parseError(is);
+
+        return createInstance(move(predictors));
+    }
+    catch (const std::ios::failure&) {
+        parseError(is);
+    }
+    catch (const std::overflow_error&) {   // thrown by base128Load()
+        parseError(is);
+    }
+}
@@ -0,0 +1,49 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+class Predictor;
+
+
+// Predictor for several classes, as trained by MultinomialTrainer.
+// There is one boost predictor for each class, and the log odds F_q of the boost predictor of class q is the score of
+// the class. The probability of class q is the softmax exp(F_q) / (exp(F_0) + exp(F_1) + ... + exp(F_{K-1})).
+// The file format is that of Predictor, with the boost predictors of the classes one after the other.
+
+class MultinomialPredictor {   // immutable class
+public:
+    // the predictors must be boost predictors (see BoostPredictor in Predictor.h)
+    static shared_ptr<MultinomialPredictor> createInstance(vector<shared_ptr<Predictor>> predictors);
+    ~MultinomialPredictor() = default;
+
+    size_t classCount() const { return size(predictors_); }
+    size_t variableCount() const { return variableCount_; }
+    // returns a samples x classes array with the probability of each class
+    ArrayXXdc predict(CRefXXfc inData, size_t threadCount = 0) const;
+    // returns the most probable class of each sample
+    ArrayXu8 classify(CRefXXfc inData, size_t threadCount = 0) const;
+    // the boost predictor of class q; its predictions are the logistic function of the scores of the class
+    shared_ptr<Predictor> predictor(size_t q) const;
+    ArrayXf variableWeights() const;
+
+    void save(const string& filePath) const;
+    void save(ostream& os) const;
+    static shared_ptr<MultinomialPredictor> load(const string& filePath);
+    static shared_ptr<MultinomialPredictor> load(istream& is);
+
+private:
+    MultinomialPredictor(vector<shared_ptr<Predictor>> predictors);
+    MultinomialPredictor(const MultinomialPredictor&) = delete;
+    MultinomialPredictor& operator=(const MultinomialPredictor&) = delete;
+
+    static size_t initVariableCount_(const vector<shared_ptr<Predictor>>& predictors);
+    // returns a samples x classes array with the score of each class
+    ArrayXXdc scores_(CRefXXfc inData, size_t threadCount) const;
+
+    const vector<shared_ptr<Predictor>> predictors_;
+    const size_t variableCount_;
+
+    friend class MakeSharedHelper<MultinomialPredictor>;
+};
@@ -0,0 +1,181 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "MultinomialTrainer.h"
+
+#include "BasePredictor.h"
+#include "BoostOptions.h"
+#include "Dataset.h"
+#include "MultinomialPredictor.h"
+#include "Predictor.h"
+#include "TreeTrainer.h"
+
+
+MultinomialTrainer::MultinomialTrainer(
+    shared_ptr<const Dataset> dataset, ArrayXu8 outData, optional<ArrayXd> weights, optional<ArrayXu8> strata) :
+    sampleCount_{
+        (validateData_(dataset.get(), outData, weights, strata),   // do validation before anything else
+         dataset->sampleCount())},
+    classCount_{std::max<size_t>(outData.maxCoeff() + 1, 2)},
+    dataset_{std::move(dataset)},
+    inDataBlocks_{dataset_->inDataBlocks()},
+    outData_{outData},
+    weights_{std::move(weights)},
+    strata_{strata ? std::move(*strata) : std::move(outData)},
+    globalLogPriors_{getGlobalLogPriors_()}
+{
+}
+
+MultinomialTrainer::MultinomialTrainer(
+    ArrayXXfc inData, ArrayXu8 outData, optional<ArrayXd> weights, optional<ArrayXu8> strata,
+    optional<ArrayXu8> categorical) :
+    MultinomialTrainer(
+        std::make_shared<const Dataset>(std::move(inData), std::move(categorical)), std::move(outData),
+        std::move(weights), std::move(strata))
+{
+}
+
+MultinomialTrainer::MultinomialTrainer(
+    vector<ArrayXXfc> inDataBlocks, ArrayXu8 outData, optional<ArrayXd> weights, optional<ArrayXu8> strata,
+    optional<ArrayXu8> categorical) :
+    MultinomialTrainer(
+        std::make_shared<const Dataset>(std::move(inDataBlocks), std::move(categorical)), std::move(outData),
+        std::move(weights), std::move(strata))
+{
+}
+
+MultinomialTrainer::~MultinomialTrainer() = default;
+
+
+void MultinomialTrainer::validateData_(
+    const Dataset* dataset, CRefXu8 outData, optional<CRefXd> weights, optional<CRefXu8> strata)
+{
+    if (dataset == nullptr)
+        throw std::invalid_argument("Train dataset is missing.");
+    if (dataset->pairs().pairCount() != 0)
+        throw std::invalid_argument("Multinomial boosting does not support pair variables.");
+
+    const size_t sampleCount = dataset->sampleCount();
+
+    if (static_cast<size_t>(outData.rows()) != sampleCount)
+        throw std::invalid_argument("Train indata and outdata have different numbers of samples.");
+
+    if (weights) {
+        if (static_cast<size_t>(weights->rows()) != sampleCount)
+            throw std::invalid_argument("Train indata and weights have different numbers of samples.");
+        if (!weights->isFinite().all())
+            throw std::invalid_argument("Train weights have values that are infinity or NaN.");
+        if ((*weights <= 0.0).any())
+            throw std::invalid_argument("Train weights have non-positive values.");
+    }
+
+    if (strata) {
+        if (static_cast<size_t>(strata->rows()) != sampleCount)
+            throw std::invalid_argument("Train indata and strata have different numbers of samples.");
+    }
+}
+
+
+ArrayXd MultinomialTrainer::getGlobalLogPriors_() const
+{
+    ArrayXd p = ArrayXd::Zero(classCount_);
+    for (size_t i = 0; i != sampleCount_; ++i)
+        p(outData_(i)) += weights_ ? (*weights_)(i) : 1.0;
+
+    for (size_t q = 0; q != classCount_; ++q) {
+        if (p(q) == 0.0)
+            throw std::invalid_argument("There are no train samples with label " + std::to_string(q) + ".");
+    }
+
+    return p.log();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// Each iteration does one Newton step for each class, as in binary logit boost (see BoostTrainer::trainLogit_()).
+// With p_q the softmax of the scores F_0, ..., F_{K-1}, e_q = exp(F_q - max F) and S = e_0 + ... + e_{K-1},
+// the adjusted outdata and weights of class q are
+//     z_q = (y_q - p_q) / (p_q * (1 - p_q)) = y_q ? S / e_q : -S / (S - e_q),
+//     u_q = p_q * (1 - p_q) = e_q * (S - e_q) / S^2,
+// and the tree predictions are multiplied by (K - 1) / K.
+// Friedman et al. also subtract the mean of the tree predictions over the classes from the scores; we skip that step,
+// since the probabilities do not change when the same value is added to all the scores.
+
+shared_ptr<MultinomialPredictor> MultinomialTrainer::train(const BoostOptions& opt, size_t threadCount) const
+{
+    size_t ITEM_COUNT = sampleCount_ * classCount_ * opt.iterationCount();
+    ScopedProfiler sp(PROFILE::BOOST_TRAIN, &ITEM_COUNT);
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    const size_t sampleCount = sampleCount_;
+    const size_t classCount = classCount_;
+    const size_t iterationCount = opt.iterationCount();
+    const double c1 = opt.eta() * (classCount - 1.0) / classCount;
+
+    ArrayXXdc adjOutData(sampleCount, classCount);
+    ArrayXXdc adjWeights(sampleCount, classCount);
+    ArrayXXdc F = globalLogPriors_.transpose().replicate(sampleCount, 1);
+    ArrayXd e(classCount);
+
+    vector<vector<unique_ptr<BasePredictor>>> basePredictors(classCount);
+    for (auto& bp : basePredictors)
+        bp.reserve(iterationCount);
+
+    for (size_t k = 0; k != iterationCount; ++k) {
+
+        double absAdjOutDataSum = 0.0;
+
+        for (size_t i = 0; i != sampleCount; ++i) {
+
+            // S - e_q is computed without cancellation: e_q <= 1 <= S, except for the largest score,
+            // where e_q = 1 and S - e_q is the sum of the other terms
+
+            Eigen::Index qMax;
+            const double fMax = F.row(i).maxCoeff(&qMax);
+            double sumOthers = 0.0;
+            for (size_t q = 0; q != classCount; ++q) {
+                e(q) = std::exp(F(i, q) - fMax);
+                if (q != static_cast<size_t>(qMax))
+                    sumOthers += e(q);
+            }
+            const double S = 1.0 + sumOthers;
+            const double w = weights_ ? (*weights_)(i) : 1.0;
+            const size_t y = outData_(i);
+
+            for (size_t q = 0; q != classCount; ++q) {
+                const double r = (q == static_cast<size_t>(qMax)) ? sumOthers : S - e(q);   // r = S - e_q
+                const double z = (q == y) ? S / e(q) : -S / r;
+                adjOutData(i, q) = z;
+                absAdjOutDataSum += std::abs(z);
+                adjWeights(i, q) = w * e(q) * r / square(S);
+            }
+        }
+
+        if (!std::isfinite(absAdjOutDataSum))
+            overflow_();
+
+        vector<unique_ptr<BasePredictor>> basePreds
+            = dataset_->treeTrainer_->trainMulti(adjOutData, adjWeights, strata_, opt, threadCount);
+        for (size_t q = 0; q != classCount; ++q) {
+            basePreds[q]->predict(inDataBlocks_, dataset_->pairs(), c1, F.col(q));
+            basePredictors[q].push_back(move(basePreds[q]));
+        }
+    }
+
+    vector<shared_ptr<Predictor>> predictors(classCount);
+    for (size_t q = 0; q != classCount; ++q)
+        predictors[q] = BoostPredictor::createInstance(globalLogPriors_(q), c1, move(basePredictors[q]));
+    return MultinomialPredictor::createInstance(move(predictors));
+}
+
+//......................................................................................................................
+
+void MultinomialTrainer::overflow_ [[noreturn]] ()
+{
+    throw std::overflow_error("Numerical overflow in the boost algorithm.\nTry decreasing eta.");
+}
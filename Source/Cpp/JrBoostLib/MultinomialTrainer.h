@@ -0,0 +1,52 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+class BoostOptions;
+class Dataset;
+class MultinomialPredictor;
+
+
+// Multinomial logit boost (Friedman, Hastie and Tibshirani, Additive Logistic Regression, 2000) for outdata with the
+// labels 0, 1, ..., K-1. Each iteration trains one tree per class; the trees of an iteration have the same splits,
+// so they share the selection of samples and variables, the presorted samples and the sample status
+// (see TreeTrainer::trainMulti()).
+// The gamma option is ignored, and pair variables are not supported.
+
+class MultinomialTrainer {   // immutable class
+public:
+    // the dataset can be shared with other trainers; it is presorted only once
+    MultinomialTrainer(
+        shared_ptr<const Dataset> dataset, ArrayXu8 outData, optional<ArrayXd> weights = std::nullopt,
+        optional<ArrayXu8> strata = std::nullopt);
+    MultinomialTrainer(
+        ArrayXXfc inData, ArrayXu8 outData, optional<ArrayXd> weights = std::nullopt,
+        optional<ArrayXu8> strata = std::nullopt, optional<ArrayXu8> categorical = std::nullopt);
+    // the indata blocks are treated as one matrix, see Dataset.h
+    MultinomialTrainer(
+        vector<ArrayXXfc> inDataBlocks, ArrayXu8 outData, optional<ArrayXd> weights = std::nullopt,
+        optional<ArrayXu8> strata = std::nullopt, optional<ArrayXu8> categorical = std::nullopt);
+    MultinomialTrainer(const MultinomialTrainer&) = delete;
+    MultinomialTrainer& operator=(const MultinomialTrainer&) = delete;
+    ~MultinomialTrainer();
+
+    size_t classCount() const { return classCount_; }
+    shared_ptr<MultinomialPredictor> train(const BoostOptions& opt, size_t threadCount = 0) const;
+
+private:
+    static void
+    validateData_(const Dataset* dataset, CRefXu8 outData, optional<CRefXd> weights, optional<CRefXu8> strata);
+    ArrayXd getGlobalLogPriors_() const;
+    static void overflow_ [[noreturn]] ();
+
+    const size_t sampleCount_;
+    const size_t classCount_;
+    const shared_ptr<const Dataset> dataset_;
+    const vector<CRefXXfc> inDataBlocks_;   // the indata blocks of dataset_
+    const ArrayXu8 outData_;
+    const optional<ArrayXd> weights_;
+    const ArrayXu8 strata_;
+    const ArrayXd globalLogPriors_;   // the log of the (weighted) frequency of each class
+};
@@ -0,0 +1,210 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "PairPredictor.h"
+
+#include "Base128Encoding.h"
+
+
+shared_ptr<Predictor>
+PairPredictor::createInstance(shared_ptr<Predictor> predictor, size_t variableCount, const PairVariables& pairs)
+{
+    return makeShared<PairPredictor>(predictor, variableCount, pairs);
+}
+
+PairPredictor::PairPredictor(shared_ptr<Predictor> predictor, size_t variableCount, const PairVariables& pairs) :
+    Predictor(variableCount),
+    predictor_(predictor),
+    pairs_(pairs),
+    variables_(predictor->usedVariables()),
+    compactPredictor_(predictor->createCompactPredictor_(variables_))
+{
+    ASSERT(predictor->variableCount() <= variableCount + pairs.pairCount());
+    pairs.validate(variableCount);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+ArrayXXfc PairPredictor::compactInData_(CRefXXfc inData) const
+{
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t usedVariableCount = static_cast<size_t>(variables_.size());
+
+    vector<const float*> columns(variableCount());
+    for (size_t j = 0; j != variableCount(); ++j)
+        columns[j] = std::data(inData.col(j));
+
+    ArrayXXfc compactInData(sampleCount, usedVariableCount);
+    for (size_t k = 0; k != usedVariableCount; ++k) {
+        const size_t j = variables_(k);
+        if (j < variableCount())
+            compactInData.col(k) = inData.col(j);
+        else
+            pairs_.values(j - variableCount(), columns, sampleCount, compactInData.col(k).data());
+    }
+    return compactInData;
+}
+
+ArrayXd PairPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    return compactPredictor_->predictImpl_(compactInData_(inData), threadCount);
+}
+
+void PairPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
+{
+    const size_t usedVariableCount = static_cast<size_t>(variables_.size());
+
+    static thread_local vector<float> compactInData;
+    compactInData.resize(sampleCount * usedVariableCount);
+
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const float* x = inData + static_cast<ptrdiff_t>(i) * rowStride;
+        float* compactX = data(compactInData) + i * usedVariableCount;
+        for (size_t k = 0; k != usedVariableCount; ++k) {
+            const size_t j = variables_(k);
+            if (j < variableCount())
+                compactX[k] = x[static_cast<ptrdiff_t>(j) * colStride];
+            else {
+                const size_t m = j - variableCount();
+                compactX[k] = pairs_.value(
+                    m, x[static_cast<ptrdiff_t>(pairs_.variable1(m)) * colStride],
+                    x[static_cast<ptrdiff_t>(pairs_.variable2(m)) * colStride]);
+            }
+        }
+    }
+
+    compactPredictor_->predictUncheckedImpl_(
+        data(compactInData), static_cast<ptrdiff_t>(usedVariableCount), 1, sampleCount, outData);
+}
+
+// the weight of a pair variable is split equally between its two variables
+ArrayXf PairPredictor::variableWeightsImpl_() const
+{
+    const ArrayXf sourceWeights = predictor_->variableWeightsImpl_();
+    ArrayXf weights = ArrayXf::Zero(variableCount());
+    for (size_t j = 0; j != static_cast<size_t>(sourceWeights.size()); ++j) {
+        if (j < variableCount())
+            weights(j) += sourceWeights(j);
+        else {
+            const size_t m = j - variableCount();
+            weights(pairs_.variable1(m)) += sourceWeights(j) / 2.0f;
+            weights(pairs_.variable2(m)) += sourceWeights(j) / 2.0f;
+        }
+    }
+    return weights;
+}
+
+void PairPredictor::usedVariablesImpl_(RefXu8 used) const
+{
+    for (size_t j : variables_) {
+        if (j < variableCount())
+            used(j) = 1;
+        else {
+            const size_t m = j - variableCount();
+            used(pairs_.variable1(m)) = 1;
+            used(pairs_.variable2(m)) = 1;
+        }
+    }
+}
+
+// the pair variables follow the reindexed variables
+shared_ptr<Predictor> PairPredictor::reindexVariablesImpl_(CRefXs newIndices) const
+{
+    const size_t newVariableCount = (variableCount() == 0) ? 0 : newIndices.head(variableCount()).maxCoeff() + 1;
+    const size_t pairCount = pairs_.pairCount();
+
+    ArrayXs sourceNewIndices(variableCount() + pairCount);
+    sourceNewIndices.head(variableCount()) = newIndices.head(variableCount());
+    for (size_t m = 0; m != pairCount; ++m)
+        sourceNewIndices(variableCount() + m) = newVariableCount + m;
+
+    return createInstance(
+        predictor_->reindexVariablesImpl_(sourceNewIndices), newVariableCount, pairs_.reindexVariables(newIndices));
+}
+
+
+void PairPredictor::saveImpl_(ostream& os) const
+{
+    os.put('P');
+    base128Save(os, variableCount());
+    pairs_.save(os);
+    predictor_->saveImpl_(os);
+}
+
+shared_ptr<Predictor> PairPredictor::loadImpl_(istream& is, int version)
+{
+    const size_t variableCount = base128Load(is);
+    const PairVariables pairs = PairVariables::load(is);
+    for (size_t m = 0; m != pairs.pairCount(); ++m) {
+        if (pairs.variable1(m) >= variableCount || pairs.variable2(m) >= variableCount)
+            parseError(is);
+    }
+    shared_ptr<Predictor> predictor = Predictor::loadImpl_(is, version);
+    if (predictor->variableCount() > variableCount + pairs.pairCount())
+        parseError(is);
+    return createInstance(predictor, variableCount, pairs);
+}
+
+// the source predictor is written as a function of the used variables, which are gathered into an array
+size_t PairPredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    const size_t i = compactPredictor_->saveCodeImpl_(os, functionCount);
+
+    const size_t usedVariableCount = static_cast<size_t>(variables_.size());
+    const size_t k = (*functionCount)++;
+    os << "static double predictor" << k << "(const float* x, ptrdiff_t s)\n{\n";
+    os << "    float u[" << std::max<size_t>(usedVariableCount, 1) << "];\n";
+    for (size_t r = 0; r != usedVariableCount; ++r) {
+        const size_t j = variables_(r);
+        os << "    u[" << r << "] = ";
+        if (j < variableCount())
+            os << "x[" << j << " * s];\n";
+        else {
+            const size_t m = j - variableCount();
+            const string x1 = "x[" + std::to_string(pairs_.variable1(m)) + " * s]";
+            const string x2 = "x[" + std::to_string(pairs_.variable2(m)) + " * s]";
+            if (pairs_.operation(m) == PairVariables::Difference)
+                os << x1 << " - " << x2 << ";\n";
+            else
+                os << "(isnan(" << x1 << ") || isnan(" << x2 << ")) ? NAN : (float)(" << x1 << " < " << x2
+                   << ");\n";
+        }
+    }
+    os << "    return predictor" << i << "(u, 1);\n}\n\n";
+    return k;
+}
+
+shared_ptr<Predictor> PairPredictor::quantizeImpl_() const
+{
+    return createInstance(predictor_->quantizeImpl_(), variableCount(), pairs_);
+}
+
+shared_ptr<Predictor> PairPredictor::flattenImpl_() const
+{
+    return createInstance(predictor_->flattenImpl_(), variableCount(), pairs_);
+}
+
+// the SHAP value of a pair variable is split equally between its two variables
+ArrayXXdc PairPredictor::shapValuesImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const ArrayXXdc compactShapValues = compactPredictor_->shapValuesImpl_(compactInData_(inData), threadCount);
+    const ArrayXXdc sourceShapValues
+        = expandShapValues_(compactShapValues, variables_, variableCount() + pairs_.pairCount());
+
+    // the SHAP value of a pair variable is split equally between its two variables
+    ArrayXXdc shapValues(inData.rows(), variableCount() + 1);
+    shapValues.leftCols(variableCount()) = sourceShapValues.leftCols(variableCount());
+    for (size_t j : variables_) {
+        if (j < variableCount())
+            continue;
+        const size_t m = j - variableCount();
+        shapValues.col(pairs_.variable1(m)) += sourceShapValues.col(j) / 2.0;
+        shapValues.col(pairs_.variable2(m)) += sourceShapValues.col(j) / 2.0;
+    }
+    shapValues.col(variableCount()) = sourceShapValues.rightCols(1);
+    return shapValues;
+}
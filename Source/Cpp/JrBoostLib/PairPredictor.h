@@ -0,0 +1,49 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "PairVariables.h"
+#include "Predictor.h"
+
+// A predictor that uses pair variables (see PairVariables.h), as returned by BoostTrainer for datasets with pairs.
+// The source predictor refers to the variables of the test data as 0, 1, ..., variableCount() - 1,
+// and to pair variable k as variableCount() + k.
+// The values of the pair variables are never stored as a matrix. When predicting, the used variables, and the values of
+// the used pair variables, are gathered into a compact matrix, which is scored by a copy of the source predictor
+// with the used variables reindexed to 0, 1, 2, ...
+
+class PairPredictor : public Predictor {   // immutable class
+public:
+    static shared_ptr<Predictor>
+    createInstance(shared_ptr<Predictor> predictor, size_t variableCount, const PairVariables& pairs);
+
+private:
+    PairPredictor(shared_ptr<Predictor> predictor, size_t variableCount, const PairVariables& pairs);
+
+    virtual ~PairPredictor() = default;
+    virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
+    virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
+    virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
+    virtual void saveImpl_(ostream& os) const;
+    static shared_ptr<Predictor> loadImpl_(istream& is, int version);
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
+    virtual ArrayXXdc shapValuesImpl_(CRefXXfc inData, size_t threadCount) const;
+
+    // gathers the used variables of the samples
+    ArrayXXfc compactInData_(CRefXXfc inData) const;
+
+    shared_ptr<Predictor> predictor_;
+    PairVariables pairs_;
+    ArrayXs variables_;                        // the variables used by the source predictor, sorted
+    shared_ptr<Predictor> compactPredictor_;   // the source predictor with variable variables_(k) reindexed to k
+
+    friend class Predictor;
+    friend class MakeSharedHelper<PairPredictor>;
+};
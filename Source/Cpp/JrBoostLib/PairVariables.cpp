@@ -0,0 +1,74 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "PairVariables.h"
+
+#include "Base128Encoding.h"
+
+
+PairVariables::PairVariables(ArrayXs variables1, ArrayXs variables2, ArrayXu8 operations) :
+    variables1_{std::move(variables1)}, variables2_{std::move(variables2)}, operations_{std::move(operations)}
+{
+    if (variables2_.rows() != variables1_.rows() || operations_.rows() != variables1_.rows())
+        throw std::invalid_argument("Pair variables and pair operations have different sizes.");
+    if ((operations_ > Less).any())
+        throw std::invalid_argument("Pair operations have values that are not 0 (difference) or 1 (less).");
+}
+
+void PairVariables::values(size_t k, const vector<const float*>& columns, size_t sampleCount, float* outData) const
+{
+    const float* pX1 = columns[variables1_(k)];
+    const float* pX2 = columns[variables2_(k)];
+    if (operations_(k) == Difference) {
+        for (size_t i = 0; i != sampleCount; ++i)
+            outData[i] = pX1[i] - pX2[i];
+    }
+    else {
+        for (size_t i = 0; i != sampleCount; ++i)
+            outData[i] = value(k, pX1[i], pX2[i]);
+    }
+}
+
+void PairVariables::validate(size_t variableCount) const
+{
+    if (pairCount() == 0)
+        return;
+    if (variables1_.maxCoeff() >= variableCount || variables2_.maxCoeff() >= variableCount)
+        throw std::invalid_argument("Pair variables refer to variables that are not in the train indata.");
+}
+
+PairVariables PairVariables::reindexVariables(CRefXs newIndices) const
+{
+    return PairVariables(ArrayXs(newIndices(variables1_)), ArrayXs(newIndices(variables2_)), operations_);
+}
+
+
+void PairVariables::save(ostream& os) const
+{
+    const size_t n = pairCount();
+    base128Save(os, n);
+    for (size_t k = 0; k != n; ++k) {
+        base128Save(os, variables1_(k));
+        base128Save(os, variables2_(k));
+        os.put(operations_(k));
+    }
+}
+
+PairVariables PairVariables::load(istream& is)
+{
+    const size_t n = base128Load(is);
+    ArrayXs variables1(n);
+    ArrayXs variables2(n);
+    ArrayXu8 operations(n);
+    for (size_t k = 0; k != n; ++k) {
+        variables1(k) = base128Load(is);
+        variables2(k) = base128Load(is);
+        operations(k) = static_cast<uint8_t>(is.get());
+        if (operations(k) > Less)
+            parseError(is);
+    }
+    return PairVariables(std::move(variables1), std::move(variables2), std::move(operations));
+}
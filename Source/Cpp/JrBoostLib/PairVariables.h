@@ -0,0 +1,49 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+// Derived variables defined by pairs of variables (j1, j2), e.g. the pairs returned by topScoringPairs().
+// Pair variable k is
+//     x(j1) - x(j2) if operation k is Difference,
+//     1 if x(j1) < x(j2) and 0 otherwise if operation k is Less,
+// and it is missing (NaN) if x(j1) or x(j2) is missing.
+// The values of the pair variables are never stored as a matrix. They are computed by the tree trainer when presorting
+// and when the samples are split on them, and by PairPredictor for the pair variables that are used.
+
+class PairVariables {   // immutable class
+public:
+    enum Operation : uint8_t { Difference = 0, Less = 1 };
+
+    PairVariables() = default;
+    PairVariables(ArrayXs variables1, ArrayXs variables2, ArrayXu8 operations);
+
+    size_t pairCount() const { return static_cast<size_t>(variables1_.rows()); }
+    size_t variable1(size_t k) const { return variables1_(k); }
+    size_t variable2(size_t k) const { return variables2_(k); }
+    Operation operation(size_t k) const { return static_cast<Operation>(operations_(k)); }
+
+    float value(size_t k, float x1, float x2) const
+    {
+        if (operations_(k) == Difference)
+            return x1 - x2;
+        return (std::isnan(x1) || std::isnan(x2)) ? std::numeric_limits<float>::quiet_NaN()
+                                                  : static_cast<float>(x1 < x2);
+    }
+
+    // writes the values of pair variable k to outData; columns[j] points to the values of variable j
+    void values(size_t k, const vector<const float*>& columns, size_t sampleCount, float* outData) const;
+
+    // throws if a pair refers to a variable that is not less than variableCount
+    void validate(size_t variableCount) const;
+    PairVariables reindexVariables(CRefXs newIndices) const;
+
+    void save(ostream& os) const;
+    static PairVariables load(istream& is);
+
+private:
+    ArrayXs variables1_;
+    ArrayXs variables2_;
+    ArrayXu8 operations_;
+};
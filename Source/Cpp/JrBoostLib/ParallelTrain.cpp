@@ -100,7 +100,7 @@ ArrayXXdc parallelTrainAndPredict(const BoostTrainer& trainer, const vector<Boos
                 break;
             size_t optIndex = optIndicesSortedByCost[sortedOptIndex];
             shared_ptr<Predictor> pred = trainer.train(opt[optIndex], innerThreadCount);
-            predData.col(optIndex) = pred->predict(testInData, innerThreadCount);
+            pred->predict(testInData, predData.col(optIndex), innerThreadCount);
         }
     }
     END_OMP_PARALLEL
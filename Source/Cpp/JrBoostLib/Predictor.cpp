@@ -8,13 +8,36 @@
 
 #include "Base128Encoding.h"
 #include "BasePredictor.h"
+#include "FlatPredictor.h"
+#include "MappedFile.h"
 #include "OmpParallel.h"
+#include "PairPredictor.h"
+#include "ProjectedPredictor.h"
+#include "QuantizedPredictor.h"
+#include "Tree.h"
 
 
 Predictor::Predictor(size_t variableCount) : variableCount_(variableCount) {}
 
 
 ArrayXd Predictor::predict(CRefXXfc inData, size_t threadCount) const
+{
+    ArrayXd pred(inData.rows());
+    predictInto_(inData, pred, threadCount);
+    return pred;
+}
+
+void Predictor::predict(CRefXXfc inData, RefXd outData, size_t threadCount) const
+{
+    predictInto_(inData, outData, threadCount);
+}
+
+void Predictor::predict(CRefXXfc inData, RefXf outData, size_t threadCount) const
+{
+    predictInto_(inData, outData, threadCount);
+}
+
+ArrayXd Predictor::predict(const vector<CRefXXfc>& inDataBlocks, size_t threadCount) const
 {
     size_t ITEM_COUNT = 0;
     ScopedProfiler sp(PROFILE::PREDICT, &ITEM_COUNT);
@@ -24,15 +47,42 @@ ArrayXd Predictor::predict(CRefXXfc inData, size_t threadCount) const
     if (abortThreads)
         throw ThreadAborted();
 
-    if (static_cast<size_t>(inData.cols()) < variableCount())
+    if (inDataBlocks.empty())
+        throw std::invalid_argument("Test indata has 0 blocks.");
+    const size_t sampleCount = static_cast<size_t>(inDataBlocks[0].rows());
+    for (const auto& block : inDataBlocks) {
+        if (static_cast<size_t>(block.rows()) != sampleCount)
+            throw std::invalid_argument("Test indata blocks have different numbers of samples.");
+    }
+    const vector<const float*> columns = inDataColumns(inDataBlocks);
+    if (size(columns) < variableCount())
         throw std::invalid_argument("Test indata has fewer variables than train indata.");
-    if (!inData.isFinite().all())
-        throw std::invalid_argument("Test indata has values that are infinity or NaN.");
 
     if (threadCount == 0 || threadCount > omp_get_max_threads())
         threadCount = omp_get_max_threads();
 
-    ArrayXd pred = predictImpl_(inData, threadCount);
+    // the used variables are gathered in blocks of rows, see gatheredPrediction_()
+
+    const GatheredPrediction_& gp = gatheredPrediction_();
+    const size_t usedVariableCount = static_cast<size_t>(gp.usedVariables.rows());
+    // the buffer holds at most outBlockSize_ * usedVariableCount values, also when it has unused columns
+    const size_t blockSize = (gp.columnCount == usedVariableCount)
+        ? outBlockSize_
+        : std::max(outBlockSize_ * usedVariableCount / gp.columnCount, size_t{1});
+
+    ArrayXd pred(sampleCount);
+    ArrayXXfc usedInData;
+    for (size_t iBegin = 0; iBegin < sampleCount; iBegin += blockSize) {
+        const size_t n = std::min(blockSize, sampleCount - iBegin);
+        if (static_cast<size_t>(usedInData.rows()) != n)
+            usedInData.setZero(n, gp.columnCount);   // the unused columns are never written
+        for (size_t k = 0; k != usedVariableCount; ++k) {
+            usedInData.col(gp.columns(k)) = Eigen::Map<const ArrayXf>(columns[gp.usedVariables(k)] + iBegin, n);
+            if (usedInData.col(gp.columns(k)).isInf().any())
+                throw std::invalid_argument("Test indata has values that are infinity.");
+        }
+        pred.segment(iBegin, n) = gp.predictor->predictImpl_(usedInData, threadCount);
+    }
 
     PROFILE::SWITCH(PROFILE::ZERO, ITEM_COUNT);   // calibrate the profiling
     ITEM_COUNT = 0;
@@ -40,18 +90,362 @@ ArrayXd Predictor::predict(CRefXXfc inData, size_t threadCount) const
     return pred;
 }
 
-double Predictor::predictOne(CRefXf inData) const
+// The used variables are usually gathered to adjacent columns and predicted by the predictor reindexed to them.
+// If reindexing is not efficient, or all variables are used, they are instead gathered to their own columns
+// and predicted by this predictor.
+
+const Predictor::GatheredPrediction_& Predictor::gatheredPrediction_() const
+{
+    GatheredPrediction_& gp = gatheredPredictionCache_;
+    std::call_once(gp.initFlag, [this, &gp]() {
+        gp.usedVariables = usedVariables();
+        const size_t usedVariableCount = static_cast<size_t>(gp.usedVariables.rows());
+        if (usedVariableCount == variableCount() || !reindexesEfficiently_()) {
+            gp.columns = gp.usedVariables;
+            gp.columnCount = variableCount();
+            gp.predictor = this;
+        }
+        else {
+            gp.columns.resize(usedVariableCount);
+            for (size_t k = 0; k != usedVariableCount; ++k)
+                gp.columns(k) = k;
+            gp.columnCount = usedVariableCount;
+            gp.reindexedPredictor = createCompactPredictor_(gp.usedVariables);
+            gp.predictor = gp.reindexedPredictor.get();
+        }
+    });
+    return gp;
+}
+
+template<typename OutData>
+void Predictor::predictInto_(CRefXXfc inData, OutData& outData, size_t threadCount) const
+{
+    size_t ITEM_COUNT = 0;
+    ScopedProfiler sp(PROFILE::PREDICT, &ITEM_COUNT);
+
+    if (::currentInterruptHandler != nullptr)
+        ::currentInterruptHandler->check();
+    if (abortThreads)
+        throw ThreadAborted();
+
+    validateInData_(inData);
+    if (outData.rows() != inData.rows())
+        throw std::invalid_argument("Test indata and outdata have different numbers of samples.");
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    // The test data is processed in blocks of rows,
+    // so that the scratch memory used does not grow with the number of samples.
+
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    for (size_t iBegin = 0; iBegin < sampleCount; iBegin += outBlockSize_) {
+        const size_t n = std::min(outBlockSize_, sampleCount - iBegin);
+        outData.segment(iBegin, n)
+            = predictImpl_(inData.middleRows(iBegin, n), threadCount).template cast<typename OutData::Scalar>();
+    }
+
+    PROFILE::SWITCH(PROFILE::ZERO, ITEM_COUNT);   // calibrate the profiling
+    ITEM_COUNT = 0;
+}
+
+void Predictor::validateInData_(const InDataRef_& inData) const
+{
+    std::visit(
+        [this](const auto& inData) {
+            if (static_cast<size_t>(inData.cols()) < variableCount())
+                throw std::invalid_argument("Test indata has fewer variables than train indata.");
+            if (inData.isInf().any())
+                throw std::invalid_argument("Test indata has values that are infinity.");
+        },
+        inData);
+}
+
+ArrayXd Predictor::predictRowMajor(CRefXXfr inData, size_t threadCount) const
+{
+    ArrayXd pred(inData.rows());
+    predictRowMajorInto_(inData, pred, threadCount);
+    return pred;
+}
+
+void Predictor::predictRowMajor(CRefXXfr inData, RefXd outData, size_t threadCount) const
 {
-    if (static_cast<size_t>(inData.rows()) < variableCount())
+    predictRowMajorInto_(inData, outData, threadCount);
+}
+
+void Predictor::predictRowMajor(CRefXXfr inData, RefXf outData, size_t threadCount) const
+{
+    predictRowMajorInto_(inData, outData, threadCount);
+}
+
+template<typename OutData>
+void Predictor::predictRowMajorInto_(CRefXXfr inData, OutData& outData, size_t threadCount) const
+{
+    size_t ITEM_COUNT = 0;
+    ScopedProfiler sp(PROFILE::PREDICT, &ITEM_COUNT);
+
+    if (::currentInterruptHandler != nullptr)
+        ::currentInterruptHandler->check();
+    if (abortThreads)
+        throw ThreadAborted();
+
+    validateInData_(inData);
+    if (outData.rows() != inData.rows())
+        throw std::invalid_argument("Test indata and outdata have different numbers of samples.");
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    // Row-major test data is scored in place one sample at a time;
+    // each sample is contiguous in memory, so this is cache friendly.
+    // Samples are processed in blocks and the blocks are distributed over the threads.
+
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t blockSize = 256;
+    const size_t blockCount = divideRoundUp(sampleCount, blockSize);
+    if (blockCount == 0)
+        return;
+
+    threadCount = std::min(threadCount, blockCount);
+    const ptrdiff_t rowStride = inData.outerStride();
+    std::atomic<size_t> nextBlock = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        double pred[blockSize];
+        while (true) {
+            const size_t block = nextBlock++;
+            if (block >= blockCount)
+                break;
+            const size_t iBegin = block * blockSize;
+            const size_t n = std::min(blockSize, sampleCount - iBegin);
+            predictUncheckedImpl_(inData.data() + static_cast<ptrdiff_t>(iBegin) * rowStride, rowStride, 1, n, pred);
+            outData.segment(iBegin, n) = Eigen::Map<ArrayXd>(pred, n).template cast<typename OutData::Scalar>();
+        }
+    }
+    END_OMP_PARALLEL
+
+    PROFILE::SWITCH(PROFILE::ZERO, ITEM_COUNT);   // calibrate the profiling
+    ITEM_COUNT = 0;
+}
+
+ArrayXXdc Predictor::predictMany(const vector<shared_ptr<Predictor>>& predictors, CRefXXfc inData, size_t threadCount)
+{
+    size_t ITEM_COUNT = 0;
+    ScopedProfiler sp(PROFILE::PREDICT, &ITEM_COUNT);
+
+    if (::currentInterruptHandler != nullptr)
+        ::currentInterruptHandler->check();
+    if (abortThreads)
+        throw ThreadAborted();
+
+    size_t variableCount = 0;
+    for (const auto& predictor : predictors)
+        variableCount = std::max(variableCount, predictor->variableCount());
+    if (static_cast<size_t>(inData.cols()) < variableCount)
         throw std::invalid_argument("Test indata has fewer variables than train indata.");
-    if (!inData.isFinite().all())
-        throw std::invalid_argument("Test indata has values that are infinity or NaN.");
+    if (inData.isInf().any())
+        throw std::invalid_argument("Test indata has values that are infinity.");
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t predictorCount = size(predictors);
+    const size_t blockCount = divideRoundUp(sampleCount, manyBlockSize_);
+    ArrayXXdc pred(sampleCount, predictorCount);
+    if (blockCount == 0 || predictorCount == 0)
+        return pred;
+
+    // Each thread processes one block of rows at a time and evaluates all predictors on it.
+    // The predictors themselves are run single-threaded.
+
+    threadCount = std::min(threadCount, blockCount);
+    std::atomic<size_t> nextBlock = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        while (true) {
+            const size_t block = nextBlock++;
+            if (block >= blockCount)
+                break;
+            const size_t iBegin = block * manyBlockSize_;
+            const size_t n = std::min(manyBlockSize_, sampleCount - iBegin);
+            for (size_t k = 0; k != predictorCount; ++k) {
+                if (abortThreads)
+                    throw ThreadAborted();
+                pred.col(k).segment(iBegin, n) = predictors[k]->predictImpl_(inData.middleRows(iBegin, n), 1);
+            }
+        }
+    }
+    END_OMP_PARALLEL
+
+    PROFILE::SWITCH(PROFILE::ZERO, ITEM_COUNT);   // calibrate the profiling
+    ITEM_COUNT = 0;
+
+    return pred;
+}
+
+ArrayXu8 Predictor::classify(CRefXXfc inData, double threshold, size_t threadCount) const
+{
+    size_t ITEM_COUNT = 0;
+    ScopedProfiler sp(PROFILE::PREDICT, &ITEM_COUNT);
+
+    if (::currentInterruptHandler != nullptr)
+        ::currentInterruptHandler->check();
+    if (abortThreads)
+        throw ThreadAborted();
+
+    validateInData_(inData);
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    ArrayXu8 outData = classifyImpl_(inData, threshold, threadCount);
+
+    PROFILE::SWITCH(PROFILE::ZERO, ITEM_COUNT);   // calibrate the profiling
+    ITEM_COUNT = 0;
+
+    return outData;
+}
+
+ArrayXu8 Predictor::classifyImpl_(CRefXXfc inData, double threshold, size_t threadCount) const
+{
+    return (predictImpl_(inData, threadCount) >= threshold).cast<uint8_t>();
+}
+
+double Predictor::predictOne(CRefXf inData) const
+{
+    validateInData_(CRefXXfr(inData.transpose()));
+
+    double pred;
+    predictUncheckedImpl_(inData.data(), 0, inData.innerStride(), 1, &pred);
+    return pred;
+}
 
-    return predictOneImpl_(inData);
+void Predictor::predictUnchecked(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
+{
+    predictUncheckedImpl_(inData, rowStride, colStride, sampleCount, outData);
 }
 
 ArrayXf Predictor::variableWeights() const { return variableWeightsImpl_(); }
 
+ArrayXXdc Predictor::shapValues(CRefXXfc inData, size_t threadCount) const
+{
+    if (::currentInterruptHandler != nullptr)
+        ::currentInterruptHandler->check();
+    if (abortThreads)
+        throw ThreadAborted();
+
+    validateInData_(inData);
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    return shapValuesImpl_(inData, threadCount);
+}
+
+ArrayXXdc Predictor::shapValuesImpl_(CRefXXfc /*inData*/, size_t /*threadCount*/) const
+{
+    throw std::runtime_error("SHAP values are only supported for boost predictors.");
+}
+
+ArrayXd Predictor::permutationImportance(
+    CRefXXfc inData, CRefXu8 outData, function<double(CRefXu8, CRefXd, optional<CRefXd>)> lossFun,
+    size_t repeatCount, optional<CRefXd> weights, size_t threadCount) const
+{
+    if (::currentInterruptHandler != nullptr)
+        ::currentInterruptHandler->check();
+    if (abortThreads)
+        throw ThreadAborted();
+
+    validateInData_(inData);
+    if (outData.rows() != inData.rows())
+        throw std::invalid_argument("Test indata and outdata have different numbers of samples.");
+    if (repeatCount == 0)
+        throw std::invalid_argument("repeatCount must be positive.");
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    // all variables are permuted with the same permutations, this makes the importances easier to compare
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    vector<vector<size_t>> permutations(repeatCount, vector<size_t>(sampleCount));
+    for (auto& permutation : permutations) {
+        std::iota(begin(permutation), end(permutation), size_t{0});
+        std::shuffle(begin(permutation), end(permutation), ::theRne);
+    }
+
+    return permutationImportanceImpl_(inData, outData, lossFun, permutations, weights, threadCount);
+}
+
+ArrayXd Predictor::permutationImportanceImpl_(
+    CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+    const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const
+{
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const ArrayXs usedVariables = this->usedVariables();
+    const size_t usedVariableCount = static_cast<size_t>(usedVariables.rows());
+
+    ArrayXd importance = ArrayXd::Zero(variableCount());
+    if (usedVariableCount == 0)
+        return importance;
+
+    // gather the used variables, so that each thread only needs a copy of them
+
+    ArrayXs newIndices = ArrayXs::Zero(variableCount());
+    ArrayXXfc usedInData(sampleCount, usedVariableCount);
+    for (size_t k = 0; k != usedVariableCount; ++k) {
+        newIndices(usedVariables(k)) = k;
+        usedInData.col(k) = inData.col(usedVariables(k));
+    }
+    const shared_ptr<Predictor> usedPredictor = reindexVariablesImpl_(newIndices);
+
+    const double baseLoss = lossFun(outData, usedPredictor->predictImpl_(usedInData, threadCount), weights);
+
+    threadCount = std::min(threadCount, usedVariableCount);
+    std::atomic<size_t> nextK = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        ArrayXXfc permutedInData = usedInData;
+        ArrayXf column;
+
+        while (true) {
+            const size_t k = nextK++;
+            if (k >= usedVariableCount)
+                break;
+            column = usedInData.col(k);
+            double loss = 0.0;
+            for (const auto& permutation : permutations) {
+                for (size_t i = 0; i != sampleCount; ++i)
+                    permutedInData(i, k) = column(permutation[i]);
+                loss += lossFun(outData, usedPredictor->predictImpl_(permutedInData, 1), weights);
+            }
+            permutedInData.col(k) = column;
+            importance(usedVariables(k)) = loss / size(permutations) - baseLoss;
+        }
+    }
+    END_OMP_PARALLEL
+
+    return importance;
+}
+
+ArrayXs Predictor::usedVariables() const
+{
+    ArrayXu8 used = ArrayXu8::Zero(variableCount());
+    usedVariablesImpl_(used);
+
+    ArrayXs variables(used.cast<size_t>().sum());
+    size_t k = 0;
+    for (size_t j = 0; j != variableCount(); ++j) {
+        if (used(j))
+            variables(k++) = j;
+    }
+    return variables;
+}
+
 shared_ptr<Predictor> Predictor::reindexVariables(CRefXs newIndices) const
 {
     if (static_cast<size_t>(newIndices.rows()) < variableCount())
@@ -60,6 +454,34 @@ shared_ptr<Predictor> Predictor::reindexVariables(CRefXs newIndices) const
     return reindexVariablesImpl_(newIndices);
 }
 
+bool Predictor::reindexesEfficiently_() const { return true; }
+
+shared_ptr<Predictor> Predictor::createCompactPredictor_(CRefXs variables) const
+{
+    // the unused variables are never referenced, so their new indices do not matter
+    ArrayXs newIndices = ArrayXs::Zero(variableCount());
+    const size_t usedVariableCount = static_cast<size_t>(variables.size());
+    for (size_t k = 0; k != usedVariableCount; ++k)
+        newIndices(variables(k)) = k;
+    return reindexVariablesImpl_(newIndices);
+}
+
+ArrayXXdc Predictor::expandShapValues_(CRefXXdc compactShapValues, CRefXs variables, size_t variableCount)
+{
+    const size_t usedVariableCount = static_cast<size_t>(variables.size());
+    ArrayXXdc shapValues = ArrayXXdc::Zero(compactShapValues.rows(), variableCount + 1);
+    for (size_t k = 0; k != usedVariableCount; ++k)
+        shapValues.col(variables(k)) = compactShapValues.col(k);
+    shapValues.col(variableCount) = compactShapValues.rightCols(1);   // the expected value
+    return shapValues;
+}
+
+shared_ptr<Predictor> Predictor::project() const { return ProjectedPredictor::createInstance(sharedFromThis_()); }
+
+shared_ptr<Predictor> Predictor::quantize() const { return quantizeImpl_(); }
+
+shared_ptr<Predictor> Predictor::flatten() const { return flattenImpl_(); }
+
 
 void Predictor::save(const string& filePath) const
 {
@@ -118,6 +540,73 @@ shared_ptr<Predictor> Predictor::load(istream& is)
     }
 }
 
+void Predictor::saveCode(const string& filePath) const
+{
+    ofstream ofs;
+    ofs.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+    ofs.open(filePath);
+    saveCode(ofs);
+}
+
+void Predictor::saveCode(ostream& os) const
+{
+    // floating point literals are written in hexadecimal format so that they are reproduced exactly
+    const std::ios::fmtflags flags = os.flags();
+    os << std::hexfloat;
+
+    os << R"(// C source code generated by JrBoost
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define JRBOOST_EXPORT __declspec(dllexport)
+#else
+#define JRBOOST_EXPORT __attribute__((visibility("default")))
+#endif
+
+)";
+
+    size_t functionCount = 0;
+    const size_t k = saveCodeImpl_(os, &functionCount);
+
+    os << "JRBOOST_EXPORT size_t jrboostVariableCount(void)\n{\n    return " << variableCount() << ";\n}\n\n";
+    os << "JRBOOST_EXPORT uint64_t jrboostFingerprint(void)\n{\n    return " << fingerprint_() << "ull;\n}\n\n";
+    os << R"(JRBOOST_EXPORT void jrboostPredict(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData)
+{
+    for (size_t i = 0; i != sampleCount; ++i)
+)";
+    os << "        outData[i] = predictor" << k << "(inData + (ptrdiff_t)i * rowStride, colStride);\n}\n";
+
+    os.flags(flags);
+}
+
+
+uint64_t Predictor::fingerprint_() const
+{
+    stringstream ss;
+    ss.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+    saveImpl_(ss);
+
+    uint64_t h = 14695981039346656037ull;
+    for (char c : ss.str()) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+shared_ptr<Predictor> Predictor::loadMapped(const string& filePath)
+{
+    MappedStreamBuffer buffer(std::make_shared<const MappedFile>(filePath));
+    istream is(&buffer);
+    is.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+    return load(is);
+}
+
 shared_ptr<Predictor> Predictor::loadImpl_(istream& is, int version)
 {
     int type = is.get();
@@ -134,7 +623,13 @@ shared_ptr<Predictor> Predictor::loadImpl_(istream& is, int version)
             return EnsemblePredictor::loadImpl_(is, version);
         if (version >= 7 && type == 'U')
             return UnionPredictor::loadImpl_(is, version);
-        // if (version >= 9 && type == 'H')
+        if (version >= 9 && type == 'L')
+            return FlatPredictor::loadImpl_(is, version);
+        if (version >= 14 && type == 'P')
+            return PairPredictor::loadImpl_(is, version);
+        if (version >= 15 && type == 'M')
+            throw std::runtime_error("This is a JrBoost multinomial predictor file; load it with MultinomialPredictor.");
+        // if (version >= 16 && type == 'H')
         //    return ShiftPredictor::loadImpl_(is, version);
     }
     parseError(is);
@@ -152,7 +647,8 @@ BoostPredictor::BoostPredictor(double c0, double c1, vector<unique_ptr<BasePredi
     Predictor(initVariableCount_(basePredictors)),
     c0_{static_cast<float>(c0)},
     c1_{static_cast<float>(c1)},
-    basePredictors_{move(basePredictors)}
+    basePredictors_{move(basePredictors)},
+    remainingBounds_{initRemainingBounds_(c1_, basePredictors_)}
 {
 }
 
@@ -164,13 +660,29 @@ size_t BoostPredictor::initVariableCount_(const vector<unique_ptr<BasePredictor>
     return n;
 }
 
+vector<double>
+BoostPredictor::initRemainingBounds_(double c1, const vector<unique_ptr<BasePredictor>>& basePredictors)
+{
+    const size_t basePredictorCount = size(basePredictors);
+    vector<double> remainingBounds(basePredictorCount + 1, 0.0);
+    for (size_t k = basePredictorCount; k != 0; --k)
+        remainingBounds[k - 1] = remainingBounds[k] + std::abs(c1) * basePredictors[k - 1]->maxAbsPrediction_();
+    return remainingBounds;
+}
+
 BoostPredictor::~BoostPredictor() = default;
 
 
 ArrayXd BoostPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const ArrayXd pred = logOdds_(inData, threadCount);
+    return (1.0 + (-pred).exp()).inverse();
+}
+
+ArrayXd BoostPredictor::logOdds_(CRefXXfc inData, size_t threadCount) const
 {
     if (threadCount == 1)
-        return predictImplNoThreads_(inData);
+        return logOddsNoThreads_(inData);
 
     const size_t sampleCount = static_cast<size_t>(inData.rows());
     const size_t basePredictorCount = size(basePredictors_);
@@ -195,25 +707,127 @@ ArrayXd BoostPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
     }
     END_OMP_PARALLEL
 
-    ArrayXd pred = static_cast<double>(c0_) + predByThread.rowwise().sum();
-    return (1.0 + (-pred).exp()).inverse();
+    return static_cast<double>(c0_) + predByThread.rowwise().sum();
 }
 
-ArrayXd BoostPredictor::predictImplNoThreads_(CRefXXfc inData) const
+ArrayXd BoostPredictor::logOddsNoThreads_(CRefXXfc inData) const
 {
     const size_t sampleCount = static_cast<size_t>(inData.rows());
     ArrayXd pred = ArrayXd::Constant(sampleCount, static_cast<double>(c0_));
     for (const auto& basePredictor : basePredictors_)
         basePredictor->predict_(inData, static_cast<double>(c1_), pred);
-    return (1.0 + (-pred).exp()).inverse();
+    return pred;
 }
 
-double BoostPredictor::predictOneImpl_(CRefXf inData) const
+void BoostPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
 {
-    double pred = c0_;
-    for (const auto& basePredictor : basePredictors_)
-        pred += c1_ * basePredictor->predictOne_(inData);
-    return 1.0 / (1.0 + std::exp(-pred));
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const float* x = inData + static_cast<ptrdiff_t>(i) * rowStride;
+        double pred = c0_;
+        for (const auto& basePredictor : basePredictors_)
+            pred += c1_ * basePredictor->predictOne_(x, colStride);
+        outData[i] = 1.0 / (1.0 + std::exp(-pred));
+    }
+}
+
+// The test data is processed in blocks of samples. The base predictors are added in order, a few at a time, and after
+// each step the samples are checked. A sample is classified as soon as the remaining base predictors can no longer
+// move its log odds across the log odds of the threshold. When enough samples have been classified, the remaining
+// samples are compacted, so that later base predictors are only evaluated for them.
+// A small margin guards against rounding errors; samples that stay within it are evaluated in full.
+
+ArrayXu8 BoostPredictor::classifyImpl_(CRefXXfc inData, double threshold, size_t threadCount) const
+{
+    if (!(threshold > 0.0 && threshold < 1.0))
+        return (predictImpl_(inData, threadCount) >= threshold).cast<uint8_t>();
+
+    const double logOddsThreshold = std::log(threshold / (1.0 - threshold));
+    const double margin = 1e-9 * (1.0 + std::abs(logOddsThreshold));
+    const double upperLimit = logOddsThreshold + margin;
+    const double lowerLimit = logOddsThreshold - margin;
+
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t basePredictorCount = size(basePredictors_);
+    const size_t blockSize = 256;
+    const size_t stepSize = 16;   // number of base predictors added between the checks
+    const size_t decided = numeric_limits<size_t>::max();
+    const size_t blockCount = divideRoundUp(sampleCount, blockSize);
+    ArrayXu8 outData(sampleCount);
+    if (blockCount == 0)
+        return outData;
+
+    threadCount = std::min(threadCount, blockCount);
+    std::atomic<size_t> nextBlock = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        static thread_local ArrayXXfc compactInData;
+        static thread_local ArrayXd pred;
+        static thread_local vector<size_t> samples;   // samples[r] is the sample of row r, or decided
+
+        while (true) {
+            const size_t block = nextBlock++;
+            if (block >= blockCount)
+                break;
+            const size_t iBegin = block * blockSize;
+            const size_t iEnd = std::min(iBegin + blockSize, sampleCount);
+
+            size_t rowCount = iEnd - iBegin;
+            size_t undecidedCount = rowCount;
+            bool isCompact = false;   // whether the rows are in compactInData or in inData
+            samples.resize(rowCount);
+            std::iota(begin(samples), end(samples), iBegin);
+            pred.setConstant(rowCount, static_cast<double>(c0_));
+
+            size_t k = 0;
+            while (k != basePredictorCount) {
+                const CRefXXfc rows = isCompact ? CRefXXfc(compactInData.topRows(rowCount))
+                                                : CRefXXfc(inData.middleRows(iBegin, rowCount));
+                const size_t kEnd = std::min(k + stepSize, basePredictorCount);
+                for (; k != kEnd; ++k)
+                    basePredictors_[k]->predict_(rows, static_cast<double>(c1_), pred.head(rowCount));
+
+                const double bound = remainingBounds_[k];
+                for (size_t r = 0; r != rowCount; ++r) {
+                    if (samples[r] == decided)
+                        continue;
+                    if (pred(r) - bound > upperLimit || pred(r) + bound < lowerLimit) {
+                        outData(samples[r]) = pred(r) > logOddsThreshold;
+                        samples[r] = decided;
+                        --undecidedCount;
+                    }
+                }
+                if (undecidedCount == 0)
+                    break;
+                if (k == basePredictorCount || 4 * undecidedCount > 3 * rowCount)
+                    continue;
+
+                // compact the undecided rows; rows are only moved forward, so this also works in place
+                if (!isCompact)
+                    compactInData.resize(blockSize, variableCount());
+                size_t r1 = 0;
+                for (size_t r = 0; r != rowCount; ++r) {
+                    if (samples[r] == decided)
+                        continue;
+                    compactInData.row(r1) = rows.row(r).head(variableCount());
+                    pred(r1) = pred(r);
+                    samples[r1] = samples[r];
+                    ++r1;
+                }
+                rowCount = r1;
+                isCompact = true;
+            }
+
+            for (size_t r = 0; r != rowCount; ++r) {
+                if (samples[r] != decided)
+                    outData(samples[r]) = 1.0 / (1.0 + std::exp(-pred(r))) >= threshold;
+            }
+        }
+    }
+    END_OMP_PARALLEL
+
+    return outData;
 }
 
 ArrayXf BoostPredictor::variableWeightsImpl_() const
@@ -225,6 +839,12 @@ ArrayXf BoostPredictor::variableWeightsImpl_() const
     return weights.cast<float>();
 }
 
+void BoostPredictor::usedVariablesImpl_(RefXu8 used) const
+{
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->usedVariables_(used);
+}
+
 shared_ptr<Predictor> BoostPredictor::reindexVariablesImpl_(CRefXs newIndices) const
 {
     vector<unique_ptr<BasePredictor>> basePredictors;
@@ -276,6 +896,155 @@ shared_ptr<Predictor> BoostPredictor::loadImpl_(istream& is, int version)
     return createInstance(c0, c1, move(basePredictors));
 }
 
+shared_ptr<Predictor> BoostPredictor::quantizeImpl_() const
+{
+    vector<pair<double, vector<TreeNode>>> trees;
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->flatten_(static_cast<double>(c1_), trees);
+    return QuantizedPredictor::createInstance(sharedFromThis_(), static_cast<double>(c0_), trees);
+}
+
+shared_ptr<Predictor> BoostPredictor::flattenImpl_() const
+{
+    vector<pair<double, vector<TreeNode>>> trees;
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->flatten_(static_cast<double>(c1_), trees);
+    return FlatPredictor::createInstance(static_cast<double>(c0_), trees, variableWeightsImpl_());
+}
+
+ArrayXXdc BoostPredictor::shapValuesImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t variableCount = this->variableCount();
+    const ptrdiff_t colStride = inData.outerStride();
+    const size_t blockSize = 256;
+    const size_t blockCount = divideRoundUp(sampleCount, blockSize);
+    ArrayXXdc shapValues(sampleCount, variableCount + 1);
+    if (blockCount == 0)
+        return shapValues;
+
+    threadCount = std::min(threadCount, blockCount);
+    std::atomic<size_t> nextBlock = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        static thread_local ArrayXd sampleShapValues;
+
+        while (true) {
+            const size_t block = nextBlock++;
+            if (block >= blockCount)
+                break;
+            const size_t iBegin = block * blockSize;
+            const size_t iEnd = std::min(iBegin + blockSize, sampleCount);
+            for (size_t i = iBegin; i != iEnd; ++i) {
+                sampleShapValues.setZero(variableCount + 1);
+                double expectedValue = c0_;
+                for (const auto& basePredictor : basePredictors_)
+                    expectedValue += basePredictor->shapValues_(
+                        inData.data() + i, colStride, static_cast<double>(c1_), sampleShapValues.data());
+                sampleShapValues(variableCount) = expectedValue;
+                shapValues.row(i) = sampleShapValues.transpose();
+            }
+        }
+    }
+    END_OMP_PARALLEL
+
+    return shapValues;
+}
+
+
+// A permuted variable is scored by only reevaluating the base predictors that use it. The log odds of the samples are
+// computed once. For each used variable, the contribution of the base predictors that use the variable is computed
+// and subtracted from the log odds; then, for each permutation, the permuted values are written to a scratch column
+// and the contribution of those base predictors, evaluated with the scratch column, is added back.
+// The predictions of the individual base predictors are not stored, since that would take samples x base predictors
+// doubles. The memory used is one double per sample for the log odds, and one float and two doubles per sample for
+// each thread.
+
+ArrayXd BoostPredictor::permutationImportanceImpl_(
+    CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+    const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const
+{
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t variableCount = this->variableCount();
+    const size_t basePredictorCount = size(basePredictors_);
+
+    // basePredictorsByVariable[j] holds the indices of the base predictors that use variable j
+
+    vector<vector<size_t>> basePredictorsByVariable(variableCount);
+    ArrayXu8 used(variableCount);
+    for (size_t k = 0; k != basePredictorCount; ++k) {
+        used.setZero();
+        basePredictors_[k]->usedVariables_(used);
+        for (size_t j = 0; j != variableCount; ++j) {
+            if (used(j))
+                basePredictorsByVariable[j].push_back(k);
+        }
+    }
+    vector<size_t> usedVariables;
+    for (size_t j = 0; j != variableCount; ++j) {
+        if (!basePredictorsByVariable[j].empty())
+            usedVariables.push_back(j);
+    }
+    const size_t usedVariableCount = size(usedVariables);
+
+    ArrayXd importance = ArrayXd::Zero(variableCount);
+    if (usedVariableCount == 0)
+        return importance;
+
+    const ArrayXd basePred = logOdds_(inData, threadCount);
+    const double baseLoss = lossFun(outData, (1.0 + (-basePred).exp()).inverse(), weights);
+
+    threadCount = std::min(threadCount, usedVariableCount);
+    std::atomic<size_t> nextVariable = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        ArrayXf permutedColumn(sampleCount);
+        ArrayXd otherPred(sampleCount);   // the contribution of the base predictors that do not use variable j
+        ArrayXd pred(sampleCount);
+
+        while (true) {
+            const size_t variable = nextVariable++;
+            if (variable >= usedVariableCount)
+                break;
+            const size_t j = usedVariables[variable];
+
+            pred.setZero();
+            for (size_t k : basePredictorsByVariable[j])
+                basePredictors_[k]->predict_(inData, static_cast<double>(c1_), pred);
+            otherPred = basePred - pred;
+
+            double loss = 0.0;
+            for (const auto& permutation : permutations) {
+                if (abortThreads)
+                    throw ThreadAborted();
+                for (size_t i = 0; i != sampleCount; ++i)
+                    permutedColumn(i) = inData(permutation[i], j);
+                pred = otherPred;
+                for (size_t k : basePredictorsByVariable[j])
+                    basePredictors_[k]->predictPermuted_(inData, j, permutedColumn, static_cast<double>(c1_), pred);
+                loss += lossFun(outData, (1.0 + (-pred).exp()).inverse(), weights);
+            }
+            importance(j) = loss / size(permutations) - baseLoss;
+        }
+    }
+    END_OMP_PARALLEL
+
+    return importance;
+}
+
+size_t BoostPredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    const size_t k = (*functionCount)++;
+    os << "static double predictor" << k << "(const float* x, ptrdiff_t s)\n{\n";
+    os << "    double pred = " << static_cast<double>(c0_) << ";\n";
+    for (const auto& basePredictor : basePredictors_)
+        basePredictor->saveCode_(os, static_cast<double>(c1_), 1);
+    os << "    return 1.0 / (1.0 + exp(-pred));\n}\n\n";
+    return k;
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 
 shared_ptr<Predictor> EnsemblePredictor::createInstance(const vector<shared_ptr<Predictor>>& predictors)
@@ -340,13 +1109,20 @@ ArrayXd EnsemblePredictor::predictImplNoThreads_(CRefXXfc inData) const
     return pred;
 }
 
-double EnsemblePredictor::predictOneImpl_(CRefXf inData) const
+void EnsemblePredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
 {
-    double pred = 0.0;
-    for (const auto& predictor : predictors_)
-        pred += predictor->predictOneImpl_(inData);
-    pred /= static_cast<double>(size(predictors_));
-    return pred;
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const float* x = inData + static_cast<ptrdiff_t>(i) * rowStride;
+        double pred = 0.0;
+        for (const auto& predictor : predictors_) {
+            double p;
+            predictor->predictUncheckedImpl_(x, 0, colStride, 1, &p);
+            pred += p;
+        }
+        pred /= static_cast<double>(size(predictors_));
+        outData[i] = pred;
+    }
 }
 
 ArrayXf EnsemblePredictor::variableWeightsImpl_() const
@@ -360,6 +1136,12 @@ ArrayXf EnsemblePredictor::variableWeightsImpl_() const
     return weights;
 }
 
+void EnsemblePredictor::usedVariablesImpl_(RefXu8 used) const
+{
+    for (const auto& predictor : predictors_)
+        predictor->usedVariablesImpl_(used(Eigen::seqN(0, predictor->variableCount())));
+}
+
 shared_ptr<Predictor> EnsemblePredictor::reindexVariablesImpl_(CRefXs newIndices) const
 {
     vector<shared_ptr<Predictor>> predictors;
@@ -369,6 +1151,13 @@ shared_ptr<Predictor> EnsemblePredictor::reindexVariablesImpl_(CRefXs newIndices
     return createInstance(move(predictors));
 }
 
+bool EnsemblePredictor::reindexesEfficiently_() const
+{
+    return std::all_of(begin(predictors_), end(predictors_), [](const auto& predictor) {
+        return predictor->reindexesEfficiently_();
+    });
+}
+
 
 void EnsemblePredictor::saveImpl_(ostream& os) const
 {
@@ -400,6 +1189,43 @@ shared_ptr<Predictor> EnsemblePredictor::loadImpl_(istream& is, int version)
     return createInstance(predictors);
 }
 
+
+size_t EnsemblePredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    vector<size_t> indices;
+    indices.reserve(size(predictors_));
+    for (const auto& predictor : predictors_)
+        indices.push_back(predictor->saveCodeImpl_(os, functionCount));
+
+    const size_t k = (*functionCount)++;
+    os << "static double predictor" << k << "(const float* x, ptrdiff_t s)\n{\n";
+    os << "    double pred = 0.0;\n";
+    for (size_t i : indices)
+        os << "    pred += predictor" << i << "(x, s);\n";
+    os << "    return pred / " << size(predictors_) << ".0;\n}\n\n";
+    return k;
+}
+
+shared_ptr<Predictor> EnsemblePredictor::quantizeImpl_() const
+{
+    vector<shared_ptr<Predictor>> predictors;
+    predictors.reserve(size(predictors_));
+    for (const auto& predictor : predictors_)
+        predictors.push_back(predictor->quantizeImpl_());
+    return createInstance(predictors);
+}
+
+// merges the flattened predictors into one flat predictor, if possible
+shared_ptr<Predictor> EnsemblePredictor::flattenImpl_() const
+{
+    vector<shared_ptr<Predictor>> predictors;
+    predictors.reserve(size(predictors_));
+    for (const auto& predictor : predictors_)
+        predictors.push_back(predictor->flattenImpl_());
+    shared_ptr<Predictor> flatPredictor = FlatPredictor::merge_(predictors, false);
+    return flatPredictor ? flatPredictor : createInstance(predictors);
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 
 shared_ptr<Predictor> UnionPredictor::createInstance(const vector<shared_ptr<Predictor>>& predictors)
@@ -462,12 +1288,19 @@ ArrayXd UnionPredictor::predictImplNoThreads_(CRefXXfc inData) const
     return 1.0 - pred;
 }
 
-double UnionPredictor::predictOneImpl_(CRefXf inData) const
+void UnionPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
 {
-    double pred = 1.0;
-    for (const auto& predictor : predictors_)
-        pred *= 1.0 - predictor->predictOneImpl_(inData);
-    return 1.0 - pred;
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const float* x = inData + static_cast<ptrdiff_t>(i) * rowStride;
+        double pred = 1.0;
+        for (const auto& predictor : predictors_) {
+            double p;
+            predictor->predictUncheckedImpl_(x, 0, colStride, 1, &p);
+            pred *= 1.0 - p;
+        }
+        outData[i] = 1.0 - pred;
+    }
 }
 
 ArrayXf UnionPredictor::variableWeightsImpl_() const
@@ -480,6 +1313,12 @@ ArrayXf UnionPredictor::variableWeightsImpl_() const
     return weights;
 }
 
+void UnionPredictor::usedVariablesImpl_(RefXu8 used) const
+{
+    for (const auto& predictor : predictors_)
+        predictor->usedVariablesImpl_(used(Eigen::seqN(0, predictor->variableCount())));
+}
+
 shared_ptr<Predictor> UnionPredictor::reindexVariablesImpl_(CRefXs newIndices) const
 {
     vector<shared_ptr<Predictor>> predictors;
@@ -489,6 +1328,13 @@ shared_ptr<Predictor> UnionPredictor::reindexVariablesImpl_(CRefXs newIndices) c
     return createInstance(predictors);
 }
 
+bool UnionPredictor::reindexesEfficiently_() const
+{
+    return std::all_of(begin(predictors_), end(predictors_), [](const auto& predictor) {
+        return predictor->reindexesEfficiently_();
+    });
+}
+
 
 void UnionPredictor::saveImpl_(ostream& os) const
 {
@@ -508,6 +1354,43 @@ shared_ptr<Predictor> UnionPredictor::loadImpl_(istream& is, int version)
     return createInstance(predictors);
 }
 
+
+size_t UnionPredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    vector<size_t> indices;
+    indices.reserve(size(predictors_));
+    for (const auto& predictor : predictors_)
+        indices.push_back(predictor->saveCodeImpl_(os, functionCount));
+
+    const size_t k = (*functionCount)++;
+    os << "static double predictor" << k << "(const float* x, ptrdiff_t s)\n{\n";
+    os << "    double pred = 1.0;\n";
+    for (size_t i : indices)
+        os << "    pred *= 1.0 - predictor" << i << "(x, s);\n";
+    os << "    return 1.0 - pred;\n}\n\n";
+    return k;
+}
+
+shared_ptr<Predictor> UnionPredictor::quantizeImpl_() const
+{
+    vector<shared_ptr<Predictor>> predictors;
+    predictors.reserve(size(predictors_));
+    for (const auto& predictor : predictors_)
+        predictors.push_back(predictor->quantizeImpl_());
+    return createInstance(predictors);
+}
+
+// merges the flattened predictors into one flat predictor, if possible
+shared_ptr<Predictor> UnionPredictor::flattenImpl_() const
+{
+    vector<shared_ptr<Predictor>> predictors;
+    predictors.reserve(size(predictors_));
+    for (const auto& predictor : predictors_)
+        predictors.push_back(predictor->flattenImpl_());
+    shared_ptr<Predictor> flatPredictor = FlatPredictor::merge_(predictors, true);
+    return flatPredictor ? flatPredictor : createInstance(predictors);
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 
 /*
@@ -543,16 +1426,19 @@ ArrayXd ShiftPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
 }
 
 
-double ShiftPredictor::predictOneImpl_(CRefXf inData) const
+void ShiftPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
 {
+    predictor_->predictUncheckedImpl_(inData, rowStride, colStride, sampleCount, outData);
     if (lorShift_ == 0)
-        return predictor_->predictOneImpl_(inData);
+        return;
 
-    double pred = predictor_->predictOneImpl_(inData);
-    pred = std::log(pred) - std::log(1.0 - pred);
-    pred += lorShift_;
-    pred = 1.0 / (1.0 + std::exp(-pred));
-    return pred;
+    for (size_t i = 0; i != sampleCount; ++i) {
+        double pred = outData[i];
+        pred = std::log(pred) - std::log(1.0 - pred);
+        pred += lorShift_;
+        outData[i] = 1.0 / (1.0 + std::exp(-pred));
+    }
 }
 
 ArrayXf ShiftPredictor::variableWeightsImpl_() const { return predictor_->variableWeightsImpl_(); }
@@ -15,41 +15,161 @@ class BasePredictor;
 // 6 - changed predictor and base predictor tags
 // 7 - added union predictors
 // 8 - added variable weights, simplified handling of variable count, reintroduced gain
-
-class Predictor {   // abstract class
+// 9 - added flat predictors
+// 10 - added flat predictors with several members
+// 11 - added train sample counts to stump and tree predictors
+// 12 - added default directions for missing values to tree predictors
+// 13 - added categorical splits to tree predictors
+// 14 - added pair predictors
+// 15 - added multinomial predictors
+
+class Predictor : public std::enable_shared_from_this<Predictor> {   // abstract class
 public:
     virtual ~Predictor() = default;
 
     size_t variableCount() const { return variableCount_; }
     ArrayXd predict(CRefXXfc inData, size_t threadCount = 0) const;
+    // write the predictions to outData; the test data is processed in blocks of rows,
+    // so the memory used does not grow with the number of samples
+    void predict(CRefXXfc inData, RefXd outData, size_t threadCount = 0) const;
+    void predict(CRefXXfc inData, RefXf outData, size_t threadCount = 0) const;
+    // the test indata blocks are treated as one matrix, see Dataset.h; they are never concatenated,
+    // the used variables are gathered one block of rows at a time, and only the used variables are validated
+    ArrayXd predict(const vector<CRefXXfc>& inDataBlocks, size_t threadCount = 0) const;
+    // row-major test data is scored in place, without being copied to column-major order
+    // (not an overload of predict() since Eigen::Ref would make calls with ArrayXXfc arguments ambiguous)
+    ArrayXd predictRowMajor(CRefXXfr inData, size_t threadCount = 0) const;
+    void predictRowMajor(CRefXXfr inData, RefXd outData, size_t threadCount = 0) const;
+    void predictRowMajor(CRefXXfr inData, RefXf outData, size_t threadCount = 0) const;
+    // Evaluates many predictors on the same test data. The test data is validated once and is processed in blocks
+    // of rows; all predictors are evaluated on a block while it is in the cache. Returns a samples x predictors array.
+    static ArrayXXdc
+    predictMany(const vector<shared_ptr<Predictor>>& predictors, CRefXXfc inData, size_t threadCount = 0);
     double predictOne(CRefXf inData) const;
+    // Returns 1 for the samples with prediction >= threshold and 0 for the others.
+    // Boost predictors stop evaluating a sample as soon as the remaining trees can no longer change the outcome.
+    ArrayXu8 classify(CRefXXfc inData, double threshold, size_t threadCount = 0) const;
+    // Low-latency prediction for single samples and small batches of test data that has already been validated.
+    // inData[i * rowStride + j * colStride] is variable j of sample i.
+    // No validation is done and, apart from thread local scratch buffers that are reused, no memory is allocated.
+    void predictUnchecked(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
     ArrayXf variableWeights() const;
+    // Returns the SHAP values of the log odds of the predictions, computed with path-dependent TreeSHAP.
+    // The result is a samples x (variables + 1) array, the last column holds the expected value, so that each row
+    // sums to the log odds. Only supported by boost predictors, and by predictors derived from them.
+    ArrayXXdc shapValues(CRefXXfc inData, size_t threadCount = 0) const;
+    // Returns the permutation importance of each variable: the increase of the loss when the values of the variable are
+    // randomly permuted between the samples, averaged over repeatCount permutations. The unused variables get 0.
+    // The variables are evaluated in parallel; boost predictors only reevaluate the base predictors that use the
+    // permuted variable. lossFun may be called from several threads at the same time.
+    ArrayXd permutationImportance(
+        CRefXXfc inData, CRefXu8 outData, function<double(CRefXu8, CRefXd, optional<CRefXd>)> lossFun,
+        size_t repeatCount = 1, optional<CRefXd> weights = std::nullopt, size_t threadCount = 0) const;
+    // returns the indices of the variables used by the predictor, sorted
+    ArrayXs usedVariables() const;
     shared_ptr<Predictor> reindexVariables(CRefXs newIndices) const;
+    // returns an equivalent predictor that only reads and validates the used variables, see ProjectedPredictor.h
+    shared_ptr<Predictor> project() const;
+    // returns an equivalent predictor that bins the test data and uses integer comparisons, see QuantizedPredictor.h
+    shared_ptr<Predictor> quantize() const;
+    // returns an equivalent predictor with all trees stored in one compact array, see FlatPredictor.h
+    shared_ptr<Predictor> flatten() const;
 
     void save(const string& filePath) const;
     void save(ostream& os) const;
     static shared_ptr<Predictor> load(const string& filePath);
     static shared_ptr<Predictor> load(istream& is);
+    // memory maps the file; flat predictors in the file then use the mapped memory directly, see FlatPredictor.h
+    static shared_ptr<Predictor> loadMapped(const string& filePath);
+
+    // writes C source code that implements the predictor, see CompiledPredictor.h
+    void saveCode(const string& filePath) const;
+    void saveCode(ostream& os) const;
 
 protected:
     Predictor(size_t variableCount);
     Predictor(const Predictor&) = delete;
     Predictor& operator=(const Predictor&) = delete;
 
+    // predictors are immutable, so handing out non-const pointers to them is safe
+    shared_ptr<Predictor> sharedFromThis_() const { return std::const_pointer_cast<Predictor>(shared_from_this()); }
+
+    // Helpers for predictors that gather the used variables of a source predictor, and predict them with a compact
+    // predictor: the source predictor with variable variables(k) reindexed to k, for the sorted used variables.
+    // createCompactPredictor_() returns the compact predictor; the other variables are never referenced.
+    // expandShapValues_() returns the SHAP values of the source predictor, with variableCount variables,
+    // given those of the compact predictor.
+    shared_ptr<Predictor> createCompactPredictor_(CRefXs variables) const;
+    static ArrayXXdc expandShapValues_(CRefXXdc compactShapValues, CRefXs variables, size_t variableCount);
+
 private:
+    template<typename OutData>
+    void predictInto_(CRefXXfc inData, OutData& outData, size_t threadCount) const;
+    template<typename OutData>
+    void predictRowMajorInto_(CRefXXfr inData, OutData& outData, size_t threadCount) const;
+
+    // How predict() with blocks of test data predicts the used variables once they are gathered:
+    // used variable usedVariables(k) goes to column columns(k) of a columnCount wide buffer that is then predicted
+    // by predictor. Computed by the first call and then reused.
+    struct GatheredPrediction_ {
+        std::once_flag initFlag;
+        ArrayXs usedVariables;
+        ArrayXs columns;
+        size_t columnCount;
+        const Predictor* predictor;
+        shared_ptr<Predictor> reindexedPredictor;   // owns predictor, unless predictor is this predictor
+    };
+    const GatheredPrediction_& gatheredPrediction_() const;
+
+    // test data in column-major or row-major order
+    using InDataRef_ = std::variant<CRefXXfc, CRefXXfr>;
+    // throws if the test data has too few variables or has values that are infinity (NaN means missing);
+    // all prediction functions validate the test data with this function, whatever its layout
+    virtual void validateInData_(const InDataRef_& inData) const;
     virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const = 0;
-    virtual double predictOneImpl_(CRefXf inData) const = 0;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const = 0;
+    // the default implementation compares the predictions with the threshold
+    virtual ArrayXu8 classifyImpl_(CRefXXfc inData, double threshold, size_t threadCount) const;
     virtual ArrayXf variableWeightsImpl_() const = 0;
+    // set used(j) to 1 for each variable j that is used
+    virtual void usedVariablesImpl_(RefXu8 used) const = 0;
     virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const = 0;
+    // returns false if the reindexed predictors are slower than the predictor (the default returns true)
+    virtual bool reindexesEfficiently_() const;
     virtual void saveImpl_(ostream& os) const = 0;
     static shared_ptr<Predictor> loadImpl_(istream& is, int version);
+    // writes a static C function that implements the predictor and returns the function index
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const = 0;
+    // a hash (64-bit FNV-1a) of the saved predictor; saveCode() writes it into the C source code,
+    // so that CompiledPredictor can check that a library was compiled from the predictor
+    uint64_t fingerprint_() const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const = 0;
+    virtual shared_ptr<Predictor> flattenImpl_() const = 0;
+    // the default implementation throws
+    virtual ArrayXXdc shapValuesImpl_(CRefXXfc inData, size_t threadCount) const;
+    // permutations[r] is the r-th permutation of the samples;
+    // the default implementation predicts a copy of the used variables with one variable permuted at a time
+    virtual ArrayXd permutationImportanceImpl_(
+        CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+        const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const;
 
     const size_t variableCount_;
+    mutable GatheredPrediction_ gatheredPredictionCache_;
 
-    static const int currentFileFormatVersion_ = 8;
+    static const int currentFileFormatVersion_ = 15;
+    static const size_t outBlockSize_ = 16384;   // number of rows predicted at a time when writing to outData
+    static const size_t manyBlockSize_ = 1024;   // number of rows predicted at a time by predictMany()
 
     friend class EnsemblePredictor;
     friend class UnionPredictor;
+    friend class CompiledPredictor;
+    friend class QuantizedPredictor;
+    friend class FlatPredictor;
+    friend class ProjectedPredictor;
+    friend class PairPredictor;
+    friend class MultinomialPredictor;
     // friend class ShiftPredictor;
 };
 
@@ -63,21 +183,36 @@ public:
 private:
     BoostPredictor(double c0, double c1, vector<unique_ptr<BasePredictor>>&& basePredictors);
     static size_t initVariableCount_(const vector<unique_ptr<BasePredictor>>& basePredictors);
+    static vector<double> initRemainingBounds_(double c1, const vector<unique_ptr<BasePredictor>>& basePredictors);
 
     virtual ~BoostPredictor();
     virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
-    ArrayXd predictImplNoThreads_(CRefXXfc inData) const;
-    virtual double predictOneImpl_(CRefXf inData) const;
+    ArrayXd logOdds_(CRefXXfc inData, size_t threadCount) const;   // the predictions before the logistic function
+    ArrayXd logOddsNoThreads_(CRefXXfc inData) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
+    virtual ArrayXu8 classifyImpl_(CRefXXfc inData, double threshold, size_t threadCount) const;
     virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
     virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
     virtual void saveImpl_(ostream& os) const;
     static shared_ptr<Predictor> loadImpl_(istream& is, int version);
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
+    virtual ArrayXXdc shapValuesImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual ArrayXd permutationImportanceImpl_(
+        CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+        const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const;
 
     float c0_;
     float c1_;
     vector<unique_ptr<BasePredictor>> basePredictors_;
+    // remainingBounds_[k] bounds the absolute value of the contribution of base predictors k, k + 1, ...
+    vector<double> remainingBounds_;
 
     friend class Predictor;
+    friend class MultinomialPredictor;
     friend class MakeSharedHelper<BoostPredictor>;
 };
 
@@ -94,11 +229,17 @@ private:
     virtual ~EnsemblePredictor() = default;
     virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
     ArrayXd predictImplNoThreads_(CRefXXfc inData) const;
-    virtual double predictOneImpl_(CRefXf inData) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
     virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
     virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
+    virtual bool reindexesEfficiently_() const;
     virtual void saveImpl_(ostream& os) const;
     static shared_ptr<Predictor> loadImpl_(istream& is, int version);
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
 
     vector<shared_ptr<Predictor>> predictors_;
 
@@ -119,11 +260,17 @@ private:
     virtual ~UnionPredictor() = default;
     virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
     ArrayXd predictImplNoThreads_(CRefXXfc inData) const;
-    virtual double predictOneImpl_(CRefXf inData) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
     virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
     virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
+    virtual bool reindexesEfficiently_() const;
     virtual void saveImpl_(ostream& os) const;
     static shared_ptr<Predictor> loadImpl_(istream& is, int version);
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
 
     vector<shared_ptr<Predictor>> predictors_;
 
@@ -144,7 +291,8 @@ private:
 
     virtual ~ShiftPredictor() = default;
     virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
-    virtual double predictOneImpl_(CRefXf inData) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
     virtual ArrayXf variableWeightsImpl_() const;
     virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
     virtual void saveImpl_(ostream& os) const;
@@ -0,0 +1,79 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "ProjectedPredictor.h"
+
+
+shared_ptr<Predictor> ProjectedPredictor::createInstance(shared_ptr<Predictor> predictor)
+{
+    return makeShared<ProjectedPredictor>(predictor);
+}
+
+ProjectedPredictor::ProjectedPredictor(shared_ptr<Predictor> predictor) :
+    Predictor(predictor->variableCount()),
+    predictor_(predictor),
+    variables_(predictor->usedVariables()),
+    compactPredictor_(predictor->createCompactPredictor_(variables_))
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// only the values of the used variables are validated
+void ProjectedPredictor::validateInData_(const InDataRef_& inData) const
+{
+    std::visit(
+        [this](const auto& inData) {
+            if (static_cast<size_t>(inData.cols()) < variableCount())
+                throw std::invalid_argument("Test indata has fewer variables than train indata.");
+            if (inData(Eigen::all, variables_).isInf().any())
+                throw std::invalid_argument("Test indata has values that are infinity.");
+        },
+        inData);
+}
+
+ArrayXd ProjectedPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const ArrayXXfc compactInData = inData(Eigen::all, variables_);
+    return compactPredictor_->predictImpl_(compactInData, threadCount);
+}
+
+// single samples are not gathered; the source predictor only reads the used variables anyway
+void ProjectedPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
+{
+    predictor_->predictUncheckedImpl_(inData, rowStride, colStride, sampleCount, outData);
+}
+
+ArrayXf ProjectedPredictor::variableWeightsImpl_() const { return predictor_->variableWeightsImpl_(); }
+
+void ProjectedPredictor::usedVariablesImpl_(RefXu8 used) const { used(variables_) = 1; }
+
+shared_ptr<Predictor> ProjectedPredictor::reindexVariablesImpl_(CRefXs newIndices) const
+{
+    return createInstance(predictor_->reindexVariablesImpl_(newIndices));
+}
+
+bool ProjectedPredictor::reindexesEfficiently_() const { return predictor_->reindexesEfficiently_(); }
+
+void ProjectedPredictor::saveImpl_(ostream& os) const { predictor_->saveImpl_(os); }
+
+size_t ProjectedPredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    return predictor_->saveCodeImpl_(os, functionCount);
+}
+
+shared_ptr<Predictor> ProjectedPredictor::quantizeImpl_() const { return predictor_->quantizeImpl_(); }
+
+shared_ptr<Predictor> ProjectedPredictor::flattenImpl_() const { return predictor_->flattenImpl_(); }
+
+// the SHAP values are computed for the gathered used variables and then scattered back
+ArrayXXdc ProjectedPredictor::shapValuesImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const ArrayXXfc compactInData = inData(Eigen::all, variables_);
+    const ArrayXXdc compactShapValues = compactPredictor_->shapValuesImpl_(compactInData, threadCount);
+    return expandShapValues_(compactShapValues, variables_, variableCount());
+}
@@ -0,0 +1,43 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "Predictor.h"
+
+// A predictor that only reads the variables used by the source predictor.
+// The used variables are determined once, when the projected predictor is created. The corresponding columns of
+// the test data are gathered into a compact matrix, only those columns are validated, and the compact matrix is
+// scored by a copy of the source predictor with the used variables reindexed to 0, 1, 2, ...
+// This makes the cost of prediction on very wide test data proportional to the size of the model.
+// Everything except prediction is delegated to the source predictor.
+
+class ProjectedPredictor : public Predictor {   // immutable class
+public:
+    static shared_ptr<Predictor> createInstance(shared_ptr<Predictor> predictor);
+
+private:
+    ProjectedPredictor(shared_ptr<Predictor> predictor);
+
+    virtual ~ProjectedPredictor() = default;
+    virtual void validateInData_(const InDataRef_& inData) const;
+    virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
+    virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
+    virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
+    virtual bool reindexesEfficiently_() const;
+    virtual void saveImpl_(ostream& os) const;
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
+    virtual ArrayXXdc shapValuesImpl_(CRefXXfc inData, size_t threadCount) const;
+
+    shared_ptr<Predictor> predictor_;
+    ArrayXs variables_;                        // the variables used by the source predictor, sorted
+    shared_ptr<Predictor> compactPredictor_;   // the source predictor with variable variables_(k) reindexed to k
+
+    friend class MakeSharedHelper<ProjectedPredictor>;
+};
@@ -0,0 +1,221 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "QuantizedPredictor.h"
+
+#include "OmpParallel.h"
+#include "Tree.h"
+
+
+shared_ptr<Predictor> QuantizedPredictor::createInstance(
+    shared_ptr<Predictor> predictor, double c0, const vector<pair<double, vector<TreeNode>>>& trees)
+{
+    // categorical splits do not fit the bin codes, so a predictor with categorical splits is returned as is
+    for (const auto& [c, nodes] : trees) {
+        for (const TreeNode& node : nodes) {
+            if (!node.isLeaf && node.leftCategories != 0)
+                return predictor;
+        }
+    }
+    return makeShared<QuantizedPredictor>(predictor, c0, trees);
+}
+
+QuantizedPredictor::QuantizedPredictor(
+    shared_ptr<Predictor> predictor, double c0, const vector<pair<double, vector<TreeNode>>>& trees) :
+    Predictor(predictor->variableCount()), predictor_(predictor), c0_(c0)
+{
+    initBinEdges_(trees);
+
+    for (const auto& [c, nodes] : trees) {
+        trees_.emplace_back(size(nodes_), c);
+        initNodes_(data(nodes));
+    }
+}
+
+// The bin edges of a variable are the distinct thresholds used with that variable.
+// The code of a value x is the number of bin edges <= x.
+// Hence x < binEdges[k] if and only if code < k + 1.
+// Missing values (NaN) get the largest code, so they go right. At nodes where they should go left, the codes are
+// incremented before the comparison; the largest code then wraps around to 0, while the other codes keep their order.
+
+void QuantizedPredictor::initBinEdges_(const vector<pair<double, vector<TreeNode>>>& trees)
+{
+    map<size_t, vector<float>> thresholds;
+    for (const auto& [c, nodes] : trees) {
+        for (const TreeNode& node : nodes) {
+            if (!node.isLeaf)
+                thresholds[node.j].push_back(node.x);
+        }
+    }
+
+    size_t maxBinEdgeCount = 0;
+    binEdgeOffsets_.push_back(0);
+    for (auto& [j, x] : thresholds) {
+        std::sort(begin(x), end(x));
+        x.erase(std::unique(begin(x), end(x)), end(x));
+        variables_.push_back(j);
+        binEdges_.insert(end(binEdges_), begin(x), end(x));
+        binEdgeOffsets_.push_back(size(binEdges_));
+        maxBinEdgeCount = std::max(maxBinEdgeCount, size(x));
+    }
+
+    // the largest code is reserved for missing values
+    if (maxBinEdgeCount >= numeric_limits<uint16_t>::max())
+        throw std::runtime_error("The predictor has too many distinct thresholds to be quantized.");
+    wideCodes_ = maxBinEdgeCount >= numeric_limits<uint8_t>::max();
+}
+
+void QuantizedPredictor::initNodes_(const TreeNode* node)
+{
+    const size_t k = size(nodes_);
+    nodes_.emplace_back();
+
+    if (node->isLeaf) {
+        nodes_[k] = {0, 0, 0, 0, node->y};
+        return;
+    }
+
+    const size_t j = std::lower_bound(begin(variables_), end(variables_), node->j) - begin(variables_);
+    const float* binEdgesBegin = data(binEdges_) + binEdgeOffsets_[j];
+    const float* binEdgesEnd = data(binEdges_) + binEdgeOffsets_[j + 1];
+    const size_t x = std::lower_bound(binEdgesBegin, binEdgesEnd, node->x) - binEdgesBegin + 1;
+
+    initNodes_(node->leftChild);
+    const size_t rightChild = size(nodes_) - k;
+    initNodes_(node->rightChild);
+
+    nodes_[k] = {
+        static_cast<uint32_t>(j), node->defaultLeft, static_cast<uint32_t>(x + node->defaultLeft),
+        static_cast<uint32_t>(rightChild), 0.0f};
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+ArrayXd QuantizedPredictor::predictImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t blockCount = divideRoundUp(sampleCount, blockSize_);
+    ArrayXd pred(sampleCount);
+    if (blockCount == 0)
+        return pred;
+
+    threadCount = std::min(threadCount, blockCount);
+    std::atomic<size_t> nextBlock = 0;
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        while (true) {
+            const size_t block = nextBlock++;
+            if (block >= blockCount)
+                break;
+            const size_t iBegin = block * blockSize_;
+            const size_t iEnd = std::min(iBegin + blockSize_, sampleCount);
+            if (wideCodes_)
+                predictBlock_<uint16_t>(inData, iBegin, iEnd, pred);
+            else
+                predictBlock_<uint8_t>(inData, iBegin, iEnd, pred);
+        }
+    }
+    END_OMP_PARALLEL
+
+    return pred;
+}
+
+template<typename Code>
+void QuantizedPredictor::predictBlock_(CRefXXfc inData, size_t iBegin, size_t iEnd, RefXd pred) const
+{
+    // the codes are stored sample by sample, so that the codes of each sample are contiguous
+
+    const size_t usedVariableCount = size(variables_);
+    static thread_local vector<Code> codes;
+    codes.resize((iEnd - iBegin) * usedVariableCount);
+
+    for (size_t i = iBegin; i != iEnd; ++i)
+        binSample_(inData.data() + i, inData.outerStride(), data(codes) + (i - iBegin) * usedVariableCount);
+
+    pred(Eigen::seqN(iBegin, iEnd - iBegin)) = c0_;
+    for (const auto& [root, c] : trees_) {
+        for (size_t i = iBegin; i != iEnd; ++i) {
+            const Code* sampleCodes = data(codes) + (i - iBegin) * usedVariableCount;
+            const Node_* node = data(nodes_) + root;
+            while (node->rightChild != 0)
+                node += (static_cast<Code>(sampleCodes[node->j] + node->defaultLeft) < node->x) ? 1 : node->rightChild;
+            pred(i) += c * node->y;
+        }
+    }
+
+    for (size_t i = iBegin; i != iEnd; ++i)
+        pred(i) = 1.0 / (1.0 + std::exp(-pred(i)));
+}
+
+template<typename Code>
+void QuantizedPredictor::binSample_(const float* x, ptrdiff_t s, Code* codes) const
+{
+    const size_t usedVariableCount = size(variables_);
+    for (size_t k = 0; k != usedVariableCount; ++k) {
+        const float* binEdgesBegin = data(binEdges_) + binEdgeOffsets_[k];
+        const float* binEdgesEnd = data(binEdges_) + binEdgeOffsets_[k + 1];
+        const float xk = x[variables_[k] * s];
+        codes[k] = std::isnan(xk) ? numeric_limits<Code>::max()
+                                  : static_cast<Code>(std::upper_bound(binEdgesBegin, binEdgesEnd, xk) - binEdgesBegin);
+    }
+}
+
+template<typename Code>
+double QuantizedPredictor::predictSample_(const Code* codes) const
+{
+    double pred = c0_;
+    for (const auto& [root, c] : trees_) {
+        const Node_* node = data(nodes_) + root;
+        while (node->rightChild != 0)
+            node += (static_cast<Code>(codes[node->j] + node->defaultLeft) < node->x) ? 1 : node->rightChild;
+        pred += c * node->y;
+    }
+    return 1.0 / (1.0 + std::exp(-pred));
+}
+
+void QuantizedPredictor::predictUncheckedImpl_(
+    const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const
+{
+    static thread_local vector<uint16_t> codes;
+    codes.resize(size(variables_));
+    for (size_t i = 0; i != sampleCount; ++i) {
+        binSample_(inData + static_cast<ptrdiff_t>(i) * rowStride, colStride, data(codes));
+        outData[i] = predictSample_(data(codes));
+    }
+}
+
+ArrayXf QuantizedPredictor::variableWeightsImpl_() const { return predictor_->variableWeightsImpl_(); }
+
+void QuantizedPredictor::usedVariablesImpl_(RefXu8 used) const { predictor_->usedVariablesImpl_(used); }
+
+shared_ptr<Predictor> QuantizedPredictor::reindexVariablesImpl_(CRefXs newIndices) const
+{
+    return predictor_->reindexVariablesImpl_(newIndices)->quantizeImpl_();
+}
+
+void QuantizedPredictor::saveImpl_(ostream& os) const { predictor_->saveImpl_(os); }
+
+size_t QuantizedPredictor::saveCodeImpl_(ostream& os, size_t* functionCount) const
+{
+    return predictor_->saveCodeImpl_(os, functionCount);
+}
+
+shared_ptr<Predictor> QuantizedPredictor::quantizeImpl_() const { return sharedFromThis_(); }
+
+shared_ptr<Predictor> QuantizedPredictor::flattenImpl_() const { return predictor_->flattenImpl_(); }
+
+ArrayXXdc QuantizedPredictor::shapValuesImpl_(CRefXXfc inData, size_t threadCount) const
+{
+    return predictor_->shapValuesImpl_(inData, threadCount);
+}
+
+ArrayXd QuantizedPredictor::permutationImportanceImpl_(
+    CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+    const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const
+{
+    return predictor_->permutationImportanceImpl_(inData, outData, lossFun, permutations, weights, threadCount);
+}
@@ -0,0 +1,71 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "Predictor.h"
+
+struct TreeNode;
+
+// Quantized version of a boost predictor.
+// The thresholds of each used variable serve as bin edges. The test data is binned block by block into
+// uint8 or uint16 codes, and the trees are then evaluated with integer comparisons on the compact code matrix.
+// The predictions are the same as those of the source predictor.
+// Everything except prediction is delegated to the source predictor.
+
+class QuantizedPredictor : public Predictor {   // immutable class
+public:
+    static shared_ptr<Predictor> createInstance(
+        shared_ptr<Predictor> predictor, double c0, const vector<pair<double, vector<TreeNode>>>& trees);
+
+private:
+    struct Node_ {
+        uint32_t j : 31;            // index into variables_, only used by interior nodes
+        uint32_t defaultLeft : 1;   // go left if the code plus defaultLeft is less than x, only used by interior nodes
+        uint32_t x;
+        uint32_t rightChild;   // offset to the right child, 0 for leaf nodes; the left child is the next node
+        float y;               // only used by leaf nodes
+    };
+
+    QuantizedPredictor(
+        shared_ptr<Predictor> predictor, double c0, const vector<pair<double, vector<TreeNode>>>& trees);
+    void initBinEdges_(const vector<pair<double, vector<TreeNode>>>& trees);
+    void initNodes_(const TreeNode* node);
+
+    virtual ~QuantizedPredictor() = default;
+    virtual ArrayXd predictImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual void predictUncheckedImpl_(
+        const float* inData, ptrdiff_t rowStride, ptrdiff_t colStride, size_t sampleCount, double* outData) const;
+    virtual ArrayXf variableWeightsImpl_() const;
+    virtual void usedVariablesImpl_(RefXu8 used) const;
+    virtual shared_ptr<Predictor> reindexVariablesImpl_(CRefXs newIndices) const;
+    virtual void saveImpl_(ostream& os) const;
+    virtual size_t saveCodeImpl_(ostream& os, size_t* functionCount) const;
+    virtual shared_ptr<Predictor> quantizeImpl_() const;
+    virtual shared_ptr<Predictor> flattenImpl_() const;
+    virtual ArrayXXdc shapValuesImpl_(CRefXXfc inData, size_t threadCount) const;
+    virtual ArrayXd permutationImportanceImpl_(
+        CRefXXfc inData, CRefXu8 outData, const function<double(CRefXu8, CRefXd, optional<CRefXd>)>& lossFun,
+        const vector<vector<size_t>>& permutations, optional<CRefXd> weights, size_t threadCount) const;
+
+    template<typename Code>
+    void predictBlock_(CRefXXfc inData, size_t iBegin, size_t iEnd, RefXd pred) const;
+    template<typename Code>
+    void binSample_(const float* x, ptrdiff_t s, Code* codes) const;
+    template<typename Code>
+    double predictSample_(const Code* codes) const;
+
+    shared_ptr<Predictor> predictor_;
+    double c0_;
+    vector<size_t> variables_;             // the variables used by the predictor, sorted
+    vector<float> binEdges_;               // the bin edges of all used variables, concatenated
+    vector<size_t> binEdgeOffsets_;        // offsets into binEdges_, one per used variable plus one
+    vector<Node_> nodes_;                  // the trees, each stored with the root first and in depth first order
+    vector<pair<size_t, double>> trees_;   // root index and multiplier of each tree
+    bool wideCodes_;                       // uint16 codes if true, uint8 codes if false
+
+    static const size_t blockSize_ = 256;
+
+    friend class MakeSharedHelper<QuantizedPredictor>;
+};
@@ -0,0 +1,202 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "OmpParallel.h"
+
+#include <cstring>
+
+
+// Stable LSD radix sort of indices with respect to 32-bit keys, with 8-bit digits.
+//
+// The histograms of all four digits are calculated in a single pass over the keys before the sorting,
+// and a digit is skipped if all keys have the same value of that digit
+// (e.g. the two high digits of keys of small integer valued floats of the same sign).
+// The keys and indices are stored together as items, so that each pass writes one stream per digit value;
+// each pass reads the items from one buffer and writes them to the other, and the last pass writes only the indices,
+// directly to the result.
+//
+// Floats are sorted by converting them to keys with radixSortKey().
+
+inline uint32_t radixSortKey(float x)
+{
+    // The order of the keys, as unsigned integers, is the order of the floats:
+    // negative floats have all bits flipped and non-negative floats have the sign bit flipped.
+    // -0.0 comes before +0.0, and NaN comes first or last depending on the sign bit.
+
+    uint32_t u;
+    std::memcpy(&u, &x, 4);
+    return u ^ ((0u - (u >> 31)) | 0x80000000u);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+template<typename Index>
+struct RadixSortItem {
+    uint32_t key;
+    Index index;
+};
+
+namespace RadixSortImpl_ {
+
+using Histograms = array<array<size_t, 256>, 4>;
+
+inline size_t digit(uint32_t key, size_t p) { return (key >> (8 * p)) & 0xff; }
+
+template<typename Index>
+void addToHistograms(const RadixSortItem<Index>* items, size_t n, Histograms* histograms)
+{
+    for (size_t i = 0; i != n; ++i) {
+        const uint32_t key = items[i].key;
+        ++(*histograms)[0][key & 0xff];
+        ++(*histograms)[1][(key >> 8) & 0xff];
+        ++(*histograms)[2][(key >> 16) & 0xff];
+        ++(*histograms)[3][key >> 24];
+    }
+}
+
+// returns the digits that need to be sorted, i.e. the digits that do not have the same value for all n keys
+inline vector<size_t> usedDigits(const Histograms& histograms, size_t n)
+{
+    vector<size_t> digits;
+    for (size_t p = 0; p != 4; ++p) {
+        if (*std::max_element(begin(histograms[p]), end(histograms[p])) != n)
+            digits.push_back(p);
+    }
+    return digits;
+}
+
+}   // namespace RadixSortImpl_
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// Writes the indices of the items items[0], ..., items[n - 1], sorted with respect to the keys, to result.
+// items is overwritten, buffer must have room for n items, and result must not overlap items or buffer.
+
+template<typename Index>
+void radixSort(size_t n, RadixSortItem<Index>* items, RadixSortItem<Index>* buffer, Index* result)
+{
+    using namespace RadixSortImpl_;
+
+    Histograms histograms{};
+    addToHistograms(items, n, &histograms);
+    const vector<size_t> digits = usedDigits(histograms, n);
+
+    if (digits.empty()) {
+        for (size_t i = 0; i != n; ++i)
+            result[i] = items[i].index;
+        return;
+    }
+
+    for (size_t p : digits) {
+
+        array<size_t, 256> offsets;
+        std::exclusive_scan(begin(histograms[p]), end(histograms[p]), begin(offsets), size_t{0});
+
+        if (p == digits.back()) {
+            for (size_t i = 0; i != n; ++i)
+                result[offsets[digit(items[i].key, p)]++] = items[i].index;
+        }
+        else {
+            for (size_t i = 0; i != n; ++i) {
+                const RadixSortItem<Index> item = items[i];
+                buffer[offsets[digit(item.key, p)]++] = item;
+            }
+            std::swap(items, buffer);
+        }
+    }
+}
+
+
+// Same as radixSort(), but with threadCount threads.
+// The items are divided into one chunk per thread. In each pass the threads first calculate the histogram of the digit
+// for their chunks, and then each thread moves the items of its chunk to positions that come after those of the same
+// digit value from the preceding chunks, so the sort is still stable.
+
+template<typename Index>
+void parallelRadixSort(
+    size_t n, RadixSortItem<Index>* items, RadixSortItem<Index>* buffer, Index* result, size_t threadCount)
+{
+    using namespace RadixSortImpl_;
+
+    vector<Histograms> chunkHistograms(threadCount);
+
+    BEGIN_OMP_PARALLEL(threadCount)
+    {
+        const size_t threadId = omp_get_thread_num();
+        const size_t iStart = n * threadId / threadCount;
+        const size_t iStop = n * (threadId + 1) / threadCount;
+        Histograms histograms{};
+        addToHistograms(items + iStart, iStop - iStart, &histograms);
+        chunkHistograms[threadId] = histograms;
+    }
+    END_OMP_PARALLEL
+
+    Histograms histograms{};
+    for (const Histograms& h : chunkHistograms) {
+        for (size_t p = 0; p != 4; ++p)
+            std::transform(begin(h[p]), end(h[p]), begin(histograms[p]), begin(histograms[p]), std::plus<size_t>());
+    }
+    const vector<size_t> digits = usedDigits(histograms, n);
+
+    if (digits.empty()) {
+        for (size_t i = 0; i != n; ++i)
+            result[i] = items[i].index;
+        return;
+    }
+
+    vector<array<size_t, 256>> chunkOffsets(threadCount);
+
+    for (size_t p : digits) {
+
+        // the chunk histograms of the first digit were calculated above; the other digits need new chunk histograms,
+        // since the previous pass has moved the items between the chunks
+
+        if (p != digits.front()) {
+            BEGIN_OMP_PARALLEL(threadCount)
+            {
+                const size_t threadId = omp_get_thread_num();
+                const size_t iStart = n * threadId / threadCount;
+                const size_t iStop = n * (threadId + 1) / threadCount;
+                array<size_t, 256> histogram{};
+                for (size_t i = iStart; i != iStop; ++i)
+                    ++histogram[digit(items[i].key, p)];
+                chunkHistograms[threadId][p] = histogram;
+            }
+            END_OMP_PARALLEL
+        }
+
+        size_t offset = 0;
+        for (size_t b = 0; b != 256; ++b) {
+            for (size_t t = 0; t != threadCount; ++t) {
+                chunkOffsets[t][b] = offset;
+                offset += chunkHistograms[t][p][b];
+            }
+        }
+
+        const bool lastPass = (p == digits.back());
+
+        BEGIN_OMP_PARALLEL(threadCount)
+        {
+            const size_t threadId = omp_get_thread_num();
+            const size_t iStart = n * threadId / threadCount;
+            const size_t iStop = n * (threadId + 1) / threadCount;
+            array<size_t, 256> offsets = chunkOffsets[threadId];
+            if (lastPass) {
+                for (size_t i = iStart; i != iStop; ++i)
+                    result[offsets[digit(items[i].key, p)]++] = items[i].index;
+            }
+            else {
+                for (size_t i = iStart; i != iStop; ++i) {
+                    const RadixSortItem<Index> item = items[i];
+                    buffer[offsets[digit(item.key, p)]++] = item;
+                }
+            }
+        }
+        END_OMP_PARALLEL
+
+        std::swap(items, buffer);
+    }
+}
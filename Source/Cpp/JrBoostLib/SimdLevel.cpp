@@ -0,0 +1,105 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "SimdLevel.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+
+namespace {
+
+// returns the registers eax, ebx, ecx and edx of the CPUID instruction
+
+array<uint32_t, 4> cpuid_(uint32_t leaf, uint32_t subleaf)
+{
+    array<uint32_t, 4> r;
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (size_t k = 0; k != 4; ++k)
+        r[k] = static_cast<uint32_t>(regs[k]);
+#else
+    __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+    return r;
+}
+
+// returns the extended control register XCR0, which tells which register states the operating system saves
+// on context switches
+
+uint64_t xgetbv_()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+bool hasBit_(uint64_t bits, int k) { return ((bits >> k) & 1) != 0; }
+
+
+SimdLevel detectSimdLevel_()
+{
+    const uint32_t maxLeaf = cpuid_(0, 0)[0];
+    if (maxLeaf < 7)
+        return SimdLevel::Scalar;
+
+    const array<uint32_t, 4> leaf1 = cpuid_(1, 0);
+    const array<uint32_t, 4> leaf7 = cpuid_(7, 0);
+
+    const bool fma = hasBit_(leaf1[2], 12);
+    const bool osxsave = hasBit_(leaf1[2], 27);
+    const bool avx = hasBit_(leaf1[2], 28);
+    const bool avx2 = hasBit_(leaf7[1], 5);
+    const bool avx512f = hasBit_(leaf7[1], 16);
+    const bool avx512dq = hasBit_(leaf7[1], 17);
+    const bool avx512bw = hasBit_(leaf7[1], 30);
+
+    // XGETBV may only be executed if OSXSAVE is set
+    if (!(osxsave && avx && avx2 && fma))
+        return SimdLevel::Scalar;
+
+    // the operating system must save the SSE and AVX registers (XCR0 bits 1 and 2)
+    // and for AVX-512 also the opmask and ZMM registers (XCR0 bits 5, 6 and 7)
+    const uint64_t xcr0 = xgetbv_();
+    if ((xcr0 & 0x06) != 0x06)
+        return SimdLevel::Scalar;
+    if (!(avx512f && avx512dq && avx512bw) || (xcr0 & 0xe0) != 0xe0)
+        return SimdLevel::AVX2;
+    return SimdLevel::AVX512;
+}
+
+std::atomic<SimdLevel>& currentSimdLevel_()
+{
+    static std::atomic<SimdLevel> level = maxSimdLevel();
+    return level;
+}
+
+}   // namespace
+
+//----------------------------------------------------------------------------------------------------------------------
+
+SimdLevel maxSimdLevel()
+{
+    static const SimdLevel level = detectSimdLevel_();
+    return level;
+}
+
+SimdLevel simdLevel() { return currentSimdLevel_(); }
+
+void setSimdLevel(SimdLevel level)
+{
+    if (level > maxSimdLevel())
+        throw std::invalid_argument("The SIMD level is not supported by this processor.");
+    currentSimdLevel_() = level;
+}
@@ -0,0 +1,44 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+
+// Runtime selection of the SIMD code paths.
+//
+// The manually vectorized functions (the fast exp loop of Ada boost in BoostTrainer and processBlock_() in
+// TopScoringPairs) have one version for each SIMD level, and the version is selected at runtime.
+// Hence a binary built for the baseline x86-64 instruction set runs on any processor, and still uses AVX2 or
+// AVX-512 where available. (Code that the compiler vectorizes uses the instruction set of the build.)
+// The SIMD versions use unaligned loads and stores, since the arrays are only aligned as required by the
+// instruction set of the build.
+//
+//     Scalar:  no SIMD code beyond the instruction set of the build
+//     AVX2:    AVX2 + FMA
+//     AVX512:  AVX-512F + AVX-512BW + AVX-512DQ (in addition to AVX2 + FMA)
+
+enum class SimdLevel { Scalar, AVX2, AVX512 };
+
+// the highest level supported by the processor and the operating system (detected with CPUID and XGETBV)
+SimdLevel maxSimdLevel();
+
+// the level used; initially maxSimdLevel()
+SimdLevel simdLevel();
+
+// overrides the level used, for instance for testing or benchmarking;
+// throws std::invalid_argument if the level exceeds maxSimdLevel()
+void setSimdLevel(SimdLevel level);
+
+
+// The functions of a SIMD level are marked with these macros. They let GCC and Clang use the intrinsics of the
+// instruction sets of the level regardless of the compiler options.
+// Visual C++ allows intrinsics of any instruction set in any function.
+
+#if defined(__GNUC__)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx2,fma,avx512f,avx512bw,avx512dq")))
+#else
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#endif
@@ -166,6 +166,21 @@ inline void parseError [[noreturn]] (istream& is)
 
 //----------------------------------------------------------------------------------------------------------------------
 
+// Several indata blocks with the same samples can be treated as one matrix, with the variables of the first block first,
+// then the variables of the second block, and so on. Returns a pointer to the values of each variable.
+
+inline vector<const float*> inDataColumns(const vector<CRefXXfc>& inDataBlocks)
+{
+    vector<const float*> columns;
+    for (const auto& block : inDataBlocks) {
+        for (Eigen::Index j = 0; j != block.cols(); ++j)
+            columns.push_back(std::data(block.col(j)));
+    }
+    return columns;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
 // Fills the range that starts at q0 with a permutation
 // i0, ..., i{n-1} of 0, 1, ...., n-1 such that
 // f(p0[i0]) <= f(p0[i1]) <= ... <= f(p0[i{n-1}]).
@@ -32,6 +32,13 @@ float maxNodeGain(const TreeNode* node)
     return std::max({node->gain, maxNodeGain(node->leftChild), maxNodeGain(node->rightChild)});
 }
 
+float maxAbsLeafY(const TreeNode* node)
+{
+    if (node->isLeaf)
+        return std::abs(node->y);
+    return std::max(maxAbsLeafY(node->leftChild), maxAbsLeafY(node->rightChild));
+}
+
 
 void pruneTree(TreeNode* node, float minNodeGain)
 {
@@ -117,18 +124,31 @@ void predict(const TreeNode* root, CRefXXfc inData, double c, RefXd outData)
     for (size_t i = 0; i != sampleCount; ++i) {
         const TreeNode* node = root;
         while (!node->isLeaf)
-            node = (inData(i, node->j) < node->x) ? node->leftChild : node->rightChild;
+            node = goesLeft(node, inData(i, node->j)) ? node->leftChild : node->rightChild;
         outData(i) += c * node->y;
     }
 }
 
-double predictOne(const TreeNode* node, CRefXf inData)
+double predictOne(const TreeNode* node, const float* inData, ptrdiff_t stride)
 {
     while (!node->isLeaf)
-        node = (inData(node->j) < node->x) ? node->leftChild : node->rightChild;
+        node = goesLeft(node, inData[node->j * stride]) ? node->leftChild : node->rightChild;
     return node->y;
 }
 
+void predictPermuted(const TreeNode* root, CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData)
+{
+    const size_t sampleCount = inData.rows();
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const TreeNode* node = root;
+        while (!node->isLeaf) {
+            const float x = (node->j == j) ? permutedColumn(i) : inData(i, node->j);
+            node = goesLeft(node, x) ? node->leftChild : node->rightChild;
+        }
+        outData(i) += c * node->y;
+    }
+}
+
 size_t variableCount(const TreeNode* node)
 {
     if (node->isLeaf)
@@ -145,16 +165,180 @@ void variableWeights(const TreeNode* node, double c, RefXd weights)
     variableWeights(node->rightChild, c, weights);
 }
 
+void usedVariables(const TreeNode* node, RefXu8 used)
+{
+    if (node->isLeaf)
+        return;
+    used(node->j) = 1;
+    usedVariables(node->leftChild, used);
+    usedVariables(node->rightChild, used);
+}
+
+//......................................................................................................................
+
+// Path-dependent TreeSHAP, Algorithm 2 in S. M. Lundberg, G. G. Erion and S.-I. Lee,
+// Consistent Individualized Feature Attribution for Tree Ensembles, arXiv:1802.03888.
+// The train sample counts of the nodes are used to weight the branches not taken by the sample.
+// The run time is proportional to the number of leaves times the square of the tree depth.
+
+struct PathElement_ {
+    size_t j;              // the variable, or -1 for the dummy element at the start of the path
+    double zeroFraction;   // fraction of the train samples that follow the path at the splits on variable j
+    double oneFraction;    // 1 if the sample follows the path at the splits on variable j, 0 otherwise
+    double pathWeight;
+};
+
+void extendPath_(PathElement_* path, size_t pathLength, double zeroFraction, double oneFraction, size_t j)
+{
+    path[pathLength] = {j, zeroFraction, oneFraction, pathLength == 0 ? 1.0 : 0.0};
+    for (size_t i = pathLength; i != 0; --i) {
+        path[i].pathWeight += oneFraction * path[i - 1].pathWeight * i / (pathLength + 1.0);
+        path[i - 1].pathWeight = zeroFraction * path[i - 1].pathWeight * (pathLength + 1 - i) / (pathLength + 1.0);
+    }
+}
+
+void unwindPath_(PathElement_* path, size_t pathLength, size_t k)
+{
+    const double oneFraction = path[k].oneFraction;
+    const double zeroFraction = path[k].zeroFraction;
+    double nextOnePortion = path[pathLength].pathWeight;
+
+    for (size_t i = pathLength; i != 0; --i) {
+        if (oneFraction != 0.0) {
+            const double tmp = path[i - 1].pathWeight;
+            path[i - 1].pathWeight = nextOnePortion * (pathLength + 1.0) / (i * oneFraction);
+            nextOnePortion = tmp - path[i - 1].pathWeight * zeroFraction * (pathLength + 1 - i) / (pathLength + 1.0);
+        }
+        else
+            path[i - 1].pathWeight = path[i - 1].pathWeight * (pathLength + 1.0) / (zeroFraction * (pathLength + 1 - i));
+    }
+
+    for (size_t i = k; i != pathLength; ++i) {
+        path[i].j = path[i + 1].j;
+        path[i].zeroFraction = path[i + 1].zeroFraction;
+        path[i].oneFraction = path[i + 1].oneFraction;
+    }
+}
+
+// the total weight of the path with element k removed, without modifying the path
+double unwoundPathSum_(const PathElement_* path, size_t pathLength, size_t k)
+{
+    const double oneFraction = path[k].oneFraction;
+    const double zeroFraction = path[k].zeroFraction;
+    double nextOnePortion = path[pathLength].pathWeight;
+    double total = 0.0;
+
+    for (size_t i = pathLength; i != 0; --i) {
+        if (oneFraction != 0.0) {
+            const double tmp = nextOnePortion * (pathLength + 1.0) / (i * oneFraction);
+            total += tmp;
+            nextOnePortion = path[i - 1].pathWeight - tmp * zeroFraction * (pathLength + 1 - i) / (pathLength + 1.0);
+        }
+        else if (zeroFraction != 0.0)
+            total += path[i - 1].pathWeight * (pathLength + 1.0) / (zeroFraction * (pathLength + 1 - i));
+    }
+    return total;
+}
+
+// parentPath[0, ..., pathLength - 1] is the path of the parent node;
+// the path of this node is stored after it, so that the parent path is left intact for the sibling
+void shapValuesImpl_(
+    const TreeNode* node, const float* inData, ptrdiff_t stride, double c, double* shapValues,
+    PathElement_* parentPath, size_t pathLength, double zeroFraction, double oneFraction, size_t j)
+{
+    PathElement_* path = parentPath + pathLength;
+    std::copy(parentPath, parentPath + pathLength, path);
+    extendPath_(path, pathLength, zeroFraction, oneFraction, j);
+
+    if (node->isLeaf) {
+        for (size_t i = 1; i <= pathLength; ++i) {
+            const double w = unwoundPathSum_(path, pathLength, i);
+            shapValues[path[i].j] += c * w * (path[i].oneFraction - path[i].zeroFraction) * node->y;
+        }
+        return;
+    }
+
+    const TreeNode* hotChild;
+    const TreeNode* coldChild;
+    if (goesLeft(node, inData[node->j * stride])) {
+        hotChild = node->leftChild;
+        coldChild = node->rightChild;
+    }
+    else {
+        hotChild = node->rightChild;
+        coldChild = node->leftChild;
+    }
+    const double hotZeroFraction
+        = static_cast<double>(hotChild->trainSampleCount) / static_cast<double>(node->trainSampleCount);
+    const double coldZeroFraction
+        = static_cast<double>(coldChild->trainSampleCount) / static_cast<double>(node->trainSampleCount);
+
+    // if the variable has already been split on along the path, undo that split
+    double incomingZeroFraction = 1.0;
+    double incomingOneFraction = 1.0;
+    size_t k = 1;
+    while (k <= pathLength && path[k].j != node->j)
+        ++k;
+    if (k <= pathLength) {
+        incomingZeroFraction = path[k].zeroFraction;
+        incomingOneFraction = path[k].oneFraction;
+        unwindPath_(path, pathLength, k);
+        --pathLength;
+    }
+
+    shapValuesImpl_(
+        hotChild, inData, stride, c, shapValues, path, pathLength + 1, hotZeroFraction * incomingZeroFraction,
+        incomingOneFraction, node->j);
+    shapValuesImpl_(
+        coldChild, inData, stride, c, shapValues, path, pathLength + 1, coldZeroFraction * incomingZeroFraction, 0.0,
+        node->j);
+}
+
+double expectedValue_(const TreeNode* node)
+{
+    if (node->isLeaf)
+        return node->y;
+    const double n = static_cast<double>(node->trainSampleCount);
+    const double nLeft = static_cast<double>(node->leftChild->trainSampleCount);
+    const double nRight = static_cast<double>(node->rightChild->trainSampleCount);
+    return (nLeft * expectedValue_(node->leftChild) + nRight * expectedValue_(node->rightChild)) / n;
+}
+
+double shapValues(const TreeNode* root, const float* inData, ptrdiff_t stride, double c, double* shapValues)
+{
+    if (root->trainSampleCount == 0)
+        throw std::runtime_error(
+            "SHAP values need the train sample counts of the tree nodes, which are missing in predictors saved by "
+            "older versions of JrBoost.");
+
+    // the path of a node at depth d has length d + 1 (including the dummy element) and is stored after
+    // the paths of its ancestors; the paths only grow by one element per level
+    const size_t depth = treeDepth(root);
+    static thread_local vector<PathElement_> pathBuffer;
+    pathBuffer.resize((depth + 2) * (depth + 3) / 2);
+
+    shapValuesImpl_(root, inData, stride, c, shapValues, data(pathBuffer), 0, 1.0, 1.0, static_cast<size_t>(-1));
+    return expectedValue_(root);
+}
+
 //......................................................................................................................
 
 void saveTreeImpl_(const TreeNode* node, ostream& os)
 {
-    os.put(static_cast<char>(node->isLeaf));
+    // 0 = interior node with missing values going right, 1 = leaf, 2 = interior node with missing values going left,
+    // 3 and 4 = the same as 0 and 2, but with a categorical split
+    const bool isCategorical = !node->isLeaf && node->leftCategories != 0;
+    const int nodeType = node->isLeaf ? 1 : isCategorical ? (node->defaultLeft ? 4 : 3) : (node->defaultLeft ? 2 : 0);
+    os.put(static_cast<char>(nodeType));
+    base128Save(os, node->trainSampleCount);
     if (node->isLeaf)
         os.write(reinterpret_cast<const char*>(&node->y), sizeof(node->y));
     else {
         base128Save(os, node->j);
-        os.write(reinterpret_cast<const char*>(&node->x), sizeof(node->x));
+        if (isCategorical)
+            os.write(reinterpret_cast<const char*>(&node->leftCategories), sizeof(node->leftCategories));
+        else
+            os.write(reinterpret_cast<const char*>(&node->x), sizeof(node->x));
         os.write(reinterpret_cast<const char*>(&node->gain), sizeof(node->gain));
         saveTreeImpl_(node->leftChild, os);
         saveTreeImpl_(node->rightChild, os);
@@ -171,10 +355,14 @@ void saveTree(const TreeNode* root, ostream& os)
 
 TreeNode* loadTreeImpl_(TreeNode* node, istream& is, int version)
 {
-    const int isLeaf = is.get();
-    if (isLeaf != 0 && isLeaf != 1)
+    const int nodeType = is.get();
+    if (nodeType < 0 || nodeType > 4 || (nodeType == 2 && version < 12) || (nodeType >= 3 && version < 13))
         parseError(is);
-    node->isLeaf = static_cast<bool>(isLeaf);
+    const bool isCategorical = (nodeType >= 3);
+    node->isLeaf = (nodeType == 1);
+    node->defaultLeft = (nodeType == 2 || nodeType == 4);
+    node->leftCategories = 0;
+    node->trainSampleCount = (version >= 11) ? base128Load(is) : 0;
 
     if (node->isLeaf) {
         is.read(reinterpret_cast<char*>(&node->y), sizeof(node->y));
@@ -190,7 +378,14 @@ TreeNode* loadTreeImpl_(TreeNode* node, istream& is, int version)
             node->j = static_cast<uint64_t>(j32);
         }
 
-        is.read(reinterpret_cast<char*>(&node->x), sizeof(node->x));
+        if (isCategorical) {
+            node->x = numeric_limits<float>::quiet_NaN();
+            is.read(reinterpret_cast<char*>(&node->leftCategories), sizeof(node->leftCategories));
+            if (node->leftCategories == 0)
+                parseError(is);
+        }
+        else
+            is.read(reinterpret_cast<char*>(&node->x), sizeof(node->x));
 
         if (version >= 3 && version < 5)
             is.read(reinterpret_cast<char*>(&node->gain), sizeof(node->gain));
@@ -222,4 +417,31 @@ vector<TreeNode> loadTree(istream& is, int version)
     return nodes;
 }
 
+//......................................................................................................................
+
+void saveTreeCode(const TreeNode* node, ostream& os, double c, size_t indentation)
+{
+    const string indent(4 * indentation, ' ');
+    if (node->isLeaf)
+        os << indent << "pred += " << c * node->y << ";\n";
+    else {
+        if (node->leftCategories != 0) {
+            const string xj = "x[" + std::to_string(node->j) + " * s]";
+            os << indent << "if (" << (node->defaultLeft ? "isnan(" + xj + ") || " : "") << "(" << xj << " >= 0.0f && "
+               << xj << " < " << maxCategoryCount << ".0f && (0x" << std::hex << node->leftCategories << std::dec
+               << "ull >> (unsigned)" << xj << " & 1))) {\n";
+        }
+        else {
+            // isnan() is used explicitly, as in numericalGoesLeft()
+            const string xj = "x[" + std::to_string(node->j) + " * s]";
+            os << indent << "if (" << (node->defaultLeft ? "isnan(" + xj + ") || " : "!isnan(" + xj + ") && ") << xj
+               << " < " << node->x << "f) {\n";
+        }
+        saveTreeCode(node->leftChild, os, c, indentation + 1);
+        os << indent << "}\n" << indent << "else {\n";
+        saveTreeCode(node->rightChild, os, c, indentation + 1);
+        os << indent << "}\n";
+    }
+}
+
 }   // namespace TreeTools
@@ -6,21 +6,37 @@
 
 
 struct TreeNode {
-    // true for leaf nodes, false for interior nodes
-    bool isLeaf;
+    // the members are ordered by size, so that there is no padding between them
 
-    // only used by leaf nodes
-    // however, pruning can turn interior nodes into leaf nodes, so y should be set for interior nodes as well
-    float y;
+    // number of train samples that reached the node, 0 if unknown (predictors saved by old versions)
+    // only used for SHAP values
+    size_t trainSampleCount;
 
     // only used by interior nodes
+    // the samples with x[j] < x go to the left child and the other samples to the right child,
+    // except that the samples with x[j] missing (NaN) go to the left child if defaultLeft is true
+    // for categorical splits (leftCategories != 0) x is not used; the samples with x[j] = k go to the left child
+    // if bit k of leftCategories is set, and the samples with x[j] out of range always go to the right child
     size_t j;
-    float x;
-    float gain;
+    uint64_t leftCategories;
     TreeNode* leftChild;
     TreeNode* rightChild;
+    float x;
+    float gain;
+
+    // only used by leaf nodes
+    // however, pruning can turn interior nodes into leaf nodes, so y should be set for interior nodes as well
+    float y;
+
+    // true for leaf nodes, false for interior nodes
+    bool isLeaf;
+
+    // only used by interior nodes, see above
+    bool defaultLeft;
 };
 
+static_assert(sizeof(TreeNode) == 56);   // 64-bit platforms
+
 
 struct TreeNodeData {
     size_t sampleCount;
@@ -38,6 +54,7 @@ namespace TreeTools {
 size_t nodeCount(const TreeNode* node);
 size_t treeDepth(const TreeNode* node);
 float maxNodeGain(const TreeNode* node);
+float maxAbsLeafY(const TreeNode* node);
 
 void pruneTree(TreeNode* node, float minNodeGain);
 // first node in the returned vectors is the root
@@ -45,12 +62,47 @@ vector<TreeNode> cloneTreeDepthFirst(const TreeNode* node);
 vector<TreeNode> cloneTreeBreadthFirst(const TreeNode* node);
 vector<TreeNode> reindexTree(const TreeNode* node, CRefXs newIndices);
 
+// categorical variables have values 0, 1, ..., maxCategoryCount - 1 (non-integer values are truncated)
+inline constexpr size_t maxCategoryCount = 64;
+
+// missing values are tested with std::isnan() rather than through the comparisons of NaN,
+// since the comparisons of NaN are not reliable with /fp:fast (see JrBoost.props)
+
+inline bool numericalGoesLeft(float splitX, bool defaultLeft, float x)
+{
+    if (std::isnan(x))
+        return defaultLeft;
+    return x < splitX;
+}
+
+inline bool categoryGoesLeft(uint64_t leftCategories, bool defaultLeft, float x)
+{
+    if (std::isnan(x))
+        return defaultLeft;
+    if (x >= 0.0f && x < static_cast<float>(maxCategoryCount))
+        return (leftCategories >> static_cast<uint32_t>(x)) & 1;
+    return false;
+}
+
+inline bool goesLeft(const TreeNode* node, float x)
+{
+    if (node->leftCategories != 0)
+        return categoryGoesLeft(node->leftCategories, node->defaultLeft, x);
+    return numericalGoesLeft(node->x, node->defaultLeft, x);
+}
+
 void predict(const TreeNode* node, CRefXXfc inData, double c, RefXd outData);
-double predictOne(const TreeNode* node, CRefXf inData);
+double predictOne(const TreeNode* node, const float* inData, ptrdiff_t stride);   // inData[j * stride] is variable j
+// same as predict(), but variable j is read from permutedColumn instead of from inData
+void predictPermuted(const TreeNode* node, CRefXXfc inData, size_t j, CRefXf permutedColumn, double c, RefXd outData);
 size_t variableCount(const TreeNode* node);
 void variableWeights(const TreeNode* node, double c, RefXd weights);
+void usedVariables(const TreeNode* node, RefXu8 used);
+// adds the SHAP values of the sample, multiplied by c, to shapValues and returns the expected value of the tree
+double shapValues(const TreeNode* root, const float* inData, ptrdiff_t stride, double c, double* shapValues);
 
 void saveTree(const TreeNode* node, ostream& os);
 vector<TreeNode> loadTree(istream& is, int version);   // first node in the returned vector is the root
+void saveTreeCode(const TreeNode* node, ostream& os, double c, size_t indentation);
 
 }   // namespace TreeTools
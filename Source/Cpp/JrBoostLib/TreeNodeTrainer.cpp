@@ -6,97 +6,64 @@
 
 #include "TreeNodeTrainer.h"
 
-#include "BaseOptions.h"
-#include "TreeTrainerBuffers.h"
-
 
 template<typename SampleIndex>
 void TreeNodeTrainer<SampleIndex>::init(const TreeNodeExt& node, const BaseOptions& options)
 {
-    sampleCount_ = node.sampleCount;
-    sumW_ = node.sumW;
-    sumWY_ = node.sumWY;
-    minNodeWeight_ = std::max(options.minNodeWeight(), 1e-6 * sumW_);
-    minNodeSize_ = options.minNodeSize();
-
-    splitFound_ = false;
-    score_ = square(sumWY_) / sumW_ + options.minNodeGain();
-
-    iterationCount_ = 0;
-    slowBranchCount_ = 0;
+    this->nodeSums_.init(node.sumW, node.sumWY);
+    this->init_(node, options);
 }
 
 
-// finds the best split of a node for variable j
-
 template<typename SampleIndex>
 void TreeNodeTrainer<SampleIndex>::update(
-    CRefXXfc inData,
+    const float* pInDataColJ,
     CRefXd outData,
     CRefXd weights,
     const SampleIndex* pSortedSamplesBegin,
     const SampleIndex* pSortedSamplesEnd,
     size_t j)
 {
-    // the samples in the range [pSortedSamplesBegin, pSortedSamplesEnd) should be sorted according to inData.col(j)
-
-    ASSERT(static_cast<size_t>(pSortedSamplesEnd - pSortedSamplesBegin) == sampleCount_);
-
-    if (sumW_ == 0)
-        return;
-
-    const float* pInDataColJ = std::data(inData.col(j));
-
-    const double* pOutData = std::data(outData);
-    const double* pWeights = std::data(weights);
-
-    double leftSumW = 0.0;
-    double leftSumWY = 0.0;
-
-    const SampleIndex* p = pSortedSamplesBegin;
-    size_t nextI = *p;
-    while (p != pSortedSamplesEnd - 1) {
-
-        // this is where most execution time is spent ..........................
-
-        const size_t i = nextI;
-        nextI = *++p;
-
-        const double w = pWeights[i];
-        const double y = pOutData[i];
-        leftSumW += w;
-        leftSumWY += w * y;
-        const double rightSumW = sumW_ - leftSumW;
-        const double rightSumWY = sumWY_ - leftSumWY;
-
-        const double score = square(leftSumWY) / leftSumW + square(rightSumWY) / rightSumW;
-
-        if (score <= score_)
-            continue;   // usually true .......................
-
-        ++slowBranchCount_;
-
-        if (p < pSortedSamplesBegin + minNodeSize_ || p > pSortedSamplesEnd - minNodeSize_ || leftSumW < minNodeWeight_
-            || rightSumW < minNodeWeight_)
-            continue;
+    this->updateImpl_(
+        pInDataColJ, DoubleSampleData_{std::data(outData), std::data(weights)}, pSortedSamplesBegin,
+        pSortedSamplesEnd, j);
+}
 
-        const float leftX = pInDataColJ[i];
-        const float rightX = pInDataColJ[nextI];   // leftX <= rightX
-        const float midX = (leftX + rightX) / 2;
+template<typename SampleIndex>
+void TreeNodeTrainer<SampleIndex>::update(
+    const float* pInDataColJ,
+    const WyPack* pWyPacks,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pSortedSamplesEnd,
+    size_t j)
+{
+    this->updateImpl_(pInDataColJ, FloatSampleData_{pWyPacks}, pSortedSamplesBegin, pSortedSamplesEnd, j);
+}
 
-        if (leftX == midX)
-            continue;
 
-        splitFound_ = true;
-        score_ = score;
-        j_ = j;
-        x_ = midX;
-        leftSampleCount_ = p - pSortedSamplesBegin;
-        leftSumW_ = leftSumW;
-        leftSumWY_ = leftSumWY;
-    }
+template<typename SampleIndex>
+void TreeNodeTrainer<SampleIndex>::updateCategorical(
+    const float* pInDataColJ,
+    CRefXd outData,
+    CRefXd weights,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pSortedSamplesEnd,
+    size_t j)
+{
+    this->updateCategoricalImpl_(
+        pInDataColJ, DoubleSampleData_{std::data(outData), std::data(weights)}, pSortedSamplesBegin,
+        pSortedSamplesEnd, j);
+}
 
-    iterationCount_ += sampleCount_;
+template<typename SampleIndex>
+void TreeNodeTrainer<SampleIndex>::updateCategorical(
+    const float* pInDataColJ,
+    const WyPack* pWyPacks,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pSortedSamplesEnd,
+    size_t j)
+{
+    this->updateCategoricalImpl_(pInDataColJ, FloatSampleData_{pWyPacks}, pSortedSamplesBegin, pSortedSamplesEnd, j);
 }
 
 
@@ -106,87 +73,26 @@ void TreeNodeTrainer<SampleIndex>::update(
 template<typename SampleIndex>
 size_t TreeNodeTrainer<SampleIndex>::finalize(TreeNodeExt** ppParentNode, TreeNodeExt** ppChildNode) const
 {
-    PROFILE::UPDATE_BRANCH_STATISTICS(iterationCount_, slowBranchCount_);
-
-    TreeNodeExt* pParentNode = *ppParentNode;
-    ++*ppParentNode;
-
-    if (!splitFound_)
+    TreeNodeExt* leftChildNode = this->finalize_(ppParentNode, ppChildNode);
+    if (leftChildNode == nullptr)
         return 0;
 
-    pParentNode->isLeaf = false;
-    pParentNode->j = j_;
-    pParentNode->x = x_;
-    pParentNode->gain = static_cast<float>(score_ - square(sumWY_) / sumW_);
-
-    TreeNodeExt* leftChildNode = *ppChildNode;
-    ++*ppChildNode;
-    pParentNode->leftChild = leftChildNode;
-
-    leftChildNode->isLeaf = true;
-    leftChildNode->y = static_cast<float>(leftSumWY_ / leftSumW_);
-    leftChildNode->sampleCount = leftSampleCount_;
-    leftChildNode->sumW = leftSumW_;
-    leftChildNode->sumWY = leftSumWY_;
+    const ScalarNodeSums::Sum node = this->nodeSums_.node();
+    const ScalarNodeSums::Sum left = this->nodeSums_.bestLeft();
 
-    TreeNodeExt* rightChildNode = *ppChildNode;
-    ++*ppChildNode;
-    pParentNode->rightChild = rightChildNode;
+    leftChildNode->y = static_cast<float>(left.wy / left.w);
+    leftChildNode->sumW = left.w;
+    leftChildNode->sumWY = left.wy;
 
-    size_t rightSampleCount = sampleCount_ - leftSampleCount_;
-    double rightSumW = sumW_ - leftSumW_;
-    double rightSumWY = sumWY_ - leftSumWY_;
+    const double rightSumW = node.w - left.w;
+    const double rightSumWY = node.wy - left.wy;
 
-    rightChildNode->isLeaf = true;
+    TreeNodeExt* rightChildNode = leftChildNode + 1;
     rightChildNode->y = static_cast<float>(rightSumWY / rightSumW);
-    rightChildNode->sampleCount = rightSampleCount;
     rightChildNode->sumW = rightSumW;
     rightChildNode->sumWY = rightSumWY;
 
-    return sampleCount_;
-}
-
-//......................................................................................................................
-
-template<typename SampleIndex>
-void TreeNodeTrainer<SampleIndex>::fork(TreeNodeTrainer* other) const
-{
-    ASSERT(!splitFound_);
-
-    other->sampleCount_ = sampleCount_;
-    other->sumW_ = sumW_;
-    other->sumWY_ = sumWY_;
-    other->minNodeWeight_ = minNodeWeight_;
-    other->minNodeSize_ = minNodeSize_;
-
-    other->splitFound_ = false;
-    other->score_ = score_;
-
-    other->iterationCount_ = 0;
-    other->slowBranchCount_ = 0;
-}
-
-
-template<typename SampleIndex>
-void TreeNodeTrainer<SampleIndex>::join(const TreeNodeTrainer& other)
-{
-    iterationCount_ += other.iterationCount_;
-    slowBranchCount_ += other.slowBranchCount_;
-
-    if (!other.splitFound_)
-        return;
-    if (splitFound_ && other.score_ < score_)
-        return;
-    if (splitFound_ && other.score_ == score_ && j_ < other.j_)
-        return;   // makes joining deterministic
-
-    splitFound_ = true;
-    score_ = other.score_;
-    j_ = other.j_;
-    x_ = other.x_;
-    leftSampleCount_ = other.leftSampleCount_;
-    leftSumW_ = other.leftSumW_;
-    leftSumWY_ = other.leftSumWY_;
+    return this->sampleCount_;
 }
 
 //......................................................................................................................
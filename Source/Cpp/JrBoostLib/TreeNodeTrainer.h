@@ -4,48 +4,57 @@
 
 #pragma once
 
-#include "Tree.h"
+#include "TreeNodeTrainerBase.h"
 
-class BaseOptions;
-struct WyPack;
+// the weight w and the product w * y of a sample, stored in single precision when options.singlePrecision() is true;
+// the node trainer reads one pack per sample instead of one value from each of the arrays weights and outData,
+// but all sums are still accumulated in double precision
+
+struct WyPack {
+    float w;
+    float wy;
+};
 
 //----------------------------------------------------------------------------------------------------------------------
 
+// finds the best split of a node of a single tree (see TreeNodeTrainerBase.h)
+
 template<typename SampleIndex>
-class TreeNodeTrainer {   // immutable class
+class TreeNodeTrainer : public TreeNodeTrainerBase<SampleIndex, ScalarNodeSums> {   // immutable class
 public:
     TreeNodeTrainer() = default;
     ~TreeNodeTrainer() = default;
 
     void init(const TreeNodeExt& node, const BaseOptions& options);
     void update(
-        CRefXXfc inData, CRefXd outData, CRefXd weights, const SampleIndex* pSortedSamplesBegin,
+        const float* pInDataColJ, CRefXd outData, CRefXd weights, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pSortedSamplesEnd, size_t j);
+    void updateCategorical(
+        const float* pInDataColJ, CRefXd outData, CRefXd weights, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pSortedSamplesEnd, size_t j);
+    void update(
+        const float* pInDataColJ, const WyPack* pWyPacks, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pSortedSamplesEnd, size_t j);
+    void updateCategorical(
+        const float* pInDataColJ, const WyPack* pWyPacks, const SampleIndex* pSortedSamplesBegin,
         const SampleIndex* pSortedSamplesEnd, size_t j);
     size_t finalize(TreeNodeExt** ppParentNode, TreeNodeExt** ppChildNode) const;
 
-    void fork(TreeNodeTrainer* other) const;
-    void join(const TreeNodeTrainer& other);
-
     // not really used, but required by vector<TreeNodeTrainer>
     TreeNodeTrainer(const TreeNodeTrainer&){};
     TreeNodeTrainer& operator=(const TreeNodeTrainer&) { return *this; };
 
 private:
-    size_t sampleCount_;
-    double sumW_;
-    double sumWY_;
-    double minNodeWeight_;
-    size_t minNodeSize_;
-
-    bool splitFound_;
-    double score_;
-    size_t j_;
-    float x_;
-
-    size_t leftSampleCount_;
-    double leftSumW_;
-    double leftSumWY_;
-
-    size_t iterationCount_;
-    size_t slowBranchCount_;
+    // the sample data, either the arrays outData and weights or an array of packs
+    struct DoubleSampleData_ {
+        const double* pOutData;
+        const double* pWeights;
+        double w(size_t i) const { return pWeights[i]; }
+        double wy(size_t i) const { return pWeights[i] * pOutData[i]; }
+    };
+    struct FloatSampleData_ {
+        const WyPack* pWyPacks;
+        double w(size_t i) const { return pWyPacks[i].w; }
+        double wy(size_t i) const { return pWyPacks[i].wy; }
+    };
 };
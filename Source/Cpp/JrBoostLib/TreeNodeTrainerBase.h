@@ -0,0 +1,752 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "BaseOptions.h"
+#include "Tree.h"
+
+// The split search shared by TreeNodeTrainer (a single tree) and MultiTreeNodeTrainer (several trees with the same
+// splits). The two differ only in the sums of a node, which are given by the policy class NodeSums:
+// ScalarNodeSums holds the sums w and w * y, and ClassNodeSums holds these sums for each tree (class).
+//
+// NodeSums::Sum is the type of a set of sums; it is a value for ScalarNodeSums, but a pointer to storage owned by
+// ClassNodeSums, so the code below only changes a Sum through the member functions of NodeSums.
+// The sample data, passed to the update functions, is also a policy, see TreeNodeTrainer and MultiTreeNodeTrainer.
+
+//----------------------------------------------------------------------------------------------------------------------
+
+class ScalarNodeSums {
+public:
+    struct Sum {
+        double w;
+        double wy;
+    };
+
+    void init(double sumW, double sumWY) { node_ = {sumW, sumWY}; }
+    void fork(ScalarNodeSums* other) const { other->node_ = node_; }
+
+    Sum node() const { return node_; }
+    Sum bestLeft() const { return bestLeft_; }
+    size_t classCount() const { return 1; }
+    double weight() const { return node_.w; }
+    double nodeScore() const { return square(node_.wy) / node_.w; }
+
+    // the sets of sums in use at the same time have different indices k (only needed by ClassNodeSums)
+    void reserveSums(size_t /*count*/) {}
+    Sum emptySum(size_t /*k*/) const { return {0.0, 0.0}; }
+    Sum nonMissingSum(size_t /*k*/) const { return {node_.w - missing_.w, node_.wy - missing_.wy}; }
+
+    template<typename SampleData>
+    void add(Sum& s, const SampleData& sampleData, size_t i) const
+    {
+        s.w += sampleData.w(i);
+        s.wy += sampleData.wy(i);
+    }
+    template<typename SampleData>
+    void subtract(Sum& s, const SampleData& sampleData, size_t i) const
+    {
+        s.w -= sampleData.w(i);
+        s.wy -= sampleData.wy(i);
+    }
+    void add(Sum& s, const Sum& t) const
+    {
+        s.w += t.w;
+        s.wy += t.wy;
+    }
+    void subtract(Sum& s, const Sum& t) const
+    {
+        s.w -= t.w;
+        s.wy -= t.wy;
+    }
+
+    void clearMissing() { missing_ = {0.0, 0.0}; }
+    template<typename SampleData>
+    void addMissing(const SampleData& sampleData, size_t i)
+    {
+        add(missing_, sampleData, i);
+    }
+
+    template<bool MISSING_LEFT>
+    double splitScore(const Sum& left) const
+    {
+        double leftSumW = left.w;
+        double leftSumWY = left.wy;
+        double rightSumW = node_.w - left.w;
+        double rightSumWY = node_.wy - left.wy;
+        if (MISSING_LEFT) {
+            leftSumW += missing_.w;
+            leftSumWY += missing_.wy;
+            rightSumW -= missing_.w;
+            rightSumWY -= missing_.wy;
+        }
+        return square(leftSumWY) / leftSumW + square(rightSumWY) / rightSumW;
+    }
+    double leftWeight(const Sum& left, bool missingLeft) const { return missingLeft ? left.w + missing_.w : left.w; }
+    double mean(const Sum& s, size_t /*q*/) const { return (s.w > 0.0) ? s.wy / s.w : 0.0; }
+
+    void saveBestLeft(const Sum& left, bool missingLeft)
+    {
+        bestLeft_ = missingLeft ? Sum{left.w + missing_.w, left.wy + missing_.wy} : left;
+    }
+    void copyBestLeft(const ScalarNodeSums& other) { bestLeft_ = other.bestLeft_; }
+
+private:
+    Sum node_;
+    Sum bestLeft_;
+    Sum missing_;   // the samples with missing values of the variable being updated
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// the sums of each tree are stored as pClassSums[2 * q] = w and pClassSums[2 * q + 1] = w * y for tree q
+// sums_ consists of segments with the sums of each tree: the node, the left child of the best split,
+// the samples with missing values, and the sets of sums with index k = 0, 1, ...
+
+class ClassNodeSums {
+public:
+    using Sum = double*;
+
+    void init(const double* pNodeSums, size_t classCount)
+    {
+        n_ = 2 * classCount;
+        sums_.resize(5 * n_);
+        std::copy(pNodeSums, pNodeSums + n_, data(sums_));
+        sumW_ = 0.0;
+        for (size_t q = 0; q != classCount; ++q)
+            sumW_ += pNodeSums[2 * q];
+    }
+    void fork(ClassNodeSums* other) const
+    {
+        other->n_ = n_;
+        other->sums_.resize(5 * n_);
+        std::copy(data(sums_), data(sums_) + n_, data(other->sums_));
+        other->sumW_ = sumW_;
+    }
+
+    const double* node() const { return data(sums_); }
+    const double* bestLeft() const { return data(sums_) + n_; }
+    size_t classCount() const { return n_ / 2; }
+    double weight() const { return sumW_; }
+    double nodeScore() const
+    {
+        const double* pNodeSums = node();
+        double score = 0.0;
+        for (size_t r = 0; r != n_; r += 2)
+            score += treeScore_(pNodeSums[r], pNodeSums[r + 1]);
+        return score;
+    }
+
+    void reserveSums(size_t count) { sums_.resize((3 + count) * n_); }   // allocates memory the first time only
+    Sum emptySum(size_t k)
+    {
+        Sum s = data(sums_) + (3 + k) * n_;
+        std::fill(s, s + n_, 0.0);
+        return s;
+    }
+    Sum nonMissingSum(size_t k)
+    {
+        Sum s = data(sums_) + (3 + k) * n_;
+        const double* pNodeSums = node();
+        const double* pMissingSums = missing_();
+        for (size_t r = 0; r != n_; ++r)
+            s[r] = pNodeSums[r] - pMissingSums[r];
+        return s;
+    }
+
+    template<typename SampleData>
+    void add(Sum s, const SampleData& sampleData, size_t i) const
+    {
+        add(s, sampleData.classSums(i));
+    }
+    template<typename SampleData>
+    void subtract(Sum s, const SampleData& sampleData, size_t i) const
+    {
+        subtract(s, sampleData.classSums(i));
+    }
+    void add(Sum s, const double* t) const
+    {
+        for (size_t r = 0; r != n_; ++r)
+            s[r] += t[r];
+    }
+    void subtract(Sum s, const double* t) const
+    {
+        for (size_t r = 0; r != n_; ++r)
+            s[r] -= t[r];
+    }
+
+    void clearMissing() { std::fill(missing_(), missing_() + n_, 0.0); }
+    template<typename SampleData>
+    void addMissing(const SampleData& sampleData, size_t i)
+    {
+        add(missing_(), sampleData, i);
+    }
+
+    template<bool MISSING_LEFT>
+    double splitScore(const double* pLeftSums) const
+    {
+        const double* pNodeSums = node();
+        const double* pMissingSums = missing_();
+        double score = 0.0;
+        for (size_t r = 0; r != n_; r += 2) {
+            double leftSumW = pLeftSums[r];
+            double leftSumWY = pLeftSums[r + 1];
+            if (MISSING_LEFT) {
+                leftSumW += pMissingSums[r];
+                leftSumWY += pMissingSums[r + 1];
+            }
+            score += treeScore_(leftSumW, leftSumWY)
+                + treeScore_(pNodeSums[r] - leftSumW, pNodeSums[r + 1] - leftSumWY);
+        }
+        return score;
+    }
+    double leftWeight(const double* pLeftSums, bool missingLeft) const
+    {
+        const double* pMissingSums = missing_();
+        double leftSumW = 0.0;
+        for (size_t r = 0; r != n_; r += 2) {
+            leftSumW += pLeftSums[r];
+            if (missingLeft)
+                leftSumW += pMissingSums[r];
+        }
+        return leftSumW;
+    }
+    double mean(const double* pSums, size_t q) const
+    {
+        return (pSums[2 * q] > 0.0) ? pSums[2 * q + 1] / pSums[2 * q] : 0.0;
+    }
+
+    void saveBestLeft(const double* pLeftSums, bool missingLeft)
+    {
+        double* pBestLeftSums = data(sums_) + n_;
+        const double* pMissingSums = missing_();
+        for (size_t r = 0; r != n_; ++r)
+            pBestLeftSums[r] = missingLeft ? pLeftSums[r] + pMissingSums[r] : pLeftSums[r];
+    }
+    void copyBestLeft(const ClassNodeSums& other)
+    {
+        std::copy(other.bestLeft(), other.bestLeft() + n_, data(sums_) + n_);
+    }
+
+private:
+    // the score of one tree; a tree with no weight in a node, e.g. because the node only has samples that are
+    // already classified with certainty, does not contribute
+    static double treeScore_(double sumW, double sumWY) { return sumW > 0.0 ? square(sumWY) / sumW : 0.0; }
+
+    double* missing_() { return data(sums_) + 2 * n_; }
+    const double* missing_() const { return data(sums_) + 2 * n_; }
+
+    size_t n_;   // 2 * classCount
+    vector<double> sums_;
+    double sumW_;   // the sum of w over the trees
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+template<typename SampleIndex, typename NodeSums>
+class TreeNodeTrainerBase {
+public:
+    void fork(TreeNodeTrainerBase* other) const;
+    void join(const TreeNodeTrainerBase& other);
+
+protected:
+    using Sum = typename NodeSums::Sum;
+
+    // nodeSums_ should be initialized first
+    void init_(const TreeNodeExt& node, const BaseOptions& options);
+    template<typename SampleData>
+    void updateImpl_(
+        const float* pInDataColJ, const SampleData& sampleData, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pSortedSamplesEnd, size_t j);
+    template<typename SampleData>
+    void updateCategoricalImpl_(
+        const float* pInDataColJ, const SampleData& sampleData, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pSortedSamplesEnd, size_t j);
+    // returns the left child node if the node was split, otherwise nullptr; the right child node follows it
+    TreeNodeExt* finalize_(TreeNodeExt** ppParentNode, TreeNodeExt** ppChildNode) const;
+
+    NodeSums nodeSums_;
+    size_t sampleCount_;
+
+private:
+    template<bool HAS_MISSING, typename SampleData>
+    void update_(
+        const float* pInDataColJ, const SampleData& sampleData, const SampleIndex* pSortedSamplesBegin,
+        const SampleIndex* pMissingSamplesBegin, size_t zeroSampleCount, size_t j);
+    template<bool HAS_MISSING, typename SampleData>
+    void scan_(
+        const float* pInDataColJ, const SampleData& sampleData, const SampleIndex* pBegin, const SampleIndex* pEnd,
+        float nextX, size_t* pLeftSampleCount, Sum* pLeft, size_t j);
+    template<bool HAS_MISSING>
+    void evaluate_(size_t leftSampleCount, const Sum& left, float leftX, float rightX, size_t j);
+    template<bool HAS_MISSING>
+    void trySplits_(
+        double score, double scoreMissingLeft, size_t leftSampleCount, const Sum& left, float leftX, float rightX,
+        size_t j);
+    void trySplit_(
+        double score, bool defaultLeft, size_t leftSampleCount, const Sum& left, float leftX, float rightX, size_t j);
+    void trySplitCategorical_(
+        double score, bool defaultLeft, size_t leftSampleCount, const Sum& left, uint64_t leftCategories, size_t j);
+    bool acceptSplit_(double score, bool defaultLeft, size_t leftSampleCount, const Sum& left) const;
+    void saveSplit_(double score, bool defaultLeft, size_t leftSampleCount, const Sum& left, size_t j);
+
+    double minNodeWeight_;
+    size_t minNodeSize_;
+
+    bool splitFound_;
+    double score_;
+    size_t j_;
+    float x_;
+    uint64_t leftCategories_;   // 0 for numerical splits
+    bool defaultLeft_;
+    size_t leftSampleCount_;
+
+    // the samples with missing values of the variable being updated
+    size_t missingSampleCount_;
+
+    size_t iterationCount_;
+    size_t slowBranchCount_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+template<typename SampleIndex, typename NodeSums>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::init_(const TreeNodeExt& node, const BaseOptions& options)
+{
+    sampleCount_ = node.sampleCount;
+    minNodeWeight_ = std::max(options.minNodeWeight(), 1e-6 * nodeSums_.weight());
+    minNodeSize_ = options.minNodeSize();
+
+    splitFound_ = false;
+    score_ = nodeSums_.nodeScore() + options.minNodeGain();
+
+    iterationCount_ = 0;
+    slowBranchCount_ = 0;
+}
+
+
+// finds the best split of a node for variable j
+
+template<typename SampleIndex, typename NodeSums>
+template<typename SampleData>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::updateImpl_(
+    const float* pInDataColJ,
+    const SampleData& sampleData,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pSortedSamplesEnd,
+    size_t j)
+{
+    // the samples in the range [pSortedSamplesBegin, pSortedSamplesEnd) should be the samples in the node
+    // with non-zero values of variable j (pInDataColJ points to its values), sorted according to these values,
+    // with the samples with missing values (NaN) last
+    // the samples with zero values are not listed; they form an implicit block between the negative and the positive
+    // values, and the scan jumps over that block in one step
+
+    ASSERT(static_cast<size_t>(pSortedSamplesEnd - pSortedSamplesBegin) <= sampleCount_);
+
+    if (nodeSums_.weight() == 0)
+        return;
+
+    const SampleIndex* pMissingSamplesBegin = pSortedSamplesEnd;
+    while (pMissingSamplesBegin != pSortedSamplesBegin && std::isnan(pInDataColJ[pMissingSamplesBegin[-1]]))
+        --pMissingSamplesBegin;
+
+    missingSampleCount_ = pSortedSamplesEnd - pMissingSamplesBegin;
+    nodeSums_.clearMissing();
+    for (const SampleIndex* p = pMissingSamplesBegin; p != pSortedSamplesEnd; ++p)
+        nodeSums_.addMissing(sampleData, *p);
+
+    const size_t zeroSampleCount = sampleCount_ - (pSortedSamplesEnd - pSortedSamplesBegin);
+
+    if (missingSampleCount_ == 0)
+        update_<false>(pInDataColJ, sampleData, pSortedSamplesBegin, pMissingSamplesBegin, zeroSampleCount, j);
+    else
+        update_<true>(pInDataColJ, sampleData, pSortedSamplesBegin, pMissingSamplesBegin, zeroSampleCount, j);
+
+    iterationCount_ += pSortedSamplesEnd - pSortedSamplesBegin;
+}
+
+
+// the samples in the range [pSortedSamplesBegin, pMissingSamplesBegin) are the samples with non-zero non-missing values
+
+template<typename SampleIndex, typename NodeSums>
+template<bool HAS_MISSING, typename SampleData>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::update_(
+    const float* pInDataColJ,
+    const SampleData& sampleData,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pMissingSamplesBegin,
+    size_t zeroSampleCount,
+    size_t j)
+{
+    // the left sums do not include the samples with missing values
+
+    size_t leftSampleCount = 0;
+    Sum left = nodeSums_.emptySum(0);
+
+    if (zeroSampleCount == 0) {
+        scan_<HAS_MISSING>(
+            pInDataColJ, sampleData, pSortedSamplesBegin, pMissingSamplesBegin, numeric_limits<float>::quiet_NaN(),
+            &leftSampleCount, &left, j);
+        return;
+    }
+
+    // the sums of the zero block are the sums of the node minus the sums of the listed samples
+
+    Sum zero = nodeSums_.nonMissingSum(1);
+    for (const SampleIndex* p = pSortedSamplesBegin; p != pMissingSamplesBegin; ++p)
+        nodeSums_.subtract(zero, sampleData, *p);
+
+    const SampleIndex* pPositiveSamplesBegin = std::partition_point(
+        pSortedSamplesBegin, pMissingSamplesBegin, [pInDataColJ](SampleIndex i) { return pInDataColJ[i] < 0.0f; });
+
+    scan_<HAS_MISSING>(
+        pInDataColJ, sampleData, pSortedSamplesBegin, pPositiveSamplesBegin, 0.0f, &leftSampleCount, &left, j);
+
+    leftSampleCount += zeroSampleCount;
+    nodeSums_.add(left, zero);
+    if (pPositiveSamplesBegin != pMissingSamplesBegin)
+        evaluate_<HAS_MISSING>(leftSampleCount, left, 0.0f, pInDataColJ[*pPositiveSamplesBegin], j);
+
+    scan_<HAS_MISSING>(
+        pInDataColJ, sampleData, pPositiveSamplesBegin, pMissingSamplesBegin, numeric_limits<float>::quiet_NaN(),
+        &leftSampleCount, &left, j);
+}
+
+
+// moves the samples in the range [pBegin, pEnd) to the left side one by one and tries the split after each of them
+// nextX is the value that follows the range; if it is NaN, the split after the last sample is not tried
+
+template<typename SampleIndex, typename NodeSums>
+template<bool HAS_MISSING, typename SampleData>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::scan_(
+    const float* pInDataColJ,
+    const SampleData& sampleData,
+    const SampleIndex* pBegin,
+    const SampleIndex* pEnd,
+    float nextX,
+    size_t* pLeftSampleCount,
+    Sum* pLeft,
+    size_t j)
+{
+    if (pBegin == pEnd)
+        return;
+
+    const size_t leftSampleCount0 = *pLeftSampleCount;
+    Sum left = *pLeft;
+
+    const SampleIndex* p = pBegin;
+    size_t nextI = *p;
+    while (p != pEnd - 1) {
+
+        // this is where most execution time is spent ..........................
+
+        const size_t i = nextI;
+        nextI = *++p;
+
+        nodeSums_.add(left, sampleData, i);
+
+        const double score = nodeSums_.template splitScore<false>(left);
+        const double scoreMissingLeft = HAS_MISSING ? nodeSums_.template splitScore<true>(left) : 0.0;
+
+        if (score <= score_ && (!HAS_MISSING || scoreMissingLeft <= score_))
+            continue;   // usually true .......................
+
+        ++slowBranchCount_;
+
+        trySplits_<HAS_MISSING>(
+            score, scoreMissingLeft, leftSampleCount0 + (p - pBegin), left, pInDataColJ[i], pInDataColJ[nextI], j);
+    }
+
+    const size_t i = nextI;
+    nodeSums_.add(left, sampleData, i);
+    const size_t leftSampleCount = leftSampleCount0 + (pEnd - pBegin);
+
+    if (!std::isnan(nextX))
+        evaluate_<HAS_MISSING>(leftSampleCount, left, pInDataColJ[i], nextX, j);
+
+    *pLeftSampleCount = leftSampleCount;
+    *pLeft = left;
+}
+
+
+// evaluates the split with the given left side (not including the samples with missing values)
+
+template<typename SampleIndex, typename NodeSums>
+template<bool HAS_MISSING>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::evaluate_(
+    size_t leftSampleCount, const Sum& left, float leftX, float rightX, size_t j)
+{
+    const double score = nodeSums_.template splitScore<false>(left);
+    const double scoreMissingLeft = HAS_MISSING ? nodeSums_.template splitScore<true>(left) : 0.0;
+
+    if (score <= score_ && (!HAS_MISSING || scoreMissingLeft <= score_))
+        return;
+
+    ++slowBranchCount_;
+
+    trySplits_<HAS_MISSING>(score, scoreMissingLeft, leftSampleCount, left, leftX, rightX, j);
+}
+
+
+// if HAS_MISSING is true, both sending the samples with missing values right and sending them left are tried
+
+template<typename SampleIndex, typename NodeSums>
+template<bool HAS_MISSING>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::trySplits_(
+    double score,
+    double scoreMissingLeft,
+    size_t leftSampleCount,
+    const Sum& left,
+    float leftX,
+    float rightX,
+    size_t j)
+{
+    trySplit_(score, false, leftSampleCount, left, leftX, rightX, j);
+    if (HAS_MISSING)
+        trySplit_(scoreMissingLeft, true, leftSampleCount + missingSampleCount_, left, leftX, rightX, j);
+}
+
+
+template<typename SampleIndex, typename NodeSums>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::trySplit_(
+    double score, bool defaultLeft, size_t leftSampleCount, const Sum& left, float leftX, float rightX, size_t j)
+{
+    if (!acceptSplit_(score, defaultLeft, leftSampleCount, left))
+        return;
+
+    // leftX < rightX
+    const float midX = (leftX + rightX) / 2;
+    if (leftX == midX)
+        return;
+
+    saveSplit_(score, defaultLeft, leftSampleCount, left, j);
+    x_ = midX;
+    leftCategories_ = 0;
+}
+
+
+// finds the best categorical split of a node for variable j
+// the categories are sorted by their mean outdata values, and only the splits that send a set of consecutive categories
+// with the lowest means to the left child are tried; for a given direction of the missing values, one of these splits
+// is the best partition of the categories into two groups (Fisher 1958)
+// with several trees this is done with the means of each tree in turn, and the best partition is not guaranteed
+
+template<typename SampleIndex, typename NodeSums>
+template<typename SampleData>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::updateCategoricalImpl_(
+    const float* pInDataColJ,
+    const SampleData& sampleData,
+    const SampleIndex* pSortedSamplesBegin,
+    const SampleIndex* pSortedSamplesEnd,
+    size_t j)
+{
+    // the samples in the range [pSortedSamplesBegin, pSortedSamplesEnd) should be the samples in the node
+    // with non-zero values of variable j (pInDataColJ points to its values), i.e. the samples not in category 0
+    // the values are integers in the range [0, maxCategoryCount) or missing (NaN), as checked by BoostTrainer
+
+    using TreeTools::maxCategoryCount;
+
+    ASSERT(static_cast<size_t>(pSortedSamplesEnd - pSortedSamplesBegin) <= sampleCount_);
+
+    if (nodeSums_.weight() == 0)
+        return;
+
+    // the left sums have index 0 and the sums of category c have index c + 1
+    nodeSums_.reserveSums(maxCategoryCount + 1);
+
+    std::array<size_t, maxCategoryCount> sampleCounts{};
+    std::array<Sum, maxCategoryCount> categorySums;
+    for (size_t c = 0; c != maxCategoryCount; ++c)
+        categorySums[c] = nodeSums_.emptySum(c + 1);
+    missingSampleCount_ = 0;
+    nodeSums_.clearMissing();
+
+    for (const SampleIndex* p = pSortedSamplesBegin; p != pSortedSamplesEnd; ++p) {
+        const float x = pInDataColJ[*p];
+        if (std::isnan(x)) {
+            ++missingSampleCount_;
+            nodeSums_.addMissing(sampleData, *p);
+        }
+        else {
+            const size_t c = static_cast<size_t>(x);
+            ++sampleCounts[c];
+            nodeSums_.add(categorySums[c], sampleData, *p);
+        }
+    }
+
+    // the sums of category 0 are the sums of the node minus the sums of the listed samples
+
+    sampleCounts[0] = sampleCount_ - (pSortedSamplesEnd - pSortedSamplesBegin);
+    if (sampleCounts[0] != 0) {
+        categorySums[0] = nodeSums_.nonMissingSum(1);
+        for (size_t c = 1; c != maxCategoryCount; ++c)
+            nodeSums_.subtract(categorySums[0], categorySums[c]);
+    }
+
+    std::array<size_t, maxCategoryCount> categories;
+    size_t categoryCount = 0;
+    for (size_t c = 0; c != maxCategoryCount; ++c) {
+        if (sampleCounts[c] != 0)
+            categories[categoryCount++] = c;
+    }
+
+    std::array<double, maxCategoryCount> means;
+    for (size_t q = 0; q != nodeSums_.classCount(); ++q) {
+
+        for (size_t r = 0; r != categoryCount; ++r) {
+            const size_t c = categories[r];
+            means[c] = nodeSums_.mean(categorySums[c], q);
+        }
+        std::sort(begin(categories), begin(categories) + categoryCount, [&means](size_t c1, size_t c2) {
+            return means[c1] < means[c2] || (means[c1] == means[c2] && c1 < c2);
+        });
+
+        size_t leftSampleCount = 0;
+        Sum left = nodeSums_.emptySum(0);
+        uint64_t leftCategories = 0;
+
+        for (size_t r = 0; r + 1 < categoryCount; ++r) {
+
+            const size_t c = categories[r];
+            leftSampleCount += sampleCounts[c];
+            nodeSums_.add(left, categorySums[c]);
+            leftCategories |= uint64_t{1} << c;
+
+            trySplitCategorical_(
+                nodeSums_.template splitScore<false>(left), false, leftSampleCount, left, leftCategories, j);
+
+            if (missingSampleCount_ == 0)
+                continue;
+            trySplitCategorical_(
+                nodeSums_.template splitScore<true>(left), true, leftSampleCount + missingSampleCount_, left,
+                leftCategories, j);
+        }
+    }
+
+    iterationCount_ += pSortedSamplesEnd - pSortedSamplesBegin;
+}
+
+
+template<typename SampleIndex, typename NodeSums>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::trySplitCategorical_(
+    double score, bool defaultLeft, size_t leftSampleCount, const Sum& left, uint64_t leftCategories, size_t j)
+{
+    if (!acceptSplit_(score, defaultLeft, leftSampleCount, left))
+        return;
+
+    saveSplit_(score, defaultLeft, leftSampleCount, left, j);
+    x_ = numeric_limits<float>::quiet_NaN();
+    leftCategories_ = leftCategories;
+}
+
+
+// the sample count of the left side includes the samples with missing values if defaultLeft is true,
+// but the left sums do not
+
+template<typename SampleIndex, typename NodeSums>
+bool TreeNodeTrainerBase<SampleIndex, NodeSums>::acceptSplit_(
+    double score, bool defaultLeft, size_t leftSampleCount, const Sum& left) const
+{
+    // carefully written to reject NaN
+    if (!(score > score_) || leftSampleCount < minNodeSize_ || sampleCount_ - leftSampleCount < minNodeSize_)
+        return false;
+
+    const double leftSumW = nodeSums_.leftWeight(left, defaultLeft);
+    return leftSumW >= minNodeWeight_ && nodeSums_.weight() - leftSumW >= minNodeWeight_;
+}
+
+
+template<typename SampleIndex, typename NodeSums>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::saveSplit_(
+    double score, bool defaultLeft, size_t leftSampleCount, const Sum& left, size_t j)
+{
+    splitFound_ = true;
+    score_ = score;
+    j_ = j;
+    defaultLeft_ = defaultLeft;
+    leftSampleCount_ = leftSampleCount;
+    nodeSums_.saveBestLeft(left, defaultLeft);
+}
+
+
+// updates the parent node based on the best split found and sets the sample counts of the child nodes;
+// the other values of the child nodes are set by the derived class
+
+template<typename SampleIndex, typename NodeSums>
+TreeNodeExt* TreeNodeTrainerBase<SampleIndex, NodeSums>::finalize_(
+    TreeNodeExt** ppParentNode, TreeNodeExt** ppChildNode) const
+{
+    PROFILE::UPDATE_BRANCH_STATISTICS(iterationCount_, slowBranchCount_);
+
+    TreeNodeExt* pParentNode = *ppParentNode;
+    ++*ppParentNode;
+
+    if (!splitFound_)
+        return nullptr;
+
+    pParentNode->isLeaf = false;
+    pParentNode->j = j_;
+    pParentNode->x = x_;
+    pParentNode->leftCategories = leftCategories_;
+    pParentNode->defaultLeft = defaultLeft_;
+    pParentNode->gain = static_cast<float>(score_ - nodeSums_.nodeScore());
+
+    TreeNodeExt* leftChildNode = *ppChildNode;
+    ++*ppChildNode;
+    pParentNode->leftChild = leftChildNode;
+    leftChildNode->isLeaf = true;
+    leftChildNode->sampleCount = leftSampleCount_;
+
+    TreeNodeExt* rightChildNode = *ppChildNode;
+    ++*ppChildNode;
+    pParentNode->rightChild = rightChildNode;
+    rightChildNode->isLeaf = true;
+    rightChildNode->sampleCount = sampleCount_ - leftSampleCount_;
+
+    return leftChildNode;
+}
+
+//......................................................................................................................
+
+template<typename SampleIndex, typename NodeSums>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::fork(TreeNodeTrainerBase* other) const
+{
+    ASSERT(!splitFound_);
+
+    nodeSums_.fork(&other->nodeSums_);
+    other->sampleCount_ = sampleCount_;
+    other->minNodeWeight_ = minNodeWeight_;
+    other->minNodeSize_ = minNodeSize_;
+
+    other->splitFound_ = false;
+    other->score_ = score_;
+
+    other->iterationCount_ = 0;
+    other->slowBranchCount_ = 0;
+}
+
+
+template<typename SampleIndex, typename NodeSums>
+void TreeNodeTrainerBase<SampleIndex, NodeSums>::join(const TreeNodeTrainerBase& other)
+{
+    iterationCount_ += other.iterationCount_;
+    slowBranchCount_ += other.slowBranchCount_;
+
+    if (!other.splitFound_)
+        return;
+    if (splitFound_ && other.score_ < score_)
+        return;
+    if (splitFound_ && other.score_ == score_ && j_ < other.j_)
+        return;   // makes joining deterministic
+
+    splitFound_ = true;
+    score_ = other.score_;
+    j_ = other.j_;
+    x_ = other.x_;
+    leftCategories_ = other.leftCategories_;
+    defaultLeft_ = other.defaultLeft_;
+    leftSampleCount_ = other.leftSampleCount_;
+    nodeSums_.copyBestLeft(other.nodeSums_);
+}
@@ -11,37 +11,60 @@
 #include "TreeTrainerImpl.h"
 
 
-unique_ptr<TreeTrainer> TreeTrainer::createInstance(CRefXXfc inData, CRefXu8 strata)
+unique_ptr<TreeTrainer>
+TreeTrainer::createInstance(const vector<CRefXXfc>& inDataBlocks, CRefXu8 categorical, const PairVariables& pairs)
 {
-    const size_t sampleCount = static_cast<size_t>(inData.rows());
+    const size_t sampleCount = static_cast<size_t>(inDataBlocks[0].rows());
     if (sampleCount <= 0x100) {
         using SampleIndex = uint8_t;
-        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inData, strata);
+        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inDataBlocks, categorical, pairs);
     }
     else if (sampleCount <= 0x10000) {
         using SampleIndex = uint16_t;
-        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inData, strata);
+        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inDataBlocks, categorical, pairs);
     }
     else if (sampleCount <= 0x100000000) {
         using SampleIndex = uint32_t;
-        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inData, strata);
+        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inDataBlocks, categorical, pairs);
     }
     else {
         using SampleIndex = uint64_t;
-        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inData, strata);
+        return std::make_unique<TreeTrainerImpl<SampleIndex>>(inDataBlocks, categorical, pairs);
     }
 }
 
 
 unique_ptr<BasePredictor>
-TreeTrainer::train(CRefXd outData, CRefXd weights, const BaseOptions& options, size_t threadCount) const
+TreeTrainer::train(CRefXd outData, CRefXd weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const
 {
     const size_t forestSize = options.forestSize();
     if (forestSize == 1)
-        return trainImpl0_(outData, weights, options, threadCount);
+        return trainImpl0_(outData, weights, strata, options, threadCount);
 
     vector<unique_ptr<BasePredictor>> basePredictors(forestSize);
     for (size_t k = 0; k != forestSize; ++k)
-        basePredictors[k] = trainImpl0_(outData, weights, options, threadCount);
+        basePredictors[k] = trainImpl0_(outData, weights, strata, options, threadCount);
     return ForestPredictor::createInstance(move(basePredictors));
 }
+
+
+vector<unique_ptr<BasePredictor>> TreeTrainer::trainMulti(
+    CRefXXdc outData, CRefXXdc weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const
+{
+    const size_t forestSize = options.forestSize();
+    if (forestSize == 1)
+        return trainMultiImpl0_(outData, weights, strata, options, threadCount);
+
+    const size_t classCount = static_cast<size_t>(outData.cols());
+    vector<vector<unique_ptr<BasePredictor>>> basePredictorsByClass(classCount);
+    for (size_t k = 0; k != forestSize; ++k) {
+        vector<unique_ptr<BasePredictor>> basePredictors
+            = trainMultiImpl0_(outData, weights, strata, options, threadCount);
+        for (size_t q = 0; q != classCount; ++q)
+            basePredictorsByClass[q].push_back(move(basePredictors[q]));
+    }
+    vector<unique_ptr<BasePredictor>> forestPredictors(classCount);
+    for (size_t q = 0; q != classCount; ++q)
+        forestPredictors[q] = ForestPredictor::createInstance(move(basePredictorsByClass[q]));
+    return forestPredictors;
+}
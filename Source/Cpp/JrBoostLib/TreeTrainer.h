@@ -6,16 +6,26 @@
 
 class BasePredictor;
 class BaseOptions;
+class PairVariables;
 
 
 class TreeTrainer {   // abstract class
 public:
-    static unique_ptr<TreeTrainer> createInstance(CRefXXfc inData, CRefXu8 strata);
+    // the indata blocks are treated as one matrix, see Dataset.h; they must outlive the tree trainer
+    // the pair variables come after the variables of the indata blocks, see PairVariables.h
+    static unique_ptr<TreeTrainer>
+    createInstance(const vector<CRefXXfc>& inDataBlocks, CRefXu8 categorical, const PairVariables& pairs);
 
     virtual ~TreeTrainer() = default;
 
     virtual unique_ptr<BasePredictor>
-    train(CRefXd outData, CRefXd weights, const BaseOptions& options, size_t threadCount) const;
+    train(CRefXd outData, CRefXd weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const;
+
+    // trains one tree for each column of outData and weights (e.g. one tree per class in multinomial boosting);
+    // the trees have the same splits, chosen to maximize the sum of the gains of the trees, but different leaf values,
+    // so the selection of samples and variables, the sorting of the samples and the sample status are shared
+    vector<unique_ptr<BasePredictor>> trainMulti(
+        CRefXXdc outData, CRefXXdc weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const;
 
 protected:
     TreeTrainer() = default;
@@ -23,6 +33,8 @@ protected:
     TreeTrainer& operator=(const TreeTrainer&) = delete;
 
 private:
-    virtual unique_ptr<BasePredictor>
-    trainImpl0_(CRefXd outData, CRefXd weights, const BaseOptions& options, size_t threadCount) const = 0;
+    virtual unique_ptr<BasePredictor> trainImpl0_(
+        CRefXd outData, CRefXd weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const = 0;
+    virtual vector<unique_ptr<BasePredictor>> trainMultiImpl0_(
+        CRefXXdc outData, CRefXXdc weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const = 0;
 };
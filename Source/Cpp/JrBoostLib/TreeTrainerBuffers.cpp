@@ -13,8 +13,14 @@ size_t TreeTrainerBuffers::bufferSize()
 #pragma omp parallel reduction(+ : n)
     {
         n += bufferSizeImpl_(threadLocalData0_.usedVariables);
+        n += bufferSizeImpl_(threadLocalData0_.usedBundleOffsets);
         n += bufferSizeImpl_(threadLocalData0_.tree);
         n += bufferSizeImpl_(threadLocalData0_.treeData);
+        n += bufferSizeImpl_(threadLocalData0_.pairValues);
+        n += bufferSizeImpl_(threadLocalData0_.wyPacks);
+        n += bufferSizeImpl_(threadLocalData0_.classData);
+        n += bufferSizeImpl_(threadLocalData0_.totalWeights);
+        n += bufferSizeImpl_(threadLocalData0_.classSums);
 
         n += bufferSizeImpl_<uint8_t>();
         n += bufferSizeImpl_<uint16_t>();
@@ -29,10 +35,14 @@ size_t TreeTrainerBuffers::bufferSizeImpl_()
 {
     size_t n = 0;
 
-    n += bufferSizeImpl_(threadLocalData1_<T>.orderedSamplesByVariable);
+    n += bufferSizeImpl_(threadLocalData1_<T>.orderedSamplesByBundle);
+    n += bufferSizeImpl_(threadLocalData1_<T>.orderedSampleBlocksByBundle);
     n += bufferSizeImpl_(threadLocalData1_<T>.sampleBuffer);
     n += bufferSizeImpl_(threadLocalData1_<T>.orderedSampleBlocks);
+    n += bufferSizeImpl_(threadLocalData1_<T>.statusBlockSizes);
+    n += bufferSizeImpl_(threadLocalData1_<T>.statusBlockPositions);
     n += bufferSizeImpl_(threadLocalData1_<T>.treeNodeTrainers);
+    n += bufferSizeImpl_(threadLocalData1_<T>.multiTreeNodeTrainers);
 
     n += bufferSizeImpl_(threadLocalData2_<T>.sampleStatus);
 
@@ -61,8 +71,14 @@ void TreeTrainerBuffers::freeBuffers()
 #pragma omp parallel
     {
         freeBufferImpl_(&threadLocalData0_.usedVariables);
+        freeBufferImpl_(&threadLocalData0_.usedBundleOffsets);
         freeBufferImpl_(&threadLocalData0_.tree);
         freeBufferImpl_(&threadLocalData0_.treeData);
+        freeBufferImpl_(&threadLocalData0_.pairValues);
+        freeBufferImpl_(&threadLocalData0_.wyPacks);
+        freeBufferImpl_(&threadLocalData0_.classData);
+        freeBufferImpl_(&threadLocalData0_.totalWeights);
+        freeBufferImpl_(&threadLocalData0_.classSums);
 
         freeBuffersImpl_<uint8_t>();
         freeBuffersImpl_<uint16_t>();
@@ -74,10 +90,14 @@ void TreeTrainerBuffers::freeBuffers()
 template<typename T>
 void TreeTrainerBuffers::freeBuffersImpl_()
 {
-    freeBufferImpl_(&threadLocalData1_<T>.orderedSamplesByVariable);
+    freeBufferImpl_(&threadLocalData1_<T>.orderedSamplesByBundle);
+    freeBufferImpl_(&threadLocalData1_<T>.orderedSampleBlocksByBundle);
     freeBufferImpl_(&threadLocalData1_<T>.sampleBuffer);
     freeBufferImpl_(&threadLocalData1_<T>.orderedSampleBlocks);
+    freeBufferImpl_(&threadLocalData1_<T>.statusBlockSizes);
+    freeBufferImpl_(&threadLocalData1_<T>.statusBlockPositions);
     freeBufferImpl_(&threadLocalData1_<T>.treeNodeTrainers);
+    freeBufferImpl_(&threadLocalData1_<T>.multiTreeNodeTrainers);
 
     freeBufferImpl_(&threadLocalData2_<T>.sampleStatus);
 }
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "MultiTreeNodeTrainer.h"
 #include "TreeNodeTrainer.h"
 
 
@@ -16,22 +17,36 @@ protected:
     struct ThreadLocalData0_ {
         ThreadLocalData0_* parent = nullptr;   // thread local data of parent thread
         vector<size_t> usedVariables;
+        vector<size_t> usedBundleOffsets;
+        // used bundle number u consists of the used variables usedVariables[usedBundleOffsets[u]], ...,
+        // usedVariables[usedBundleOffsets[u + 1] - 1]
         vector<vector<TreeNodeExt>> tree;
         vector<TreeNodeData> treeData;
+        vector<float> pairValues;   // the values of the pair variable being processed
+        vector<WyPack> wyPacks;     // only used if options.singlePrecision() = true
+        // only used when training several trees with the same splits, see TreeTrainer::trainMulti()
+        vector<double> classData;              // the sums w and w * y of each sample, see MultiTreeNodeTrainer.h
+        vector<double> totalWeights;           // the total weight of each sample
+        vector<vector<double>> classSums;      // the sums w and w * y of each node in each layer of the tree
     };
 
     template<typename SampleIndex>
     struct ThreadLocalData1_ {
         ThreadLocalData1_* parent = nullptr;   // thread local data of parent thread
 
-        vector<vector<SampleIndex>> orderedSamplesByVariable;
-        // orderedSamplesByVariable[j] contains the active samples grouped by node
-        // and then sorted by the j-th used variable
+        vector<vector<SampleIndex>> orderedSamplesByBundle;
+        vector<vector<SampleIndex*>> orderedSampleBlocksByBundle;
+        // orderedSamplesByBundle[u] contains the active samples grouped by node,
+        // then by the variables of the u-th used bundle and then sorted by the variable
+        // orderedSampleBlocksByBundle[u] contains pointers to the segments of orderedSamplesByBundle[u]
         // (only used if options.saveMemory() = false)
 
         vector<SampleIndex> sampleBuffer;
         vector<SampleIndex*> orderedSampleBlocks;
+        vector<size_t> statusBlockSizes;
+        vector<SampleIndex*> statusBlockPositions;
         vector<CacheLineAligned<TreeNodeTrainer<SampleIndex>>> treeNodeTrainers;
+        vector<CacheLineAligned<MultiTreeNodeTrainer<SampleIndex>>> multiTreeNodeTrainers;
     };
 
     template<typename SampleStatus>
@@ -9,6 +9,7 @@
 #include "BaseOptions.h"
 #include "BasePredictor.h"
 #include "OmpParallel.h"
+#include "RadixSort.h"
 
 
 /*
@@ -31,7 +32,18 @@ Overview:
     this observation is used in the implementation of initSampleStatus_(), initTree_(), and initOrderedSamples_().
 
     In the constructor we sort all samples with respect to each variable once and for all.
+    The indata is only accessed through a pointer to the values of each variable,
+    so it may consist of several blocks (see Dataset.h) without being concatenated.
+    The values of the pair variables (see PairVariables.h) are computed when they are needed, one variable at a time.
     No further sorting is done, we simply extract sorted sublists from these presorted lists.
+    Samples with missing values (NaN) are placed last in the presorted lists, and hence also in the sorted sublists.
+    When a node is split, they are sent in the direction that gives the best split (see TreeNodeTrainer).
+    Samples with zero values are not listed at all. They form an implicit block between the samples with negative
+    and positive values, which TreeNodeTrainer jumps over in one step.
+    Thus for sparse or zero-inflated data, memory and scan cost scale with the number of non-zero values.
+    Consecutive sparse variables are bundled and the samples of each bundle are ordered together (see initBundles_()).
+    For categorical variables the order of the samples is not used; TreeNodeTrainer sums the samples by category
+    and sorts the categories instead. Category 0 plays the role of the zero values and is not listed.
 
     The main tasks carried out by the code are:
         1. Maintain a vector that contains the status of each sample in the current layer of the tree.
@@ -46,6 +58,7 @@ Short variable names:
     i sample index
     j variable index
     k node and node trainer index
+    q tree index (when training several trees with the same splits, see trainMultiImpl0_())
     s sample status
     t0, t1, t2 threadlocal data
     w weight
@@ -57,7 +70,7 @@ Short variable names:
         branchfree code (not std::copy_if)
         fast random number generator (not std::mt19937)
         fast Bernoulli distribution (not std::bernoulli_distribution)
-        fast sorting algorithm (not std::sort)
+        fast sorting algorithm (radix sort, not std::sort)
         memory optimized storage of vectors of sample indices and sample status
             using the dynamically selected template parameters SampleIndex and SampleStatus
         very few memory allocations
@@ -68,70 +81,234 @@ Short variable names:
 //----------------------------------------------------------------------------------------------------------------------
 
 template<typename SampleIndex>
-TreeTrainerImpl<SampleIndex>::TreeTrainerImpl(CRefXXfc inData, CRefXu8 strata) :
-    inData_{inData},
-    sampleCount_{static_cast<size_t>(inData.rows())},
-    variableCount_{static_cast<size_t>(inData.cols())},
+TreeTrainerImpl<SampleIndex>::TreeTrainerImpl(
+    const vector<CRefXXfc>& inDataBlocks, CRefXu8 categorical, const PairVariables& pairs) :
+    inDataColumns_{::inDataColumns(inDataBlocks)},
+    pairs_{pairs},
+    sampleCount_{static_cast<size_t>(inDataBlocks[0].rows())},
+    variableCount_{size(inDataColumns_) + pairs.pairCount()},
+    categorical_{categorical},
+    sortedSampleOffsets_{initSortedSampleOffsets_()},
     sortedSamples_{initSortedSamples_()},
-    strata_{strata},
-    stratumCount_{strata_.rows() == 0 ? static_cast<size_t>(0) : static_cast<size_t>(strata_.maxCoeff()) + 1},
-    sampleCountsByStratum_(initSampleCountsByStratum())
+    bundles_{initBundles_()}
 {
 }
 
-// The next function creates a list of sorted samples for each variable.
-// These lists are then used by initSortedSamplesFast_() and initSortedSamples_().
+// the list of sorted samples of a variable contains the samples with non-zero values, including missing values,
+// and the samples with non-zero non-missing values are sorted
+// missing values are tested with std::isnan(), since the comparisons of NaN are not reliable with /fp:fast
+static inline bool isListed_(float x) { return std::isnan(x) || x != 0.0f; }
+static inline bool isSorted_(float x) { return !std::isnan(x) && x != 0.0f; }
+
+// The next two functions create a list of sorted samples for each variable.
+// The lists are stored one after the other in a single vector.
+// These lists are then used by initOrderedSamples_() and updateOrderedSampleSaveMemory_().
 
 template<typename SampleIndex>
-vector<vector<SampleIndex>> TreeTrainerImpl<SampleIndex>::initSortedSamples_() const
+vector<size_t> TreeTrainerImpl<SampleIndex>::initSortedSampleOffsets_() const
 {
-    vector<vector<SampleIndex>> sortedSamples(variableCount_);
+    // the list of variable j contains the samples with non-zero values (including missing values) of variable j
+
+    vector<size_t> sortedSampleOffsets(variableCount_ + 1);
+    sortedSampleOffsets[0] = 0;
 
     const size_t threadCount = std::min<size_t>(omp_get_max_threads(), variableCount_);
 
     BEGIN_OMP_PARALLEL(threadCount)
     {
         const size_t sampleCount = sampleCount_;
-        vector<pair<float, SampleIndex>> tmp(sampleCount);
-
         const size_t threadId = omp_get_thread_num();
         const size_t jStart = variableCount_ * threadId / threadCount;
         const size_t jStop = variableCount_ * (threadId + 1) / threadCount;
 
-        for (size_t j = jStart; j != jStop; ++j) {
-
-            const float* pInDataColJ = std::data(inData_.col(j));
-            for (size_t i = 0; i != sampleCount; ++i)
-                tmp[i] = {pInDataColJ[i], static_cast<SampleIndex>(i)};
-            pdqsort_branchless(begin(tmp), end(tmp), ::firstLess);
+        vector<float> pairValues;
 
-            sortedSamples[j].resize(sampleCount);
-            SampleIndex* pSortedSamplesJ = data(sortedSamples[j]);
+        for (size_t j = jStart; j != jStop; ++j) {
+            const float* pInDataColJ = variableValues_(j, &pairValues);
+            size_t n = 0;
             for (size_t i = 0; i != sampleCount; ++i)
-                pSortedSamplesJ[i] = tmp[i].second;
+                n += isListed_(pInDataColJ[i]);
+            sortedSampleOffsets[j + 1] = n;
         }
     }
     END_OMP_PARALLEL
 
+    std::partial_sum(begin(sortedSampleOffsets), end(sortedSampleOffsets), begin(sortedSampleOffsets));
+    return sortedSampleOffsets;
+}
+
+
+// The samples are sorted with radix sort (see RadixSort.h) rather than a comparison sort.
+// The sort is stable, so samples with the same value are listed in the order of their indices.
+// If there are at least as many variables as threads, or if the variables have few samples, the threads sort different
+// variables. Otherwise the variables are sorted one at a time, with all threads working on each variable.
+
+template<typename SampleIndex>
+vector<SampleIndex> TreeTrainerImpl<SampleIndex>::initSortedSamples_() const
+{
+    vector<SampleIndex> sortedSamples(sortedSampleOffsets_.back());
+
+    const size_t maxThreadCount = omp_get_max_threads();
+    const size_t minParallelSampleCount = 1 << 16;
+
+    if (variableCount_ >= maxThreadCount || sampleCount_ < minParallelSampleCount) {
+
+        const size_t threadCount = std::min(maxThreadCount, variableCount_);
+
+        BEGIN_OMP_PARALLEL(threadCount)
+        {
+            const size_t sampleCount = sampleCount_;
+            vector<RadixSortItem<SampleIndex>> items(sampleCount);
+            vector<RadixSortItem<SampleIndex>> buffer(sampleCount);
+            vector<float> pairValues;
+
+            const size_t threadId = omp_get_thread_num();
+            const size_t jStart = variableCount_ * threadId / threadCount;
+            const size_t jStop = variableCount_ * (threadId + 1) / threadCount;
+
+            for (size_t j = jStart; j != jStop; ++j) {
+
+                // the samples with zero values are left out
+                // the samples with missing values (NaN) are not sorted, they are placed last
+
+                const float* pInDataColJ = variableValues_(j, &pairValues);
+                size_t n = 0;   // number of samples with non-zero non-missing values
+                for (size_t i = 0; i != sampleCount; ++i) {
+                    const float x = pInDataColJ[i];
+                    items[n] = {radixSortKey(x), static_cast<SampleIndex>(i)};
+                    n += isSorted_(x);
+                }
+
+                SampleIndex* pSortedSamplesJ = data(sortedSamples) + sortedSampleOffsets_[j];
+                radixSort(n, data(items), data(buffer), pSortedSamplesJ);
+
+                const size_t m = sortedSampleOffsets_[j + 1] - sortedSampleOffsets_[j];   // including missing values
+                for (size_t i = 0; n != m; ++i) {
+                    if (std::isnan(pInDataColJ[i]))
+                        pSortedSamplesJ[n++] = static_cast<SampleIndex>(i);
+                }
+            }
+        }
+        END_OMP_PARALLEL
+    }
+
+    else {
+
+        const size_t sampleCount = sampleCount_;
+        const size_t threadCount = maxThreadCount;
+        vector<RadixSortItem<SampleIndex>> items(sampleCount);
+        vector<RadixSortItem<SampleIndex>> buffer(sampleCount);
+        vector<float> pairValues;
+        vector<size_t> chunkOffsets(threadCount + 1);
+        vector<size_t> chunkMissingOffsets(threadCount + 1);
+
+        for (size_t j = 0; j != variableCount_; ++j) {
+
+            // as above, but each thread processes a chunk of samples;
+            // first count the samples with non-zero non-missing values and with missing values in each chunk
+
+            const float* pInDataColJ = variableValues_(j, &pairValues);
+
+            BEGIN_OMP_PARALLEL(threadCount)
+            {
+                const size_t threadId = omp_get_thread_num();
+                const size_t iStart = sampleCount * threadId / threadCount;
+                const size_t iStop = sampleCount * (threadId + 1) / threadCount;
+                size_t n = 0;
+                size_t nMissing = 0;
+                for (size_t i = iStart; i != iStop; ++i) {
+                    const float x = pInDataColJ[i];
+                    n += isSorted_(x);
+                    nMissing += std::isnan(x);
+                }
+                chunkOffsets[threadId + 1] = n;
+                chunkMissingOffsets[threadId + 1] = nMissing;
+            }
+            END_OMP_PARALLEL
+
+            std::partial_sum(begin(chunkOffsets), end(chunkOffsets), begin(chunkOffsets));
+            std::partial_sum(begin(chunkMissingOffsets), end(chunkMissingOffsets), begin(chunkMissingOffsets));
+            const size_t n = chunkOffsets.back();   // number of samples with non-zero non-missing values
+            SampleIndex* pSortedSamplesJ = data(sortedSamples) + sortedSampleOffsets_[j];
+
+            BEGIN_OMP_PARALLEL(threadCount)
+            {
+                const size_t threadId = omp_get_thread_num();
+                const size_t iStart = sampleCount * threadId / threadCount;
+                const size_t iStop = sampleCount * (threadId + 1) / threadCount;
+                RadixSortItem<SampleIndex>* pItems = data(items) + chunkOffsets[threadId];
+                SampleIndex* pMissing = pSortedSamplesJ + n + chunkMissingOffsets[threadId];
+                for (size_t i = iStart; i != iStop; ++i) {
+                    // not branchfree as above, since that would write past the end of the chunk
+                    const float x = pInDataColJ[i];
+                    if (isSorted_(x))
+                        *pItems++ = {radixSortKey(x), static_cast<SampleIndex>(i)};
+                    else if (std::isnan(x))
+                        *pMissing++ = static_cast<SampleIndex>(i);
+                }
+            }
+            END_OMP_PARALLEL
+
+            parallelRadixSort(n, data(items), data(buffer), pSortedSamplesJ, threadCount);
+        }
+    }
+
     return sortedSamples;
 }
 
 
+// The next function bundles consecutive variables together as long as the lists of sorted samples of a bundle
+// have at most sampleCount_ entries in total. Thus dense variables are not bundled, while sparse variables,
+// such as the mutually exclusive 0/1 variables created by one-hot encoding, are.
+// Each bundle is processed as a unit by the inner threads, with the samples of all its used variables
+// ordered in a single pass, so the overhead per variable is small for wide sparse data.
+// The splits are still found, and expressed, in terms of the individual variables.
+
+template<typename SampleIndex>
+vector<size_t> TreeTrainerImpl<SampleIndex>::initBundles_() const
+{
+    vector<size_t> bundles{0};
+    size_t n = 0;   // number of entries in the lists of the current bundle
+    for (size_t j = 0; j != variableCount_; ++j) {
+        const size_t m = sortedSampleOffsets_[j + 1] - sortedSampleOffsets_[j];
+        if (j != bundles.back() && n + m > sampleCount_) {
+            bundles.push_back(j);
+            n = 0;
+        }
+        n += m;
+    }
+    if (variableCount_ != 0)
+        bundles.push_back(variableCount_);
+    return bundles;
+}
+
+
+template<typename SampleIndex>
+inline const float* TreeTrainerImpl<SampleIndex>::variableValues_(size_t j, vector<float>* buffer) const
+{
+    const size_t inputVariableCount = size(inDataColumns_);
+    if (j < inputVariableCount)
+        return inDataColumns_[j];
+    buffer->resize(sampleCount_);
+    pairs_.values(j - inputVariableCount, inDataColumns_, sampleCount_, data(*buffer));
+    return data(*buffer);
+}
+
 template<typename SampleIndex>
-vector<size_t> TreeTrainerImpl<SampleIndex>::initSampleCountsByStratum() const
+inline float TreeTrainerImpl<SampleIndex>::variableValue_(size_t i, size_t j) const
 {
-    ASSERT(static_cast<size_t>(strata_.rows()) == sampleCount_);
-    vector<size_t> n(stratumCount_, 0);
-    for (size_t z : strata_)
-        ++n[z];
-    return n;
+    const size_t inputVariableCount = size(inDataColumns_);
+    if (j < inputVariableCount)
+        return inDataColumns_[j][i];
+    const size_t k = j - inputVariableCount;
+    return pairs_.value(k, inDataColumns_[pairs_.variable1(k)][i], inDataColumns_[pairs_.variable2(k)][i]);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
 
 template<typename SampleIndex>
 unique_ptr<BasePredictor> TreeTrainerImpl<SampleIndex>::trainImpl0_(
-    CRefXd outData, CRefXd weights, const BaseOptions& options, size_t threadCount) const
+    CRefXd outData, CRefXd weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const
 {
     size_t ITEM_COUNT = 0;
     ScopedProfiler sp(PROFILE::TREE_TRAIN, &ITEM_COUNT);
@@ -140,46 +317,128 @@ unique_ptr<BasePredictor> TreeTrainerImpl<SampleIndex>::trainImpl0_(
     // validateData_(CRefXd outData, CRefXd weights);
     // ITEM_COUNT = sampleCount_;
 
-    initTree_();
-
-    const size_t usedVariableCount = usedVariableCount_(options);
-
     if (threadCount == 0 || threadCount > omp_get_max_threads())
         threadCount = omp_get_max_threads();
 
-    const TrainData_ trainData{outData, weights, options, usedVariableCount, threadCount};
+    const WyPack* pWyPacks = initWyPacks_(outData, weights, options);
+    const TrainData_ trainData{
+        outData, weights, strata, options, usedVariableCount_(options), threadCount, 0, nullptr, pWyPacks};
 
-    // The current status of a sample is 0 if it is unused and k + 1 (with k = 0, 1, ..., n - 1) if it belongs to node
-    // k. Here n is the number of nodes in the current layer of the tree. Thus 0 <= status <= the largest number of
-    // nodes in any layer of the tree. The sample status is stored as type SampleStatus which we choose as the narrowest
-    // possible unsigned integer type.
+    ITEM_COUNT = trainImpl1_(&trainData, ITEM_COUNT);
 
-    const size_t maxNodeCount   // max node count in any layer of the tree
-        = std::min<size_t>(1LL << options.maxTreeDepth(), std::max<size_t>(1, sampleCount_ / options.minNodeSize()));
+    PROFILE::SWITCH(PROFILE::FINALIZE_TREE, ITEM_COUNT);
+    ITEM_COUNT = 0;
 
-    if (maxNodeCount <= 0xff) {
-        using SampleStatus = uint8_t;
-        ITEM_COUNT = trainImpl1_<SampleStatus>(&trainData, ITEM_COUNT);
-    }
-    else if (maxNodeCount <= 0xffff) {
-        using SampleStatus = uint16_t;
-        ITEM_COUNT = trainImpl1_<SampleStatus>(&trainData, ITEM_COUNT);
-    }
-    else if (maxNodeCount <= 0xffffffff) {
-        using SampleStatus = uint32_t;
-        ITEM_COUNT = trainImpl1_<SampleStatus>(&trainData, ITEM_COUNT);
+    finalizeTree_();
+    const TreeNodeExt* root = data(threadLocalData0_.tree.front());
+    return TreePredictor::createInstance(root);
+}
+
+
+// Trains several trees with the same splits. The samples, the sorted sublists and the sample status are the same for
+// all the trees, so the only extra work for each tree is in the node trainers (see MultiTreeNodeTrainer.h).
+// The sums w and w * y of each tree are kept for each node in t0.classSums and give the leaf values of each tree.
+
+template<typename SampleIndex>
+vector<unique_ptr<BasePredictor>> TreeTrainerImpl<SampleIndex>::trainMultiImpl0_(
+    CRefXXdc outData, CRefXXdc weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const
+{
+    size_t ITEM_COUNT = 0;
+    ScopedProfiler sp(PROFILE::TREE_TRAIN, &ITEM_COUNT);
+
+    ASSERT(static_cast<size_t>(outData.rows()) == sampleCount_ && static_cast<size_t>(weights.rows()) == sampleCount_);
+    ASSERT(outData.cols() == weights.cols() && outData.cols() != 0);
+
+    ThreadLocalData0_& t0 = threadLocalData0_;
+
+    const size_t sampleCount = sampleCount_;
+    const size_t classCount = static_cast<size_t>(outData.cols());
+    const size_t n = 2 * classCount;
+
+    t0.classData.resize(sampleCount * n);
+    for (size_t q = 0; q != classCount; ++q) {
+        const double* pOutData = outData.col(q).data();
+        const double* pWeights = weights.col(q).data();
+        double* pClassData = data(t0.classData) + 2 * q;
+        for (size_t i = 0; i != sampleCount; ++i) {
+            const double w = pWeights[i];
+            const double y = pOutData[i];
+            pClassData[i * n] = w;
+            pClassData[i * n + 1] = w * y;
+        }
     }
-    else {
-        using SampleStatus = uint64_t;
-        ITEM_COUNT = trainImpl1_<SampleStatus>(&trainData, ITEM_COUNT);
+
+    t0.totalWeights.assign(sampleCount, 0.0);
+    for (size_t i = 0; i != sampleCount; ++i) {
+        for (size_t q = 0; q != classCount; ++q)
+            t0.totalWeights[i] += t0.classData[i * n + 2 * q];
     }
+    const Eigen::Map<const ArrayXd> totalWeights(data(t0.totalWeights), sampleCount);
+
+    if (threadCount == 0 || threadCount > omp_get_max_threads())
+        threadCount = omp_get_max_threads();
+
+    const TrainData_ trainData{
+        totalWeights, totalWeights, strata, options, usedVariableCount_(options), threadCount, classCount,
+        data(t0.classData), nullptr};
+
+    ITEM_COUNT = trainImpl1_(&trainData, ITEM_COUNT);
 
     PROFILE::SWITCH(PROFILE::FINALIZE_TREE, ITEM_COUNT);
     ITEM_COUNT = 0;
 
+    finalizeTree_();
+
+    // the layers and sums beyond those of the current tree are left over from earlier trees, they are not reachable
+
+    vector<unique_ptr<BasePredictor>> basePredictors(classCount);
+    for (size_t q = 0; q != classCount; ++q) {
+        for (size_t d = 0; d != std::min(size(t0.tree), size(t0.classSums)); ++d) {
+            vector<TreeNodeExt>& nodes = t0.tree[d];
+            const double* pClassSums = data(t0.classSums[d]);
+            const size_t nodeCount = std::min(size(nodes), size(t0.classSums[d]) / n);
+            for (size_t k = 0; k != nodeCount; ++k) {
+                const double sumW = pClassSums[k * n + 2 * q];
+                const double sumWY = pClassSums[k * n + 2 * q + 1];
+                nodes[k].y = (sumW == 0.0) ? 0.0f : static_cast<float>(sumWY / sumW);
+            }
+        }
+        const TreeNodeExt* root = data(t0.tree.front());
+        basePredictors[q] = TreePredictor::createInstance(root);
+    }
+    return basePredictors;
+}
+
+
+// Packs w and w * y of each sample in single precision, halving the memory traffic of the node trainers.
+// Falls back to double precision (returns nullptr) if some value does not fit in a float.
+
+template<typename SampleIndex>
+const WyPack*
+TreeTrainerImpl<SampleIndex>::initWyPacks_(CRefXd outData, CRefXd weights, const BaseOptions& options) const
+{
+    if (!options.singlePrecision())
+        return nullptr;
+
     ThreadLocalData0_& t0 = threadLocalData0_;
-    const TreeNodeExt* root = data(t0.tree.front());
-    return TreePredictor::createInstance(root);
+
+    const size_t sampleCount = sampleCount_;
+    const double* pOutData = std::data(outData);
+    const double* pWeights = std::data(weights);
+    t0.wyPacks.resize(sampleCount);
+    WyPack* pWyPacks = data(t0.wyPacks);
+
+    double maxAbs = 0.0;
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const double w = pWeights[i];
+        const double wy = w * pOutData[i];
+        pWyPacks[i] = {static_cast<float>(w), static_cast<float>(wy)};
+        maxAbs = std::max(maxAbs, std::max(std::abs(w), std::abs(wy)));
+    }
+
+    if (!(maxAbs <= numeric_limits<float>::max()))
+        return nullptr;
+    return pWyPacks;
 }
 
 
@@ -225,11 +484,55 @@ size_t TreeTrainerImpl<SampleIndex>::usedVariableCount_(const BaseOptions& optio
     return usedVariableCount;
 }
 
+
+template<typename SampleIndex>
+size_t TreeTrainerImpl<SampleIndex>::trainImpl1_(const TrainData_* trainData, size_t ITEM_COUNT) const
+{
+    initTree_();
+
+    // The current status of a sample is 0 if it is unused and k + 1 (with k = 0, 1, ..., n - 1) if it belongs to node
+    // k. Here n is the number of nodes in the current layer of the tree. Thus 0 <= status <= the largest number of
+    // nodes in any layer of the tree. The sample status is stored as type SampleStatus which we choose as the narrowest
+    // possible unsigned integer type.
+
+    const BaseOptions& options = trainData->options;
+    const size_t maxNodeCount   // max node count in any layer of the tree
+        = std::min<size_t>(1LL << options.maxTreeDepth(), std::max<size_t>(1, sampleCount_ / options.minNodeSize()));
+
+    if (maxNodeCount <= 0xff) {
+        using SampleStatus = uint8_t;
+        return trainImpl2_<SampleStatus>(trainData, ITEM_COUNT);
+    }
+    else if (maxNodeCount <= 0xffff) {
+        using SampleStatus = uint16_t;
+        return trainImpl2_<SampleStatus>(trainData, ITEM_COUNT);
+    }
+    else if (maxNodeCount <= 0xffffffff) {
+        using SampleStatus = uint32_t;
+        return trainImpl2_<SampleStatus>(trainData, ITEM_COUNT);
+    }
+    else {
+        using SampleStatus = uint64_t;
+        return trainImpl2_<SampleStatus>(trainData, ITEM_COUNT);
+    }
+}
+
+
+template<typename SampleIndex>
+void TreeTrainerImpl<SampleIndex>::finalizeTree_() const
+{
+    ThreadLocalData0_& t0 = threadLocalData0_;
+    for (vector<TreeNodeExt>& nodes : t0.tree) {
+        for (TreeNodeExt& node : nodes)
+            node.trainSampleCount = node.sampleCount;   // keep the sample counts for SHAP values
+    }
+}
+
 //.......................................................................................................................
 
 template<typename SampleIndex>
 template<typename SampleStatus>
-size_t TreeTrainerImpl<SampleIndex>::trainImpl1_(const TrainData_* trainData, size_t ITEM_COUNT) const
+size_t TreeTrainerImpl<SampleIndex>::trainImpl2_(const TrainData_* trainData, size_t ITEM_COUNT) const
 {
     PROFILE::SWITCH(PROFILE::ZERO, ITEM_COUNT);   // calibrate the profiling
     ITEM_COUNT = 0;
@@ -237,6 +540,8 @@ size_t TreeTrainerImpl<SampleIndex>::trainImpl1_(const TrainData_* trainData, si
     PROFILE::SWITCH(PROFILE::INIT_SAMPLE_STATUS, ITEM_COUNT);
     ITEM_COUNT = sampleCount_;
     size_t usedSampleCount = initSampleStatus_<SampleStatus>(trainData);
+    if (trainData->classCount != 0)
+        initClassSums_<SampleStatus>(trainData, 0);
 
     if (trainData->usedVariableCount == 0)
         // initsampleStatus_() sets y in the root
@@ -268,6 +573,8 @@ size_t TreeTrainerImpl<SampleIndex>::trainImpl1_(const TrainData_* trainData, si
         PROFILE::SWITCH(PROFILE::UPDATE_SAMPLE_STATUS, ITEM_COUNT);
         ITEM_COUNT = sampleCount_;
         updateSampleStatus_<SampleStatus>(trainData, d);
+        if (trainData->classCount != 0)
+            initClassSums_<SampleStatus>(trainData, d + 1);
 
     }   // end d loop
 
@@ -327,16 +634,17 @@ size_t TreeTrainerImpl<SampleIndex>::initSampleStatus_(const TrainData_* trainDa
         }
 
         else {
-            const uint8_t* pStrata = std::data(strata_);
+            const uint8_t* pStrata = std::data(trainData->strata);
 
             // n[z] number of samples in stratum z
             // m[z] number of used samples in stratum z
             array<size_t, 256> n;
             array<size_t, 256> m;
-            for (size_t z = 0; z != stratumCount_; ++z) {
-                n[z] = sampleCountsByStratum_[z];
+            std::fill(begin(n), end(n), static_cast<size_t>(0));
+            for (size_t i = 0; i != sampleCount; ++i)
+                ++n[pStrata[i]];
+            for (size_t z = 0; z != 256; ++z)
                 m[z] = static_cast<size_t>(std::round(trainData->options.usedSampleRatio() * n[z]));
-            }
 
             // for each z, randomly select m[z] of n[z] samples in stratum z
             for (size_t i = 0; i != sampleCount; ++i) {
@@ -346,7 +654,7 @@ size_t TreeTrainerImpl<SampleIndex>::initSampleStatus_(const TrainData_* trainDa
                 m[z] -= s;
                 --n[z];
             }
-            ASSERT(accumulate(begin(m), begin(m) + stratumCount_, static_cast<size_t>(0)) == 0);
+            ASSERT(accumulate(begin(m), end(m), static_cast<size_t>(0)) == 0);
         }
     }
 
@@ -392,13 +700,12 @@ size_t TreeTrainerImpl<SampleIndex>::initSampleStatus_(const TrainData_* trainDa
         }
 
         else {
-            const uint8_t* pStrata = std::data(strata_);
+            const uint8_t* pStrata = std::data(trainData->strata);
 
             // store all samples with weight >= min sample weight in sample buffer
             // n[z] = number of samples in stratum z with weight >= min sample weight
             array<size_t, 256> n;
-            for (size_t z = 0; z != stratumCount_; ++z)
-                n[z] = 0;
+            std::fill(begin(n), end(n), static_cast<size_t>(0));
             t1.sampleBuffer.resize(sampleCount);
             SampleIndex* p = data(t1.sampleBuffer);
             for (size_t i = 0; i != sampleCount; ++i) {
@@ -412,7 +719,7 @@ size_t TreeTrainerImpl<SampleIndex>::initSampleStatus_(const TrainData_* trainDa
 
             // m[z] = number of used samples in stratum z
             array<size_t, 256> m;
-            for (size_t z = 0; z != stratumCount_; ++z)
+            for (size_t z = 0; z != 256; ++z)
                 m[z] = static_cast<size_t>(std::round(trainData->options.usedSampleRatio() * n[z]));
 
             // for each z, randomly select m[z] of n[z] samples with weight >= min sample weight in stratum z
@@ -424,7 +731,7 @@ size_t TreeTrainerImpl<SampleIndex>::initSampleStatus_(const TrainData_* trainDa
                 m[z] -= s;
                 --n[z];
             }
-            ASSERT(accumulate(begin(m), begin(m) + stratumCount_, static_cast<size_t>(0)) == 0);
+            ASSERT(accumulate(begin(m), end(m), static_cast<size_t>(0)) == 0);
         }
 
     }   // end minSampleWeight == 0.0
@@ -436,15 +743,11 @@ size_t TreeTrainerImpl<SampleIndex>::initSampleStatus_(const TrainData_* trainDa
     double sumW = 0.0;
     double sumWY = 0.0;
 
-    const double* pOutData = std::data(trainData->outData);
-    const double* pWeights = std::data(trainData->weights);
     for (size_t i = 0; i != sampleCount; ++i) {
         SampleStatus s = pSampleStatus[i];
-        const double w = pWeights[i];
-        const double y = pOutData[i];
         usedSampleCount += s;
-        sumW += s * w;
-        sumWY += s * w * y;
+        sumW += s * trainData->w(i);
+        sumWY += s * trainData->wy(i);
     }
 
     TreeNodeExt* root = data(t0.tree.front());
@@ -476,9 +779,6 @@ template<typename SampleIndex>
 template<typename SampleStatus>
 void TreeTrainerImpl<SampleIndex>::updateSampleStatusNoThreads_(const TrainData_* trainData, size_t d) const
 {
-    const double* pOutData = std::data(trainData->outData);
-    const double* pWeights = std::data(trainData->weights);
-
     ThreadLocalData0_& t0 = threadLocalData0_;
     ThreadLocalData2_<SampleStatus>& t2 = threadLocalData2_<SampleStatus>;
 
@@ -505,17 +805,15 @@ void TreeTrainerImpl<SampleIndex>::updateSampleStatusNoThreads_(const TrainData_
             pSampleStatus[i] = 0;
             continue;
         }
-        TreeNodeExt* pChildNode = (inData_(i, pParentNode->j) < pParentNode->x)
+        TreeNodeExt* pChildNode = TreeTools::goesLeft(pParentNode, variableValue_(i, pParentNode->j))
                                       ? static_cast<TreeNodeExt*>(pParentNode->leftChild)
                                       : static_cast<TreeNodeExt*>(pParentNode->rightChild);
         const SampleStatus s2 = static_cast<SampleStatus>((pChildNode - pChildNodes) + 1);
         pSampleStatus[i] = s2;
 
         ++pChildNode->sampleCount;
-        const double w = pWeights[i];
-        const double y = pOutData[i];
-        pChildNode->sumW += w;
-        pChildNode->sumWY += w * y;
+        pChildNode->sumW += trainData->w(i);
+        pChildNode->sumWY += trainData->wy(i);
     }
 
     for (TreeNodeExt& childNode : childNodes)
@@ -528,10 +826,6 @@ template<typename SampleStatus>
 void TreeTrainerImpl<SampleIndex>::updateSampleStatusThreaded_(
     const TrainData_* trainData, size_t d, size_t threadCount) const
 {
-
-    const double* pOutData = std::data(trainData->outData);
-    const double* pWeights = std::data(trainData->weights);
-
     ThreadLocalData0_& t0 = threadLocalData0_;
     ThreadLocalData2_<SampleStatus>& t2 = threadLocalData2_<SampleStatus>;
 
@@ -564,7 +858,7 @@ void TreeTrainerImpl<SampleIndex>::updateSampleStatusThreaded_(
                 pSampleStatus[i] = 0;
                 continue;
             }
-            const TreeNodeExt* pChildNode = (inData_(i, pParentNode->j) < pParentNode->x)
+            const TreeNodeExt* pChildNode = TreeTools::goesLeft(pParentNode, variableValue_(i, pParentNode->j))
                                                 ? static_cast<TreeNodeExt*>(pParentNode->leftChild)
                                                 : static_cast<TreeNodeExt*>(pParentNode->rightChild);
             const SampleStatus s2 = static_cast<SampleStatus>((pChildNode - pChildNodes) + 1);
@@ -572,10 +866,8 @@ void TreeTrainerImpl<SampleIndex>::updateSampleStatusThreaded_(
 
             TreeNodeData* pNodeData = pTreeData + (s2 - 1);
             ++pNodeData->sampleCount;
-            const double w = pWeights[i];
-            const double y = pOutData[i];
-            pNodeData->sumW += w;
-            pNodeData->sumWY += w * y;
+            pNodeData->sumW += trainData->w(i);
+            pNodeData->sumWY += trainData->wy(i);
         }
     }
     END_OMP_PARALLEL
@@ -598,6 +890,38 @@ void TreeTrainerImpl<SampleIndex>::updateSampleStatusThreaded_(
 }
 
 
+// The next function calculates the sums w and w * y of each tree for each node in layer d
+// when training several trees with the same splits (see trainMultiImpl0_()).
+
+template<typename SampleIndex>
+template<typename SampleStatus>
+void TreeTrainerImpl<SampleIndex>::initClassSums_(const TrainData_* trainData, size_t d) const
+{
+    ThreadLocalData0_& t0 = threadLocalData0_;
+    ThreadLocalData2_<SampleStatus>& t2 = threadLocalData2_<SampleStatus>;
+
+    const size_t n = 2 * trainData->classCount;
+    const size_t nodeCount = size(t0.tree[d]);
+    t0.classSums.resize(std::max(d + 1, size(t0.classSums)));
+    t0.classSums[d].assign(nodeCount * n, 0.0);
+    double* pClassSums = data(t0.classSums[d]);
+
+    const SampleStatus* pSampleStatus = data(t2.sampleStatus);
+    const double* pClassData = trainData->pClassData;
+
+    const size_t sampleCount = sampleCount_;
+    for (size_t i = 0; i != sampleCount; ++i) {
+        const SampleStatus s = pSampleStatus[i];
+        if (s == 0)
+            continue;
+        double* pNodeSums = pClassSums + (s - 1) * n;
+        const double* pWy = pClassData + i * n;
+        for (size_t r = 0; r != n; ++r)
+            pNodeSums[r] += pWy[r];
+    }
+}
+
+
 template<typename SampleIndex>
 size_t TreeTrainerImpl<SampleIndex>::initUsedVariables_(const TrainData_* trainData) const
 {
@@ -622,9 +946,26 @@ size_t TreeTrainerImpl<SampleIndex>::initUsedVariables_(const TrainData_* trainD
         ++j;
     }
 
+    // group the used variables by bundle
+
+    t0.usedBundleOffsets.clear();
+    size_t b = 0;
+    for (size_t k = 0; k != trainData->usedVariableCount; ++k) {
+        const size_t usedVariable = t0.usedVariables[k];
+        if (k != 0 && usedVariable < bundles_[b + 1])
+            continue;
+        while (usedVariable >= bundles_[b + 1])
+            ++b;
+        t0.usedBundleOffsets.push_back(k);
+    }
+    t0.usedBundleOffsets.push_back(trainData->usedVariableCount);
+
     if (!trainData->options.saveMemory() && !trainData->options.selectVariablesByLevel()
-        && trainData->options.maxTreeDepth() != 1)
-        t1.orderedSamplesByVariable.resize(std::max(trainData->usedVariableCount, size(t1.orderedSamplesByVariable)));
+        && trainData->options.maxTreeDepth() != 1) {
+        const size_t n = std::max(size(t0.usedBundleOffsets) - 1, size(t1.orderedSamplesByBundle));
+        t1.orderedSamplesByBundle.resize(n);
+        t1.orderedSampleBlocksByBundle.resize(n);
+    }
 
     return j;   // number of iterations of the loop
 }
@@ -638,6 +979,22 @@ void TreeTrainerImpl<SampleIndex>::initNodeTrainers_(const TrainData_* trainData
 
     const vector<TreeNodeExt>& parentNodes = t0.tree[d];
     const size_t parentNodeCount = size(parentNodes);
+
+    if (trainData->classCount != 0) {
+        const size_t classCount = trainData->classCount;
+        const double* pClassSums = data(t0.classSums[d]);
+        t1.multiTreeNodeTrainers.resize(trainData->threadCount * parentNodeCount);
+        for (size_t k = 0; k != parentNodeCount; ++k)
+            t1.multiTreeNodeTrainers[k].init(
+                parentNodes[k], pClassSums + k * 2 * classCount, classCount, trainData->options);
+        for (size_t threadIndex = 1; threadIndex != trainData->threadCount; ++threadIndex) {
+            const size_t k0 = threadIndex * parentNodeCount;
+            for (size_t k = 0; k != parentNodeCount; ++k)
+                t1.multiTreeNodeTrainers[k].fork(&t1.multiTreeNodeTrainers[k0 + k]);
+        }
+        return;
+    }
+
     t1.treeNodeTrainers.resize(trainData->threadCount * parentNodeCount);
 
     for (size_t k = 0; k != parentNodeCount; ++k)
@@ -665,12 +1022,6 @@ size_t TreeTrainerImpl<SampleIndex>::finalizeNodeTrainers_(const TrainData_* tra
     vector<TreeNodeExt>& parentNodes = t0.tree[d];
     const size_t parentNodeCount = size(parentNodes);
 
-    for (size_t threadIndex = 1; threadIndex != trainData->threadCount; ++threadIndex) {
-        const size_t k0 = threadIndex * parentNodeCount;
-        for (size_t k = 0; k != parentNodeCount; ++k)
-            t1.treeNodeTrainers[k].join(t1.treeNodeTrainers[k0 + k]);
-    }
-
     vector<TreeNodeExt>& childNodes = t0.tree[d + 1];
     const size_t maxChildNodeCount = 2 * parentNodeCount;
     childNodes.resize(maxChildNodeCount);
@@ -678,8 +1029,31 @@ size_t TreeTrainerImpl<SampleIndex>::finalizeNodeTrainers_(const TrainData_* tra
     size_t usedSampleCount = 0;
     TreeNodeExt* pParentNode = data(parentNodes);
     TreeNodeExt* pChildNode = data(childNodes);
-    for (size_t k = 0; k != parentNodeCount; ++k)
-        usedSampleCount += t1.treeNodeTrainers[k].finalize(&pParentNode, &pChildNode);
+
+    if (trainData->classCount == 0) {
+        for (size_t threadIndex = 1; threadIndex != trainData->threadCount; ++threadIndex) {
+            const size_t k0 = threadIndex * parentNodeCount;
+            for (size_t k = 0; k != parentNodeCount; ++k)
+                t1.treeNodeTrainers[k].join(t1.treeNodeTrainers[k0 + k]);
+        }
+        for (size_t k = 0; k != parentNodeCount; ++k)
+            usedSampleCount += t1.treeNodeTrainers[k].finalize(&pParentNode, &pChildNode);
+    }
+
+    else {
+        for (size_t threadIndex = 1; threadIndex != trainData->threadCount; ++threadIndex) {
+            const size_t k0 = threadIndex * parentNodeCount;
+            for (size_t k = 0; k != parentNodeCount; ++k)
+                t1.multiTreeNodeTrainers[k].join(t1.multiTreeNodeTrainers[k0 + k]);
+        }
+        t0.classSums.resize(std::max(d + 2, size(t0.classSums)));
+        vector<double>& childSums = t0.classSums[d + 1];
+        childSums.resize(maxChildNodeCount * 2 * trainData->classCount);
+        double* pChildSums = data(childSums);
+        for (size_t k = 0; k != parentNodeCount; ++k)
+            usedSampleCount += t1.multiTreeNodeTrainers[k].finalize(&pParentNode, &pChildNode, &pChildSums);
+        childSums.resize(pChildSums - data(childSums));
+    }
 
     const size_t childNodeCount = pChildNode - data(childNodes);
     childNodes.resize(childNodeCount);
@@ -694,7 +1068,9 @@ template<typename SampleStatus>
 size_t TreeTrainerImpl<SampleIndex>::updateNodeTrainers1_(
     const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t ITEM_COUNT) const
 {
-    const size_t threadCount = std::min(trainData->threadCount, std::max<size_t>(1, trainData->usedVariableCount));
+    ThreadLocalData0_& t0 = threadLocalData0_;
+    const size_t usedBundleCount = size(t0.usedBundleOffsets) - 1;
+    const size_t threadCount = std::min(trainData->threadCount, std::max<size_t>(1, usedBundleCount));
     if (threadCount == 1)
         ITEM_COUNT = updateNodeTrainers1Nothreads_<SampleStatus>(trainData, d, usedSampleCount, ITEM_COUNT);
     else
@@ -717,10 +1093,11 @@ size_t TreeTrainerImpl<SampleIndex>::updateNodeTrainers1Nothreads_(
     t2.parent = &t2;
 
     const size_t threadIndex = 0;
+    const size_t usedBundleCount = size(t0.usedBundleOffsets) - 1;
 
-    for (size_t usedVariableIndex = 0; usedVariableIndex != trainData->usedVariableCount; ++usedVariableIndex)
+    for (size_t usedBundleIndex = 0; usedBundleIndex != usedBundleCount; ++usedBundleIndex)
         ITEM_COUNT = updateNodeTrainers2_<SampleStatus>(
-            trainData, d, usedSampleCount, usedVariableIndex, threadIndex, ITEM_COUNT);
+            trainData, d, usedSampleCount, usedBundleIndex, threadIndex, ITEM_COUNT);
 
     t0.parent = nullptr;
     t1.parent = nullptr;
@@ -742,7 +1119,8 @@ size_t TreeTrainerImpl<SampleIndex>::updateNodeTrainers1Threaded_(
     ThreadLocalData2_<SampleStatus>& outerT2 = threadLocalData2_<SampleStatus>;
 
 
-    std::atomic<size_t> nextUsedVariableIndex = 0;
+    const size_t usedBundleCount = size(outerT0.usedBundleOffsets) - 1;
+    std::atomic<size_t> nextUsedBundleIndex = 0;
     // std::cout << threadCount << std::endl;
     BEGIN_OMP_PARALLEL(threadCount)
     {
@@ -763,12 +1141,12 @@ size_t TreeTrainerImpl<SampleIndex>::updateNodeTrainers1Threaded_(
         innerT2.parent = &outerT2;
 
         while (true) {
-            const size_t usedVariableIndex = nextUsedVariableIndex++;
-            if (usedVariableIndex >= trainData->usedVariableCount)
+            const size_t usedBundleIndex = nextUsedBundleIndex++;
+            if (usedBundleIndex >= usedBundleCount)
                 break;
 
             INNER_ITEM_COUNT = updateNodeTrainers2_<SampleStatus>(
-                trainData, d, usedSampleCount, usedVariableIndex, threadIndex, INNER_ITEM_COUNT);
+                trainData, d, usedSampleCount, usedBundleIndex, threadIndex, INNER_ITEM_COUNT);
 
             PROFILE::SWITCH(PROFILE::TREE_TRAIN, INNER_ITEM_COUNT);
             INNER_ITEM_COUNT = 0;
@@ -792,63 +1170,69 @@ size_t TreeTrainerImpl<SampleIndex>::updateNodeTrainers1Threaded_(
 template<typename SampleIndex>
 template<typename SampleStatus>
 size_t TreeTrainerImpl<SampleIndex>::updateNodeTrainers2_(
-    const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedVariableIndex, size_t threadIndex,
+    const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedBundleIndex, size_t threadIndex,
     size_t ITEM_COUNT) const
 {
     if (d == 0) {
         PROFILE::SWITCH(PROFILE::INIT_ORDERED_SAMPLES, ITEM_COUNT);
         ITEM_COUNT = sampleCount_;
-        initOrderedSamples_<SampleStatus>(trainData, d, usedSampleCount, usedVariableIndex);
+        initOrderedSamples_<SampleStatus>(trainData, d, usedSampleCount, usedBundleIndex);
     }
     else if (trainData->options.saveMemory() || trainData->options.selectVariablesByLevel()) {
         PROFILE::SWITCH(PROFILE::UPDATE_ORDERED_SAMPLES, ITEM_COUNT);
         ITEM_COUNT = sampleCount_;
-        updateOrderedSampleSaveMemory_<SampleStatus>(trainData, d, usedSampleCount, usedVariableIndex);
+        updateOrderedSampleSaveMemory_<SampleStatus>(trainData, d, usedSampleCount, usedBundleIndex);
     }
     else {
         PROFILE::SWITCH(PROFILE::UPDATE_ORDERED_SAMPLES, ITEM_COUNT);
         ITEM_COUNT = usedSampleCount;
-        updateOrderedSamples_<SampleStatus>(trainData, d, usedSampleCount, usedVariableIndex);
+        updateOrderedSamples_<SampleStatus>(trainData, d, usedSampleCount, usedBundleIndex);
     }
 
     PROFILE::SWITCH(PROFILE::UPDATE_SPLITS, ITEM_COUNT);
     ITEM_COUNT = usedSampleCount;
-    updateNodeTrainers3_(trainData, d, usedVariableIndex, threadIndex);
+    updateNodeTrainers3_(trainData, d, usedBundleIndex, threadIndex);
 
     return ITEM_COUNT;
 }
 
 
-// The following three functions update the vectors t1.sampleBuffer and t1.orderedSampleBlocks.
-// The vector t1.sampleBuffer contains all samples that are used in layer d of the tree.
+// The following three functions update the vectors t1.sampleBuffer and t1.orderedSampleBlocks
+// for the used variables j_0, j_1, ..., j_{m-1} of a bundle.
+// The vector t1.sampleBuffer contains all samples that are used in layer d of the tree
+// and have non-zero values of one of these variables (a sample may occur once for each variable).
 // The vector is divided into blocks. For each  k = 0, 1, ..., nodeCount-1,
 // block number k contains the samples that belong to node k in layer d of the tree.
-// Each block is sorted according to variable j.
-// The vector t1.orderedSampleBlocks contains pointers to the beginning of each block.
+// Each block is in turn divided into m segments, where segment r contains the samples with non-zero values
+// of variable j_r, sorted according to variable j_r.
+// The vector t1.orderedSampleBlocks contains m + 1 pointers for each block:
+// the pointers to the beginning of each segment and a pointer to the end of the block.
 // This vector is then used by updateNodeTrainers_().
 //
 // The function initOrderedSamples_ does this for layer 0, i.e. the root.
-// It copies samples from sortedSamples_[j] which contains all samples sorted according to variable j,
-// discards the unused samples and places the used ones in a single block
+// It copies samples from the lists in sortedSamples_ which contain all samples with non-zero values sorted according
+// to each variable, discards the unused samples and places the used ones in a single block
 //
 // The function initOrderedSamples_ does this for any layer of depth d >= 0.
-// It also copies samples from sortedSamples_[j] and distrubtes them in order in several blocks.
+// It also copies samples from the lists in sortedSamples_ and distrubtes them in order in several blocks.
 // In addition to one block for each node, it also creates an initial block with the unused samples.
 //
 // The function updateOrderedSamples_() also does this does for any layer of depth >= 1.
-// But instead of copying the samples from sortedSamples_[j] it uses the ordered samples for the previous layer.
+// But instead of copying the samples from sortedSamples_ it uses the ordered samples for the previous layer.
 // It discards the unused samples and distributes the used samples in several blocks, one for each node.
 // This is faster but requires more memory and only works if the same variables are used for each layer of the tree.
 //
 // (The code uses a branchfree conditional copy implementation that may overwrite the blocks by one element.
 // Therefore we adding a dummy element after the sample block in initOrderedSamples_()
-// and a dummy element after each block in updateOrderedSamples_().)
+// and a dummy element after each block in updateOrderedSamples_().
+// Since the sizes of the blocks are not known in advance in updateOrderedSamples_(), each block gets room for
+// the smaller of the sample count of the node and the size of the parent block.)
 
 
 template<typename SampleIndex>
 template<typename SampleStatus>
 void TreeTrainerImpl<SampleIndex>::initOrderedSamples_(
-    const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedVariableIndex) const
+    const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedBundleIndex) const
 {
     // called from the inner threads so be careful to distinguish between t0 and t0.parent etc.
 
@@ -858,32 +1242,48 @@ void TreeTrainerImpl<SampleIndex>::initOrderedSamples_(
     ThreadLocalData1_<SampleIndex>& t1 = threadLocalData1_<SampleIndex>;
     ThreadLocalData2_<SampleStatus>& t2 = threadLocalData2_<SampleStatus>;
 
-    const size_t j = t0.parent->usedVariables[usedVariableIndex];
+    const size_t* pUsedVariables = data(t0.parent->usedVariables) + t0.parent->usedBundleOffsets[usedBundleIndex];
+    const size_t m = t0.parent->usedBundleOffsets[usedBundleIndex + 1] - t0.parent->usedBundleOffsets[usedBundleIndex];
     const SampleStatus* pSampleStatus = data(t2.parent->sampleStatus);
 
-    t1.sampleBuffer.resize(usedSampleCount + 1 /*dummy*/);
+    size_t bufferSize = 1 /*dummy*/;
+    for (size_t r = 0; r != m; ++r) {
+        const size_t j = pUsedVariables[r];
+        bufferSize += std::min(usedSampleCount, sortedSampleOffsets_[j + 1] - sortedSampleOffsets_[j]);
+    }
+    t1.sampleBuffer.resize(bufferSize);
     SampleIndex* pOrderedSamples = data(t1.sampleBuffer);
 
-    for (SampleIndex i : sortedSamples_[j]) {
-        *pOrderedSamples = i;
-        const SampleStatus s = pSampleStatus[i];   // s = 0 (unused) or 1 (used, and hence belongs to the root)
-        pOrderedSamples += s;
+    t1.orderedSampleBlocks.resize(m + 1);
+    SampleIndex** pOrderedSampleBlocks = data(t1.orderedSampleBlocks);
+
+    for (size_t r = 0; r != m; ++r) {
+        pOrderedSampleBlocks[r] = pOrderedSamples;
+        const size_t j = pUsedVariables[r];
+        const SampleIndex* pSortedSamplesEnd = data(sortedSamples_) + sortedSampleOffsets_[j + 1];
+        for (const SampleIndex* p = data(sortedSamples_) + sortedSampleOffsets_[j]; p != pSortedSamplesEnd; ++p) {
+            const SampleIndex i = *p;
+            *pOrderedSamples = i;
+            const SampleStatus s = pSampleStatus[i];   // s = 0 (unused) or 1 (used, and hence belongs to the root)
+            pOrderedSamples += s;
+        }
     }
+    pOrderedSampleBlocks[m] = pOrderedSamples;
 
-    pOrderedSamples = data(t1.sampleBuffer);
     if (d + 1 != trainData->options.maxTreeDepth() && !trainData->options.saveMemory()
-        && !trainData->options.selectVariablesByLevel())
+        && !trainData->options.selectVariablesByLevel()) {
         // save the ordered samples to be used as input when ordering samples for the next layer
-        swap(t1.sampleBuffer, t1.parent->orderedSamplesByVariable[usedVariableIndex]);
-
-    t1.orderedSampleBlocks.assign(1, pOrderedSamples);
+        // (swapping the buffers does not invalidate the pointers to the blocks)
+        swap(t1.sampleBuffer, t1.parent->orderedSamplesByBundle[usedBundleIndex]);
+        t1.parent->orderedSampleBlocksByBundle[usedBundleIndex] = t1.orderedSampleBlocks;
+    }
 }
 
 
 template<typename SampleIndex>
 template<typename SampleStatus>
 void TreeTrainerImpl<SampleIndex>::updateOrderedSampleSaveMemory_(
-    const TrainData_* /*trainData*/, size_t d, size_t usedSampleCount, size_t usedVariableIndex) const
+    const TrainData_* /*trainData*/, size_t d, size_t usedSampleCount, size_t usedBundleIndex) const
 {
     // called from the inner threads so be careful to distinguish between t0 and t0.parent etc.
 
@@ -891,44 +1291,76 @@ void TreeTrainerImpl<SampleIndex>::updateOrderedSampleSaveMemory_(
     ThreadLocalData1_<SampleIndex>& t1 = threadLocalData1_<SampleIndex>;
     ThreadLocalData2_<SampleStatus>& t2 = threadLocalData2_<SampleStatus>;
 
-    const size_t j = t0.parent->usedVariables[usedVariableIndex];
+    const size_t* pUsedVariables = data(t0.parent->usedVariables) + t0.parent->usedBundleOffsets[usedBundleIndex];
+    const size_t m = t0.parent->usedBundleOffsets[usedBundleIndex + 1] - t0.parent->usedBundleOffsets[usedBundleIndex];
     const SampleStatus* pSampleStatus = data(t2.parent->sampleStatus);
 
     const vector<TreeNodeExt>& nodes = t0.parent->tree[d];
     const size_t nodeCount = size(nodes);
     const size_t statusCount = nodeCount + 1;
-    const size_t unusedSampleCount = sampleCount_ - usedSampleCount;
 
-    t1.sampleBuffer.resize(sampleCount_);
-    SampleIndex* pOrderedSamples = data(t1.sampleBuffer);
+    // count the samples with each status
+
+    t1.statusBlockSizes.assign(statusCount, 0);
+    size_t* pStatusBlockSizes = data(t1.statusBlockSizes);
+    for (size_t r = 0; r != m; ++r) {
+        const size_t j = pUsedVariables[r];
+        const SampleIndex* pSortedSamplesBegin = data(sortedSamples_) + sortedSampleOffsets_[j];
+        const SampleIndex* pSortedSamplesEnd = data(sortedSamples_) + sortedSampleOffsets_[j + 1];
+        if (static_cast<size_t>(pSortedSamplesEnd - pSortedSamplesBegin) == sampleCount_) {
+            // no samples with zero values, so the counts are given by the sample counts of the nodes
+            pStatusBlockSizes[0] += sampleCount_ - usedSampleCount;
+            for (size_t s = 1; s != statusCount; ++s)
+                pStatusBlockSizes[s] += nodes[s - 1].sampleCount;
+        }
+        else {
+            for (const SampleIndex* p = pSortedSamplesBegin; p != pSortedSamplesEnd; ++p)
+                ++pStatusBlockSizes[pSampleStatus[*p]];
+        }
+    }
 
-    t1.orderedSampleBlocks.resize(statusCount);
-    SampleIndex** pOrderedSampleBlocks = data(t1.orderedSampleBlocks);
+    size_t bufferSize = 0;
+    for (size_t s = 0; s != statusCount; ++s)
+        bufferSize += pStatusBlockSizes[s];
+    t1.sampleBuffer.resize(bufferSize);
+    SampleIndex* pOrderedSamples = data(t1.sampleBuffer);
 
+    t1.statusBlockPositions.resize(statusCount);
+    SampleIndex** pStatusBlockPositions = data(t1.statusBlockPositions);
     for (size_t s = 0; s != statusCount; ++s) {
-        pOrderedSampleBlocks[s] = pOrderedSamples;
-        const size_t blockSize = (s == 0) ? unusedSampleCount : nodes[s - 1].sampleCount;
-        pOrderedSamples += blockSize;
+        pStatusBlockPositions[s] = pOrderedSamples;
+        pOrderedSamples += pStatusBlockSizes[s];
     }
 
-    // orderedSampleBlocks[s] = pointer to the beginning of the block where we will store samples
-    // with status s sorted according to variable j  (for each s = 0, 1, 2, ..., nodeCount)
+    // statusBlockPositions[s] = pointer to the position in the block where we will store the next sample
+    // with status s (for each s = 0, 1, 2, ..., nodeCount)
+    // the samples are stored variable by variable, so the segments of each block follow each other
 
-    for (SampleIndex i : sortedSamples_[j]) {
-        const SampleStatus s = pSampleStatus[i];
-        *pOrderedSampleBlocks[s] = i;
-        ++pOrderedSampleBlocks[s];
-    }
+    t1.orderedSampleBlocks.resize(nodeCount * (m + 1));
+    SampleIndex** pOrderedSampleBlocks = data(t1.orderedSampleBlocks);
+
+    for (size_t r = 0; r != m + 1; ++r) {
+        for (size_t k = 0; k != nodeCount; ++k)
+            pOrderedSampleBlocks[k * (m + 1) + r] = pStatusBlockPositions[k + 1];
+        if (r == m)
+            break;
 
-    // orderedSampleBlocks[s] = pointer to the end of the block with samples with s
-    // = beginning of the status s + 1 block = beginning of the block with samples that belong to node s
+        const size_t j = pUsedVariables[r];
+        const SampleIndex* pSortedSamplesEnd = data(sortedSamples_) + sortedSampleOffsets_[j + 1];
+        for (const SampleIndex* p = data(sortedSamples_) + sortedSampleOffsets_[j]; p != pSortedSamplesEnd; ++p) {
+            const SampleIndex i = *p;
+            const SampleStatus s = pSampleStatus[i];
+            *pStatusBlockPositions[s] = i;
+            ++pStatusBlockPositions[s];
+        }
+    }
 }
 
 
 template<typename SampleIndex>
 template<typename SampleStatus>
 void TreeTrainerImpl<SampleIndex>::updateOrderedSamples_(
-    const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedVariableIndex) const
+    const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedBundleIndex) const
 {
     // called from inner threads; be careful to distinguish between t0 and t0.parent etc.
 
@@ -936,64 +1368,94 @@ void TreeTrainerImpl<SampleIndex>::updateOrderedSamples_(
     ThreadLocalData1_<SampleIndex>& t1 = threadLocalData1_<SampleIndex>;
     ThreadLocalData2_<SampleStatus>& t2 = threadLocalData2_<SampleStatus>;
 
-    const SampleIndex* pPrevOrderedSamples = data(t1.parent->orderedSamplesByVariable[usedVariableIndex]);
+    const size_t m = t0.parent->usedBundleOffsets[usedBundleIndex + 1] - t0.parent->usedBundleOffsets[usedBundleIndex];
     const SampleStatus* pSampleStatus = data(t2.parent->sampleStatus);
 
+    // the blocks of the previous layer (swapping the buffers does not invalidate the pointers to the blocks)
+    const SampleIndex* const* pPrevOrderedSampleBlocks = data(t1.parent->orderedSampleBlocksByBundle[usedBundleIndex]);
+
     const vector<TreeNodeExt>& prevNodes = t0.parent->tree[d - 1];
+    const size_t prevNodeCount = size(prevNodes);
     const vector<TreeNodeExt>& nodes = t0.parent->tree[d];
     const size_t nodeCount = size(nodes);
 
-    t1.sampleBuffer.resize(usedSampleCount + nodeCount /*dummies*/);
+    size_t bufferSize = 0;
+    for (size_t k = 0; k != prevNodeCount; ++k) {
+        const TreeNodeExt& prevNode = prevNodes[k];
+        if (prevNode.isLeaf)
+            continue;
+        const size_t prevBlockSize = pPrevOrderedSampleBlocks[k * (m + 1) + m] - pPrevOrderedSampleBlocks[k * (m + 1)];
+        const TreeNodeExt* leftNode = static_cast<const TreeNodeExt*>(prevNode.leftChild);
+        const TreeNodeExt* rightNode = static_cast<const TreeNodeExt*>(prevNode.rightChild);
+        bufferSize += std::min(leftNode->sampleCount * m, prevBlockSize) + 1 /*dummy*/;
+        bufferSize += std::min(rightNode->sampleCount * m, prevBlockSize) + 1 /*dummy*/;
+    }
+    ASSERT(bufferSize <= usedSampleCount * m + nodeCount);
+
+    t1.sampleBuffer.resize(bufferSize);
     SampleIndex* pOrderedSamplesLeft = data(t1.sampleBuffer);
 
-    for (const TreeNodeExt& prevNode : prevNodes) {
+    t1.orderedSampleBlocks.resize(nodeCount * (m + 1));
+    SampleIndex** pOrderedSampleBlocks = data(t1.orderedSampleBlocks);
+
+    for (size_t k = 0; k != prevNodeCount; ++k) {
 
-        if (prevNode.isLeaf) {
-            pPrevOrderedSamples += prevNode.sampleCount + 1 /*dummy*/;
+        const TreeNodeExt& prevNode = prevNodes[k];
+        if (prevNode.isLeaf)
             continue;
-        }
+
+        const SampleIndex* const* pPrevSegments = pPrevOrderedSampleBlocks + k * (m + 1);
+        const size_t prevBlockSize = pPrevSegments[m] - pPrevSegments[0];
 
         const TreeNodeExt* leftNode = static_cast<const TreeNodeExt*>(prevNode.leftChild);
-        SampleIndex* pOrderedSamplesRight = pOrderedSamplesLeft + leftNode->sampleCount + 1 /*dummy*/;
-
-        const SampleIndex* pPrevOrderedSamplesEnd = pPrevOrderedSamples + prevNode.sampleCount;
-        while (pPrevOrderedSamples != pPrevOrderedSamplesEnd) {
-            const SampleIndex i = *pPrevOrderedSamples;
-            ++pPrevOrderedSamples;
-            *pOrderedSamplesLeft = i;
-            *pOrderedSamplesRight = i;
-            const SampleStatus s = pSampleStatus[i];
-            pOrderedSamplesLeft += s & 1;
-            pOrderedSamplesRight += 1 - s & 1;
+        const TreeNodeExt* rightNode = static_cast<const TreeNodeExt*>(prevNode.rightChild);
+        const size_t kLeft = leftNode - data(nodes);   // the right child is node kLeft + 1
+        SampleIndex** pLeftSegments = pOrderedSampleBlocks + kLeft * (m + 1);
+        SampleIndex** pRightSegments = pLeftSegments + (m + 1);
+
+        SampleIndex* pOrderedSamplesRight
+            = pOrderedSamplesLeft + std::min(leftNode->sampleCount * m, prevBlockSize) + 1 /*dummy*/;
+        SampleIndex* pOrderedSamplesNext
+            = pOrderedSamplesRight + std::min(rightNode->sampleCount * m, prevBlockSize) + 1 /*dummy*/;
+
+        for (size_t r = 0; r != m; ++r) {
+            pLeftSegments[r] = pOrderedSamplesLeft;
+            pRightSegments[r] = pOrderedSamplesRight;
+
+            const SampleIndex* pPrevOrderedSamples = pPrevSegments[r];
+            const SampleIndex* pPrevOrderedSamplesEnd = pPrevSegments[r + 1];
+            while (pPrevOrderedSamples != pPrevOrderedSamplesEnd) {
+                const SampleIndex i = *pPrevOrderedSamples;
+                ++pPrevOrderedSamples;
+                *pOrderedSamplesLeft = i;
+                *pOrderedSamplesRight = i;
+                const SampleStatus s = pSampleStatus[i];
+                pOrderedSamplesLeft += s & 1;
+                pOrderedSamplesRight += 1 - s & 1;
+            }
         }
+        pLeftSegments[m] = pOrderedSamplesLeft;
+        pRightSegments[m] = pOrderedSamplesRight;
 
-        pPrevOrderedSamples += 1 /*dummy*/;
-        pOrderedSamplesLeft = pOrderedSamplesRight + 1 /*dummy*/;
+        pOrderedSamplesLeft = pOrderedSamplesNext;
     }
 
-    SampleIndex* pOrderedSamples = data(t1.sampleBuffer);
-
-    if (d + 1 != trainData->options.maxTreeDepth())
+    if (d + 1 != trainData->options.maxTreeDepth()) {
         // save the ordered samples to be used as input when ordering samples for the next layer
-        swap(t1.parent->orderedSamplesByVariable[usedVariableIndex], t1.sampleBuffer);
-
-    t1.orderedSampleBlocks.resize(nodeCount);
-    SampleIndex** pOrderedSampleBlocks = data(t1.orderedSampleBlocks);
-    for (size_t k = 0; k != nodeCount; ++k) {
-        pOrderedSampleBlocks[k] = pOrderedSamples;
-        const size_t blockSize = nodes[k].sampleCount;
-        pOrderedSamples += blockSize + 1 /*dummy*/;
+        swap(t1.parent->orderedSamplesByBundle[usedBundleIndex], t1.sampleBuffer);
+        t1.parent->orderedSampleBlocksByBundle[usedBundleIndex] = t1.orderedSampleBlocks;
     }
 }
 
 
-// The next function determines the best split of each node in layer d with respect to variable j.
-// The pointer pOrderedSamples points to a buffer that contains all used samples grouped by node
-// and then sorted by variable j.
+// The next function determines the best split of each node in layer d with respect to each used variable j
+// of a bundle. The vector t1.orderedSampleBlocks points to a buffer that contains all used samples
+// with non-zero values of variable j grouped by node and then sorted by variable j (and similarly for the other
+// used variables of the bundle).
 
 template<typename SampleIndex>
 void TreeTrainerImpl<SampleIndex>::updateNodeTrainers3_(
-    const TrainData_* trainData, size_t d, size_t usedVariableIndex, size_t threadIndex) const
+    const TrainData_* trainData, size_t d, size_t usedBundleIndex, size_t threadIndex) const
 {
     // called from inner threads; be careful to distinguish between t0 and t0.parent etc.
 
@@ -1004,15 +1466,54 @@ void TreeTrainerImpl<SampleIndex>::updateNodeTrainers3_(
     const size_t parentNodeCount = size(parentNodes);
     const size_t k0 = threadIndex * parentNodeCount;
     const SampleIndex* const* pOrderedSampleBlocks = data(t1.orderedSampleBlocks);
-    const size_t j = t0.parent->usedVariables[usedVariableIndex];
+    const size_t* pUsedVariables = data(t0.parent->usedVariables) + t0.parent->usedBundleOffsets[usedBundleIndex];
+    const size_t m = t0.parent->usedBundleOffsets[usedBundleIndex + 1] - t0.parent->usedBundleOffsets[usedBundleIndex];
+
+    for (size_t r = 0; r != m; ++r) {
+
+        const size_t j = pUsedVariables[r];
+        const bool isCategorical = categorical_(j) != 0;
+        // for a pair variable, the values of all samples are computed, not only those of the samples in the nodes;
+        // this costs about as much as the scan of the sorted samples of the variable
+        const float* pInDataColJ = variableValues_(j, &threadLocalData0_.pairValues);
+
+        for (size_t k = 0; k != parentNodeCount; ++k) {
+
+            const SampleIndex* pOrderedSampleBlockBegin = pOrderedSampleBlocks[k * (m + 1) + r];
+            const SampleIndex* pOrderedSampleBlockEnd = pOrderedSampleBlocks[k * (m + 1) + r + 1];
+
+            if (trainData->classCount != 0) {
+                MultiTreeNodeTrainer<SampleIndex>& treeNodeTrainer = t1.parent->multiTreeNodeTrainers[k0 + k];
+                if (isCategorical)
+                    treeNodeTrainer.updateCategorical(
+                        pInDataColJ, trainData->pClassData, pOrderedSampleBlockBegin, pOrderedSampleBlockEnd, j);
+                else
+                    treeNodeTrainer.update(
+                        pInDataColJ, trainData->pClassData, pOrderedSampleBlockBegin, pOrderedSampleBlockEnd, j);
+                continue;
+            }
 
-    for (size_t k = 0; k != parentNodeCount; ++k) {
+            TreeNodeTrainer<SampleIndex>& treeNodeTrainer = t1.parent->treeNodeTrainers[k0 + k];
 
-        const SampleIndex* pOrderedSampleBlockBegin = pOrderedSampleBlocks[k];
-        const SampleIndex* pOrderedSampleBlockEnd = pOrderedSampleBlockBegin + parentNodes[k].sampleCount;
+            if (trainData->pWyPacks != nullptr) {
+                if (isCategorical)
+                    treeNodeTrainer.updateCategorical(
+                        pInDataColJ, trainData->pWyPacks, pOrderedSampleBlockBegin, pOrderedSampleBlockEnd, j);
+                else
+                    treeNodeTrainer.update(
+                        pInDataColJ, trainData->pWyPacks, pOrderedSampleBlockBegin, pOrderedSampleBlockEnd, j);
+                continue;
+            }
 
-        t1.parent->treeNodeTrainers[k0 + k].update(
-            inData_, trainData->outData, trainData->weights, pOrderedSampleBlockBegin, pOrderedSampleBlockEnd, j);
+            if (isCategorical)
+                treeNodeTrainer.updateCategorical(
+                    pInDataColJ, trainData->outData, trainData->weights, pOrderedSampleBlockBegin,
+                    pOrderedSampleBlockEnd, j);
+            else
+                treeNodeTrainer.update(
+                    pInDataColJ, trainData->outData, trainData->weights, pOrderedSampleBlockBegin,
+                    pOrderedSampleBlockEnd, j);
+        }
     }
 }
 
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "BernoulliDistribution.h"
+#include "PairVariables.h"
 #include "TreeTrainer.h"
 #include "TreeTrainerBuffers.h"
 
@@ -12,42 +13,68 @@
 template<typename SampleIndex>
 class TreeTrainerImpl : public TreeTrainer, private TreeTrainerBuffers {   // immutable class
 public:
-    TreeTrainerImpl(CRefXXfc inData, CRefXu8 strata);
+    TreeTrainerImpl(const vector<CRefXXfc>& inDataBlocks, CRefXu8 categorical, const PairVariables& pairs);
     virtual ~TreeTrainerImpl() = default;
 
 private:
     struct TrainData_ {
         CRefXd outData;
         CRefXd weights;
+        CRefXu8 strata;
         BaseOptions options;
         size_t usedVariableCount;
         size_t threadCount;
+        // when training several trees with the same splits (see TreeTrainer::trainMulti()), weights holds the total
+        // weight of each sample and outData is not used
+        size_t classCount;           // number of trees, 0 when training a single tree
+        const double* pClassData;    // see MultiTreeNodeTrainer.h
+        // w and w * y of each sample in single precision (see WyPack in TreeNodeTrainer.h), nullptr if not used;
+        // the sums of the nodes must be calculated from the same values as the sums in the node trainers
+        const WyPack* pWyPacks;
+
+        double w(size_t i) const { return pWyPacks == nullptr ? weights[i] : pWyPacks[i].w; }
+        double wy(size_t i) const { return pWyPacks == nullptr ? weights[i] * outData[i] : pWyPacks[i].wy; }
     };
 
 private:
-    vector<size_t> initSampleCountsByStratum() const;
+    vector<size_t> initSortedSampleOffsets_() const;
+    vector<SampleIndex> initSortedSamples_() const;
+    vector<size_t> initBundles_() const;
 
-    vector<vector<SampleIndex>> initSortedSamples_() const;
+    // returns a pointer to the values of variable j; the values of a pair variable are first written to buffer
+    const float* variableValues_(size_t j, vector<float>* buffer) const;
+    float variableValue_(size_t i, size_t j) const;
 
     //
 
-    unique_ptr<BasePredictor>
-    trainImpl0_(CRefXd outData, CRefXd weights, const BaseOptions& options, size_t threadCount) const;
+    unique_ptr<BasePredictor> trainImpl0_(
+        CRefXd outData, CRefXd weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const;
+    vector<unique_ptr<BasePredictor>> trainMultiImpl0_(
+        CRefXXdc outData, CRefXXdc weights, CRefXu8 strata, const BaseOptions& options, size_t threadCount) const;
 
     void validateData_(CRefXd outData, CRefXd weights) const;
 
     void initTree_() const;
 
+    const WyPack* initWyPacks_(CRefXd outData, CRefXd weights, const BaseOptions& options) const;
+
     size_t usedVariableCount_(const BaseOptions& options) const;
 
+    size_t trainImpl1_(const TrainData_* trainData, size_t ITEM_COUNT) const;
+
+    void finalizeTree_() const;
+
     //
 
     template<typename SampleStatus>
-    size_t trainImpl1_(const TrainData_* trainData, size_t ITEM_COUNT) const;
+    size_t trainImpl2_(const TrainData_* trainData, size_t ITEM_COUNT) const;
 
     template<typename SampleStatus>
     size_t initSampleStatus_(const TrainData_* trainData) const;
 
+    template<typename SampleStatus>
+    void initClassSums_(const TrainData_* trainData, size_t d) const;
+
     template<typename SampleStatus>
     void updateSampleStatus_(const TrainData_* trainData, size_t d) const;
 
@@ -79,33 +106,36 @@ private:
 
     template<typename SampleStatus>
     size_t updateNodeTrainers2_(
-        const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedVariableIndex, size_t threadIndex,
+        const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedBundleIndex, size_t threadIndex,
         size_t ITEM_COUNT) const;
 
     template<typename SampleStatus>
     void
-    initOrderedSamples_(const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedVariableIndex) const;
+    initOrderedSamples_(const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedBundleIndex) const;
 
     template<typename SampleStatus>
     void updateOrderedSampleSaveMemory_(
-        const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedVariableIndex) const;
+        const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedBundleIndex) const;
 
     template<typename SampleStatus>
     void updateOrderedSamples_(
-        const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedVariableIndex) const;
+        const TrainData_* trainData, size_t d, size_t usedSampleCount, size_t usedBundleIndex) const;
 
     void
-    updateNodeTrainers3_(const TrainData_* trainData, size_t d, size_t usedVariableIndex, size_t threadIndex) const;
+    updateNodeTrainers3_(const TrainData_* trainData, size_t d, size_t usedBundleIndex, size_t threadIndex) const;
 
 private:
-    const CRefXXfc inData_;
+    const vector<const float*> inDataColumns_;   // inDataColumns_[j] points to the values of variable j
+    const PairVariables pairs_;                  // variable size(inDataColumns_) + k is pair variable k
     const size_t sampleCount_;
-    const size_t variableCount_;
-    const vector<vector<SampleIndex>> sortedSamples_;
-
-    const CRefXu8 strata_;
-    const size_t stratumCount_;
-    const vector<size_t> sampleCountsByStratum_;
+    const size_t variableCount_;                 // including the pair variables
+    const CRefXu8 categorical_;                  // categorical_(j) != 0 if variable j is categorical
+    const vector<size_t> sortedSampleOffsets_;
+    const vector<SampleIndex> sortedSamples_;
+    // the list of sorted samples of variable j is stored in sortedSamples_
+    // from sortedSampleOffsets_[j] to sortedSampleOffsets_[j + 1]
+    const vector<size_t> bundles_;
+    // bundle b consists of the variables bundles_[b], bundles_[b] + 1, ..., bundles_[b + 1] - 1
 
 private:
     using BernoulliDistribution_ = typename std::conditional_t<   // much faster than std::bernoulli_distribution
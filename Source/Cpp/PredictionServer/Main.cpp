@@ -0,0 +1,34 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "PredictionServer.h"
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3 || argc > 5) {
+        std::cerr << "Usage: PredictionServer socketPath predictorPath [maxBatchSize [maxDelayMicroseconds]]"
+                  << std::endl;
+        return 1;
+    }
+
+    try {
+        const string socketPath = argv[1];
+        const string predictorPath = argv[2];
+        const size_t maxBatchSize = argc > 3 ? std::stoull(argv[3]) : 1024;
+        const std::chrono::microseconds maxDelay{argc > 4 ? std::stoll(argv[4]) : 1000};
+
+        shared_ptr<Predictor> predictor = Predictor::loadMapped(predictorPath);
+        PredictionServer server(predictor, maxBatchSize, maxDelay);
+        std::cout << "Serving " << predictorPath << " (" << predictor->variableCount() << " variables) on "
+                  << socketPath << std::endl;
+        server.run(socketPath);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
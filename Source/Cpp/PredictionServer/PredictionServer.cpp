@@ -0,0 +1,372 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#include "pch.h"
+
+#include "PredictionServer.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+#ifdef _WIN32
+using Socket_ = SOCKET;
+const Socket_ invalidSocket_ = INVALID_SOCKET;
+#else
+using Socket_ = int;
+const Socket_ invalidSocket_ = -1;
+#endif
+
+void initSockets_()
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+        throw std::runtime_error("Unable to initialize Windows Sockets.");
+#endif
+}
+
+void closeSocket_(Socket_ s)
+{
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+// returns false if the connection was closed or failed
+
+bool readAll_(Socket_ s, void* buffer, size_t size)
+{
+    char* p = static_cast<char*>(buffer);
+    while (size != 0) {
+        const int n = static_cast<int>(std::min<size_t>(size, numeric_limits<int>::max()));
+        const auto m = recv(s, p, n, 0);
+        if (m <= 0)
+            return false;
+        p += m;
+        size -= static_cast<size_t>(m);
+    }
+    return true;
+}
+
+bool writeAll_(Socket_ s, const void* buffer, size_t size)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;   // a client that disconnects should not terminate the server with SIGPIPE
+#else
+    const int flags = 0;
+#endif
+    const char* p = static_cast<const char*>(buffer);
+    while (size != 0) {
+        const int n = static_cast<int>(std::min<size_t>(size, numeric_limits<int>::max()));
+        const auto m = send(s, p, n, flags);
+        if (m <= 0)
+            return false;
+        p += m;
+        size -= static_cast<size_t>(m);
+    }
+    return true;
+}
+
+// removes a socket file left behind by an earlier server, since it would make bind() fail;
+// throws if there is some other kind of file at the path, so that a mistyped path does not destroy a file
+
+void removeStaleSocket_(const string& socketPath)
+{
+#ifdef _WIN32
+    // Unix domain sockets are reparse points with the tag IO_REPARSE_TAG_AF_UNIX
+    WIN32_FIND_DATAA findData;
+    const HANDLE h = FindFirstFileA(socketPath.c_str(), &findData);
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+    FindClose(h);
+    const bool isSocket = (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0
+        && findData.dwReserved0 == 0x80000023;   // IO_REPARSE_TAG_AF_UNIX
+    if (!isSocket)
+        throw std::invalid_argument("The file " + socketPath + " exists and is not a socket.");
+    if (!DeleteFileA(socketPath.c_str()))
+        throw std::runtime_error("Unable to remove the socket " + socketPath + ".");
+#else
+    struct stat status;
+    if (lstat(socketPath.c_str(), &status) != 0) {
+        if (errno == ENOENT)
+            return;
+        throw std::runtime_error("Unable to access " + socketPath + ".");
+    }
+    if (!S_ISSOCK(status.st_mode))
+        throw std::invalid_argument("The file " + socketPath + " exists and is not a socket.");
+    if (unlink(socketPath.c_str()) != 0)
+        throw std::runtime_error("Unable to remove the socket " + socketPath + ".");
+#endif
+}
+
+}   // namespace
+
+//----------------------------------------------------------------------------------------------------------------------
+
+PredictionServer::PredictionServer(
+    shared_ptr<Predictor> predictor, size_t maxBatchSize, std::chrono::microseconds maxDelay) :
+    predictor_(predictor),
+    variableCount_(predictor->variableCount()),
+    maxBatchSize_(maxBatchSize),
+    maxDelay_(maxDelay),
+    lastReportTime_(Clock_::now())
+{
+    if (maxBatchSize == 0)
+        throw std::invalid_argument("maxBatchSize must be positive.");
+}
+
+void PredictionServer::run(const string& socketPath)
+{
+    initSockets_();
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (size(socketPath) >= sizeof(address.sun_path))
+        throw std::invalid_argument("The socket path " + socketPath + " is too long.");
+    std::copy(begin(socketPath), end(socketPath), address.sun_path);
+
+    const Socket_ listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == invalidSocket_)
+        throw std::runtime_error("Unable to create a socket.");
+    removeStaleSocket_(socketPath);
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0)
+        throw std::runtime_error("Unable to listen on " + socketPath + ".");
+
+    std::thread(&PredictionServer::batchLoop_, this).detach();
+
+    while (true) {
+        const Socket_ connection = accept(listener, nullptr, nullptr);
+        if (connection == invalidSocket_)
+            continue;
+        std::thread(&PredictionServer::serveConnection_, this, static_cast<uintptr_t>(connection)).detach();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// There is one thread per connection. It reads a request, validates it, hands it over to the batch thread
+// and waits for the predictions.
+
+void PredictionServer::serveConnection_(uintptr_t connection)
+{
+    const Socket_ s = static_cast<Socket_>(connection);
+    vector<float> inData;
+    vector<double> outData;
+
+    const uint64_t variableCount = variableCount_;
+    if (!writeAll_(s, &variableCount, sizeof(variableCount))) {
+        closeSocket_(s);
+        return;
+    }
+
+    // the connection threads must not terminate; if a buffer cannot be allocated, the request is answered with
+    // status 1 and the connection is closed
+
+    try {
+        while (true) {
+            uint64_t sampleCount;
+            if (!readAll_(s, &sampleCount, sizeof(sampleCount)))
+                break;
+
+            const uint64_t invalid[2] = {1, 0};
+            if (sampleCount > maxRequestSize_ / std::max<size_t>(variableCount_, 1)) {
+                writeAll_(s, invalid, sizeof(invalid));
+                break;
+            }
+            inData.resize(sampleCount * variableCount_);
+            if (!readAll_(s, data(inData), size(inData) * sizeof(float)))
+                break;
+
+            Request_ request{data(inData), sampleCount, nullptr, Clock_::now(), 0, false, false};
+            if (std::any_of(begin(inData), end(inData), [](float x) { return std::isinf(x); })) {
+                writeAll_(s, invalid, sizeof(invalid));
+                break;
+            }
+            outData.resize(sampleCount);
+            request.outData = data(outData);
+
+            predict_(&request);
+
+            if (request.failed) {
+                const uint64_t header[2] = {1, request.latency};
+                if (!writeAll_(s, header, sizeof(header)))
+                    break;
+                continue;
+            }
+
+            const uint64_t header[2] = {0, request.latency};
+            if (!writeAll_(s, header, sizeof(header)) || !writeAll_(s, data(outData), size(outData) * sizeof(double)))
+                break;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Request failed: " << e.what() << std::endl;
+        const uint64_t failed[2] = {1, 0};
+        writeAll_(s, failed, sizeof(failed));
+    }
+
+    closeSocket_(s);
+}
+
+void PredictionServer::predict_(Request_* request)
+{
+    std::unique_lock lock(mutex_);
+    queue_.push_back(request);
+    queuedSampleCount_ += request->sampleCount;
+    requestQueued_.notify_one();
+    requestDone_.wait(lock, [request] { return request->done; });
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// The batch thread waits for the first request, then waits until maxBatchSize samples are queued or maxDelay
+// has passed since that request was read, and then predicts the queued requests in one batch.
+
+void PredictionServer::batchLoop_()
+{
+    vector<Request_*> batch;
+
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            requestQueued_.wait_for(lock, reportInterval_, [this] { return !queue_.empty(); });
+            if (!queue_.empty()) {
+                requestQueued_.wait_until(lock, queue_.front()->startTime + maxDelay_, [this] {
+                    return queuedSampleCount_ >= maxBatchSize_;
+                });
+                size_t batchSampleCount = 0;
+                while (!queue_.empty()
+                       && (batch.empty() || batchSampleCount + queue_.front()->sampleCount <= maxBatchSize_)) {
+                    batch.push_back(queue_.front());
+                    batchSampleCount += queue_.front()->sampleCount;
+                    queue_.pop_front();
+                }
+                queuedSampleCount_ -= batchSampleCount;
+            }
+        }
+
+        if (!batch.empty()) {
+            predictBatch_(batch);
+            batch.clear();
+        }
+        report_(Clock_::now());
+    }
+}
+
+// The batch thread must not terminate, so the exceptions thrown by the prediction are caught here.
+// A batch of several requests that fails is retried one request at a time,
+// and only the requests that still fail are marked as failed.
+
+void PredictionServer::predictBatch_(const vector<Request_*>& batch)
+{
+    try {
+        predictRequests_(batch);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Prediction failed: " << e.what() << std::endl;
+        if (size(batch) == 1)
+            batch.front()->failed = true;
+        else {
+            for (Request_* request : batch) {
+                try {
+                    predictRequests_({request});
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Prediction failed: " << e.what() << std::endl;
+                    request->failed = true;
+                }
+            }
+        }
+    }
+
+    const Clock_::time_point now = Clock_::now();
+    {
+        std::lock_guard lock(mutex_);
+        for (Request_* request : batch) {
+            request->latency = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - request->startTime).count());
+            request->done = true;
+            ++requestCount_;
+            sampleCount_ += request->sampleCount;
+            totalLatency_ += static_cast<double>(request->latency);
+            maxLatency_ = std::max(maxLatency_, static_cast<double>(request->latency));
+        }
+    }
+    requestDone_.notify_all();
+    ++batchCount_;
+}
+
+void PredictionServer::predictRequests_(const vector<Request_*>& requests) const
+{
+    // a single request is predicted in place, several requests are first copied into one array
+
+    if (size(requests) == 1) {
+        Request_* request = requests.front();
+        const Eigen::Map<const ArrayXXfr> inData(request->inData, request->sampleCount, variableCount_);
+        Eigen::Map<ArrayXd> outData(request->outData, request->sampleCount);
+        predictor_->predictRowMajor(inData, outData);
+    }
+    else {
+        size_t batchSampleCount = 0;
+        for (const Request_* request : requests)
+            batchSampleCount += request->sampleCount;
+
+        // std::vector rather than Eigen arrays, since std::vector::resize() leaves the buffer valid if it throws
+        static thread_local vector<float> inDataBuffer;
+        static thread_local vector<double> outDataBuffer;
+        inDataBuffer.resize(batchSampleCount * variableCount_);
+        outDataBuffer.resize(batchSampleCount);
+        Eigen::Map<ArrayXXfr> inData(data(inDataBuffer), batchSampleCount, variableCount_);
+        Eigen::Map<ArrayXd> outData(data(outDataBuffer), batchSampleCount);
+
+        size_t i = 0;
+        for (const Request_* request : requests) {
+            inData.middleRows(i, request->sampleCount)
+                = Eigen::Map<const ArrayXXfr>(request->inData, request->sampleCount, variableCount_);
+            i += request->sampleCount;
+        }
+        predictor_->predictRowMajor(inData, outData);
+        i = 0;
+        for (Request_* request : requests) {
+            Eigen::Map<ArrayXd>(request->outData, request->sampleCount) = outData.segment(i, request->sampleCount);
+            i += request->sampleCount;
+        }
+    }
+}
+
+void PredictionServer::report_(Clock_::time_point now)
+{
+    if (now - lastReportTime_ < reportInterval_)
+        return;
+
+    if (requestCount_ != 0) {
+        std::cout << "requests: " << requestCount_ << "  samples: " << sampleCount_ << "  batches: " << batchCount_
+                  << "  latency (us): mean " << std::llround(totalLatency_ / requestCount_) << ", max "
+                  << std::llround(maxLatency_) << std::endl;
+    }
+
+    lastReportTime_ = now;
+    requestCount_ = 0;
+    sampleCount_ = 0;
+    batchCount_ = 0;
+    totalLatency_ = 0.0;
+    maxLatency_ = 0.0;
+}
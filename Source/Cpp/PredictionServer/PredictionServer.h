@@ -0,0 +1,81 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "../JrBoostLib/Predictor.h"
+
+// Local prediction server.
+//
+// Serves the predictions of one predictor over a Unix domain socket, so that all clients on a machine share one copy
+// of the model. Requests from concurrent clients are queued and coalesced into micro-batches, each scored with one call
+// to Predictor::predictRowMajor(). A batch is started when maxBatchSize samples are waiting or when the oldest waiting
+// request has waited maxDelay.
+//
+// Protocol (all values in native byte order):
+//   on connect, the server sends  uint64 variableCount
+//   request                       uint64 sampleCount, then sampleCount x variableCount float32 values (row-major)
+//   response                      uint64 status (0 = ok, 1 = invalid request or failed prediction),
+//                                 uint64 latency in microseconds (from the request being read to the predictions
+//                                 being ready), then, if ok, sampleCount float64 predictions
+// A client can send any number of requests over one connection. The server closes the connection after an invalid
+// request (too many samples, or values that are infinity). NaN values are missing values.
+// If the prediction of a batch fails (e.g. with std::bad_alloc), its requests are predicted one at a time, and the
+// requests that still fail get status 1; the connection is kept open. If the memory for a request cannot be allocated,
+// the request gets status 1 and the connection is closed.
+
+class PredictionServer {
+public:
+    PredictionServer(shared_ptr<Predictor> predictor, size_t maxBatchSize, std::chrono::microseconds maxDelay);
+    ~PredictionServer() = default;
+
+    // listens on socketPath and serves requests until the process is terminated;
+    // a socket left behind at socketPath by an earlier server is removed, any other file there is an error
+    [[noreturn]] void run(const string& socketPath);
+
+private:
+    using Clock_ = std::chrono::steady_clock;
+
+    struct Request_ {
+        const float* inData;
+        size_t sampleCount;
+        double* outData;
+        Clock_::time_point startTime;
+        uint64_t latency;   // in microseconds
+        bool done;
+        bool failed;
+    };
+
+    PredictionServer(const PredictionServer&) = delete;
+    PredictionServer& operator=(const PredictionServer&) = delete;
+
+    void serveConnection_(uintptr_t connection);
+    void predict_(Request_* request);
+    [[noreturn]] void batchLoop_();
+    void predictBatch_(const vector<Request_*>& batch);
+    void predictRequests_(const vector<Request_*>& requests) const;
+    void report_(Clock_::time_point now);
+
+    const shared_ptr<Predictor> predictor_;
+    const size_t variableCount_;
+    const size_t maxBatchSize_;
+    const std::chrono::microseconds maxDelay_;
+
+    std::mutex mutex_;
+    std::condition_variable requestQueued_;
+    std::condition_variable requestDone_;
+    std::deque<Request_*> queue_;
+    size_t queuedSampleCount_ = 0;
+
+    // statistics since the last report, only accessed by the batch thread
+    Clock_::time_point lastReportTime_;
+    size_t requestCount_ = 0;
+    size_t sampleCount_ = 0;
+    size_t batchCount_ = 0;
+    double totalLatency_ = 0.0;
+    double maxLatency_ = 0.0;
+
+    static const size_t maxRequestSize_ = size_t{1} << 28;   // max number of values in a request
+    static constexpr std::chrono::seconds reportInterval_{10};
+};
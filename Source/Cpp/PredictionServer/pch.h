@@ -0,0 +1,14 @@
+//  Copyright 2022 Johan Rade <johan.rade@gmail.com>.
+//  Distributed under the MIT license.
+//  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
+
+// precompiled header file
+
+#pragma once
+
+#include "../Common.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
@@ -52,6 +52,8 @@ BoostOptions tcBO::fromPython_(const PyBoostOptions_& pyOpt)
                 opt.setEta(std::get<double>(value));
             else if (key == "fastExp")
                 opt.setFastExp(std::get<bool>(value));
+            else if (key == "fastLogitExp")
+                opt.setFastLogitExp(std::get<bool>(value));
             else if (key == "forestSize")
                 opt.setForestSize(std::get<size_t>(value));
             else if (key == "maxTreeDepth")
@@ -80,6 +82,8 @@ BoostOptions tcBO::fromPython_(const PyBoostOptions_& pyOpt)
                 opt.setPruneFactor(std::get<double>(value));
             else if (key == "saveMemory")
                 opt.setSaveMemory(std::get<bool>(value));
+            else if (key == "singlePrecision")
+                opt.setSinglePrecision(std::get<bool>(value));
             else if (key == "test")
                 opt.setTest(std::get<size_t>(value));
             else {
@@ -118,6 +122,7 @@ tcBO::PyBoostOptions_ tcBO::toPython_(const BoostOptions& opt)
     pyOpt["iterationCount"] = opt.iterationCount();
     pyOpt["eta"] = opt.eta();
     pyOpt["fastExp"] = opt.fastExp();
+    pyOpt["fastLogitExp"] = opt.fastLogitExp();
     pyOpt["forestSize"] = opt.forestSize();
     pyOpt["maxTreeDepth"] = opt.maxTreeDepth();
     pyOpt["minAbsSampleWeight"] = opt.minAbsSampleWeight();
@@ -132,6 +137,7 @@ tcBO::PyBoostOptions_ tcBO::toPython_(const BoostOptions& opt)
     pyOpt["minNodeGain"] = opt.minNodeGain();
     pyOpt["pruneFactor"] = opt.pruneFactor();
     pyOpt["saveMemory"] = opt.saveMemory();
+    pyOpt["singlePrecision"] = opt.singlePrecision();
     pyOpt["test"] = opt.test();
 
     return pyOpt;
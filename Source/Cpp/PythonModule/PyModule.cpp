@@ -5,10 +5,16 @@
 #include "pch.h"
 
 #include "../JrBoostLib/BoostTrainer.h"
+#include "../JrBoostLib/CompiledPredictor.h"
+#include "../JrBoostLib/Dataset.h"
 #include "../JrBoostLib/FTest.h"
 #include "../JrBoostLib/Loss.h"
+#include "../JrBoostLib/MultinomialPredictor.h"
+#include "../JrBoostLib/MultinomialTrainer.h"
+#include "../JrBoostLib/PairVariables.h"
 #include "../JrBoostLib/Paralleltrain.h"
 #include "../JrBoostLib/Predictor.h"
+#include "../JrBoostLib/SimdLevel.h"
 #include "../JrBoostLib/TTest.h"
 #include "../JrBoostLib/TopScoringPairs.h"
 #include "../JrBoostLib/TreeTrainerBuffers.h"
@@ -37,16 +43,137 @@ PYBIND11_MODULE(_jrboost, mod)
 
     // Predictor
 
+    // accepts both C order and Fortran order float32 arrays without copying
+    using CRefXXfStrided = Eigen::Ref<const ArrayXXfc, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+
+    // A list of indata blocks is taken as a py::list, not as a vector, since pybind11 would accept a single 2D array
+    // as a vector of rows. Blocks that are not Fortran order float32 arrays are converted;
+    // the converted arrays are owned by the returned vector, which must outlive the references.
+    // A list is taken as indata blocks only if all its elements are arrays; any other list, such as a list of lists,
+    // is taken as one matrix, as by the overloads that take a matrix. (pybind11 tries all overloads without conversion
+    // before it tries any with conversion, so a list always binds to a py::list overload.)
+    using FArrayf = py::array_t<float, py::array::f_style | py::array::forcecast>;
+    const auto isBlockList = [](const py::list& list) {
+        for (const auto& item : list) {
+            if (!py::isinstance<py::array>(item))
+                return false;
+        }
+        return true;
+    };
+    const auto toArrays = [isBlockList](const py::list& blocks) {
+        vector<FArrayf> arrays;
+        const auto addArray = [&arrays](const py::handle& block) {
+            FArrayf array = FArrayf::ensure(block);
+            if (!array || array.ndim() != 2)
+                throw std::invalid_argument("Indata blocks must be 2-dimensional arrays.");
+            arrays.push_back(std::move(array));
+        };
+        if (!isBlockList(blocks))
+            addArray(blocks);
+        else {
+            for (const auto& block : blocks)
+                addArray(block);
+        }
+        return arrays;
+    };
+    const auto toRefs = [](const vector<FArrayf>& arrays) {
+        vector<CRefXXfc> refs;
+        for (const auto& array : arrays)
+            refs.push_back(Eigen::Map<const ArrayXXfc>(array.data(), array.shape(0), array.shape(1)));
+        return refs;
+    };
+    const auto toBlocks = [isBlockList](const py::list& blocks) {
+        vector<ArrayXXfc> inDataBlocks;
+        if (!isBlockList(blocks))
+            inDataBlocks.push_back(blocks.cast<ArrayXXfc>());
+        else {
+            for (const auto& block : blocks)
+                inDataBlocks.push_back(block.cast<ArrayXXfc>());
+        }
+        return inDataBlocks;
+    };
+
     py::class_<Predictor, shared_ptr<Predictor>>{mod, "Predictor"}
         .def("predict", [](shared_ptr<Predictor> predictor, CRefXXfc inData) { return predictor->predict(inData); })
+        // C order float32 arrays fail the no-conversion pass of the overload above and bind here without copying
+        .def("predict", [](shared_ptr<Predictor> predictor, CRefXXfr inData) {
+            return predictor->predictRowMajor(inData);
+        })
+        // predict(inData, out=outData) writes the predictions to a preallocated float64 or float32 array
+        .def(
+            "predict",
+            [](shared_ptr<Predictor> predictor, CRefXXfc inData, RefXd outData) { predictor->predict(inData, outData); },
+            py::arg(), py::arg("out"))
+        .def(
+            "predict",
+            [](shared_ptr<Predictor> predictor, CRefXXfc inData, RefXf outData) { predictor->predict(inData, outData); },
+            py::arg(), py::arg("out"))
+        .def(
+            "predict",
+            [](shared_ptr<Predictor> predictor, CRefXXfr inData, RefXd outData) {
+                predictor->predictRowMajor(inData, outData);
+            },
+            py::arg(), py::arg("out"))
+        .def(
+            "predict",
+            [](shared_ptr<Predictor> predictor, CRefXXfr inData, RefXf outData) {
+                predictor->predictRowMajor(inData, outData);
+            },
+            py::arg(), py::arg("out"))
+        // predict([block1, block2, ...]) treats the blocks as one matrix without concatenating them
+        .def(
+            "predict",
+            [toArrays, toRefs](shared_ptr<Predictor> predictor, const py::list& inDataBlocks) {
+                const vector<FArrayf> arrays = toArrays(inDataBlocks);
+                return predictor->predict(toRefs(arrays));
+            })
         .def("predictOne", &Predictor::predictOne)
+        .def(
+            "classify",
+            [](shared_ptr<Predictor> predictor, CRefXXfc inData, double threshold) {
+                return predictor->classify(inData, threshold);
+            })
+        .def(
+            "predictUnchecked",
+            [](const Predictor& predictor, CRefXXfStrided inData) {
+                if (static_cast<size_t>(inData.cols()) < predictor.variableCount())
+                    throw std::invalid_argument("Test indata has fewer variables than train indata.");
+                ArrayXd outData(inData.rows());
+                predictor.predictUnchecked(
+                    inData.data(), inData.innerStride(), inData.outerStride(), inData.rows(), outData.data());
+                return outData;
+            })
         .def("variableCount", &Predictor::variableCount)
         .def("variableWeights", &Predictor::variableWeights)
+        .def(
+            "shapValues",
+            [](shared_ptr<Predictor> predictor, CRefXXfc inData) { return predictor->shapValues(inData); })
+        .def(
+            "permutationImportance",
+            [](shared_ptr<Predictor> predictor, CRefXXfc inData, CRefXu8 outData,
+               function<double(CRefXu8, CRefXd, optional<CRefXd>)> lossFun, size_t repeatCount,
+               optional<CRefXd> weights) {
+                return predictor->permutationImportance(inData, outData, lossFun, repeatCount, weights);
+            },
+            py::arg(), py::arg(), py::arg(), py::arg("repeatCount") = 1, py::arg("weights") = std::nullopt,
+            py::call_guard<py::gil_scoped_release>())
+        .def("usedVariables", &Predictor::usedVariables)
         .def("reindexVariables", &Predictor::reindexVariables)
+        .def("project", &Predictor::project)
+        .def("quantize", &Predictor::quantize)
+        .def("flatten", &Predictor::flatten)
         .def("save", py::overload_cast<const string&>(&Predictor::save, py::const_))
+        .def("saveCode", py::overload_cast<const string&>(&Predictor::saveCode, py::const_))
         .def_static("load", py::overload_cast<const string&>(&Predictor::load))
+        .def_static("loadMapped", &Predictor::loadMapped)
+        .def_static(
+            "predictMany",
+            [](const vector<shared_ptr<Predictor>>& predictors, CRefXXfc inData) {
+                return Predictor::predictMany(predictors, inData);
+            })
         .def_static("createEnsemble", &EnsemblePredictor::createInstance)
         .def_static("createUnion", &UnionPredictor::createInstance)
+        .def_static("createCompiled", &CompiledPredictor::createInstance)
         //.def_static(
         //    "createShifted", py::overload_cast<shared_ptr<Predictor>, double,
         //    double>(&ShiftPredictor::createInstance))
@@ -65,15 +192,107 @@ PYBIND11_MODULE(_jrboost, mod)
             }));
 
 
-    // Boost trainer
+    // Dataset and boost trainer
+
+    // operations: 0 = difference, 1 = less
+    py::class_<PairVariables>{mod, "PairVariables"}
+        .def(py::init<ArrayXs, ArrayXs, ArrayXu8>())
+        .def("pairCount", &PairVariables::pairCount)
+        .def("__repr__", [](const PairVariables&) { return "<jrboost.PairVariables>"; });
+
+    py::class_<Dataset, shared_ptr<Dataset>>{mod, "Dataset"}
+        .def(
+            py::init([toBlocks](const py::list& inDataBlocks, optional<ArrayXu8> categorical, PairVariables pairs) {
+                return std::make_shared<Dataset>(toBlocks(inDataBlocks), std::move(categorical), std::move(pairs));
+            }),
+            py::arg(), py::kw_only(), py::arg("categorical") = std::nullopt, py::arg("pairs") = PairVariables())
+        .def(
+            py::init<ArrayXXfc, optional<ArrayXu8>, PairVariables>(), py::arg(), py::kw_only(),
+            py::arg("categorical") = std::nullopt, py::arg("pairs") = PairVariables())
+        .def("sampleCount", &Dataset::sampleCount)
+        .def("variableCount", &Dataset::variableCount)
+        .def("__repr__", [](const Dataset&) { return "<jrboost.Dataset>"; });
 
     py::class_<BoostTrainer>{mod, "BoostTrainer"}
         .def(
-            py::init<ArrayXXfc, ArrayXu8, optional<ArrayXd>, optional<ArrayXu8>>(), py::arg(), py::arg(), py::kw_only(),
-            py::arg("weights") = std::nullopt, py::arg("strata") = std::nullopt)
+            py::init([](shared_ptr<Dataset> dataset, ArrayXu8 outData, optional<ArrayXd> weights,
+                        optional<ArrayXu8> strata) {
+                return std::make_unique<BoostTrainer>(
+                    dataset, std::move(outData), std::move(weights), std::move(strata));
+            }),
+            py::arg(), py::arg(), py::kw_only(), py::arg("weights") = std::nullopt, py::arg("strata") = std::nullopt)
+        .def(
+            py::init([toBlocks](const py::list& inDataBlocks, ArrayXu8 outData, optional<ArrayXd> weights,
+                                optional<ArrayXu8> strata, optional<ArrayXu8> categorical) {
+                return std::make_unique<BoostTrainer>(
+                    toBlocks(inDataBlocks), std::move(outData), std::move(weights), std::move(strata),
+                    std::move(categorical));
+            }),
+            py::arg(), py::arg(), py::kw_only(), py::arg("weights") = std::nullopt, py::arg("strata") = std::nullopt,
+            py::arg("categorical") = std::nullopt)
+        .def(
+            py::init<ArrayXXfc, ArrayXu8, optional<ArrayXd>, optional<ArrayXu8>, optional<ArrayXu8>>(), py::arg(),
+            py::arg(), py::kw_only(), py::arg("weights") = std::nullopt, py::arg("strata") = std::nullopt,
+            py::arg("categorical") = std::nullopt)
         .def("train", [](const BoostTrainer& trainer, const BoostOptions& opt) { return trainer.train(opt); })
         .def("__repr__", [](const BoostTrainer&) { return "<jrboost.BoostTrainer>"; });
 
+    // Multinomial boosting
+
+    py::class_<MultinomialTrainer>{mod, "MultinomialTrainer"}
+        .def(
+            py::init([](shared_ptr<Dataset> dataset, ArrayXu8 outData, optional<ArrayXd> weights,
+                        optional<ArrayXu8> strata) {
+                return std::make_unique<MultinomialTrainer>(
+                    dataset, std::move(outData), std::move(weights), std::move(strata));
+            }),
+            py::arg(), py::arg(), py::kw_only(), py::arg("weights") = std::nullopt, py::arg("strata") = std::nullopt)
+        .def(
+            py::init([toBlocks](const py::list& inDataBlocks, ArrayXu8 outData, optional<ArrayXd> weights,
+                                optional<ArrayXu8> strata, optional<ArrayXu8> categorical) {
+                return std::make_unique<MultinomialTrainer>(
+                    toBlocks(inDataBlocks), std::move(outData), std::move(weights), std::move(strata),
+                    std::move(categorical));
+            }),
+            py::arg(), py::arg(), py::kw_only(), py::arg("weights") = std::nullopt, py::arg("strata") = std::nullopt,
+            py::arg("categorical") = std::nullopt)
+        .def(
+            py::init<ArrayXXfc, ArrayXu8, optional<ArrayXd>, optional<ArrayXu8>, optional<ArrayXu8>>(), py::arg(),
+            py::arg(), py::kw_only(), py::arg("weights") = std::nullopt, py::arg("strata") = std::nullopt,
+            py::arg("categorical") = std::nullopt)
+        .def("classCount", &MultinomialTrainer::classCount)
+        .def(
+            "train", [](const MultinomialTrainer& trainer, const BoostOptions& opt) { return trainer.train(opt); })
+        .def("__repr__", [](const MultinomialTrainer&) { return "<jrboost.MultinomialTrainer>"; });
+
+    py::class_<MultinomialPredictor, shared_ptr<MultinomialPredictor>>{mod, "MultinomialPredictor"}
+        .def(
+            "predict",
+            [](shared_ptr<MultinomialPredictor> predictor, CRefXXfc inData) { return predictor->predict(inData); })
+        .def(
+            "classify",
+            [](shared_ptr<MultinomialPredictor> predictor, CRefXXfc inData) { return predictor->classify(inData); })
+        .def("classCount", &MultinomialPredictor::classCount)
+        .def("variableCount", &MultinomialPredictor::variableCount)
+        .def("variableWeights", &MultinomialPredictor::variableWeights)
+        .def("predictor", &MultinomialPredictor::predictor)
+        .def("save", py::overload_cast<const string&>(&MultinomialPredictor::save, py::const_))
+        .def_static("load", py::overload_cast<const string&>(&MultinomialPredictor::load))
+        .def_static("create", &MultinomialPredictor::createInstance)
+        .def("__repr__", [](const MultinomialPredictor&) { return "<jrboost.MultinomialPredictor>"; })
+        .def(py::pickle(
+            [](const MultinomialPredictor& pred) {
+                stringstream ss;
+                ss.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+                pred.save(ss);
+                return static_cast<py::bytes>(ss.str());
+            },
+            [](const py::bytes& b) {
+                stringstream ss(static_cast<string>(b));
+                ss.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+                return MultinomialPredictor::load(ss);
+            }));
+
     mod.def("getDefaultBoostParam", []() { return BoostOptions(); });
 
     mod.def("parallelTrain", &parallelTrain);
@@ -82,7 +301,7 @@ PYBIND11_MODULE(_jrboost, mod)
         "parallelTrainAndEval", &parallelTrainAndEval, py::arg(), py::arg(), py::arg(), py::arg(), py::arg(),
         py::arg("weights") = std::nullopt, py::call_guard<py::gil_scoped_release>());
 
-    // parallelTrainAndEval() makes callbacks from multi-threaded code.
+    // parallelTrainAndEval() and Predictor.permutationImportance() make callbacks from multi-threaded code.
     // These callbacks may be to Python functions that need to acquire the GIL.
     // If we don't release the GIL here it will be held by the master thread and the other threads will be blocked.
 
@@ -129,6 +348,15 @@ PYBIND11_MODULE(_jrboost, mod)
     mod.def("getThreadCount", &omp_get_max_threads);
     mod.def("setThreadCount", &omp_set_num_threads);
 
+    py::enum_<SimdLevel>(mod, "SimdLevel")
+        .value("Scalar", SimdLevel::Scalar)
+        .value("AVX2", SimdLevel::AVX2)
+        .value("AVX512", SimdLevel::AVX512);
+
+    mod.def("getSimdLevel", &simdLevel);
+    mod.def("setSimdLevel", &setSimdLevel);
+    mod.def("getMaxSimdLevel", &maxSimdLevel);
+
     mod.def("bufferSize", &TreeTrainerBuffers::bufferSize);
     mod.def("clearBuffers", &TreeTrainerBuffers::freeBuffers);
 
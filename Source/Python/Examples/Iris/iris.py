@@ -33,6 +33,7 @@ trainParam = {
         #'stratifiedSamples': [False],
         #'selectVariablesByLevel': [True],
         #'fastExp': [False],
+        #'fastLogitExp': [True],
     },
 
     'minimizeParam' : {
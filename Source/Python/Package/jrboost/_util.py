@@ -2,7 +2,7 @@
 #  Distributed under the MIT license.
 #  (See accompanying file License.txt or copy at https://opensource.org/licenses/MIT)
 
-import copy, random, re
+import copy, os, random, re, subprocess
 import numpy as np
 import pandas as pd
 import jrboost
@@ -257,3 +257,24 @@ def formatParam(obj, indent = 0):
         return obj.name
     except:
         return s
+
+#-----------------------------------------------------------------------------------------------------------------------
+
+# Writes the predictor as C source code, compiles it to a shared library and returns a compiled predictor.
+# The compiler command may contain the placeholders {source} and {library}.
+
+def compilePredictor(predictor, dirPath, name = 'predictor', command = None):
+
+    if command is None:
+        if os.name == 'nt':
+            command = ['cl', '/nologo', '/O2', '/LD', '{source}', '/Fe:{library}']
+        else:
+            command = ['cc', '-O2', '-shared', '-fPIC', '{source}', '-o', '{library}', '-lm']
+
+    sourcePath = os.path.abspath(os.path.join(dirPath, name + '.c'))
+    libraryPath = os.path.abspath(os.path.join(dirPath, name + ('.dll' if os.name == 'nt' else '.so')))
+    command = [arg.format(source = sourcePath, library = libraryPath) for arg in command]
+
+    predictor.saveCode(sourcePath)
+    subprocess.run(command, cwd = dirPath, check = True)
+    return jrboost.Predictor.createCompiled(predictor, libraryPath)
@@ -0,0 +1,73 @@
+
+import sys
+sys.path += ['.', '../..']
+
+import os, pickle, tempfile
+import numpy as np
+import jrboost
+
+
+def test():
+
+    print('Multinomial test -----------------------\n')
+
+    threadCount = os.cpu_count() // 2
+    jrboost.setThreadCount(threadCount)
+
+    # synthetic data with noisy labels, so that the predictions do not saturate
+
+    sampleCount, variableCount = 5000, 20
+    rng = np.random.default_rng(0)
+    inData = rng.uniform(-1.0, 1.0, (sampleCount, variableCount)).astype(np.float32)
+    score = inData[:, 0] + inData[:, 1] * inData[:, 2] + 0.5 * rng.standard_normal(sampleCount)
+    print(f'{sampleCount} samples, {variableCount} variables\n')
+
+    options = {'iterationCount': 100, 'eta': 0.3, 'maxTreeDepth': 3, 'gamma': 0.0}
+
+    ok = True
+    with tempfile.TemporaryDirectory() as dirPath:
+
+        # with two classes, multinomial boost is the same as binary logit boost (gamma = 0)
+
+        outData = (score > 0.0).astype(np.uint8)
+        binaryPredictor = jrboost.BoostTrainer(inData, outData).train(options)
+        multinomialPredictor = jrboost.MultinomialTrainer(inData, outData).train(options)
+        maxDiff = np.abs(multinomialPredictor.predict(inData)[:, 1] - binaryPredictor.predict(inData)).max()
+        print(f'two classes vs binary logit boost: max difference = {maxDiff:.2e}' + ('' if maxDiff < 1e-6 else ' FAILED'))
+        ok = ok and maxDiff < 1e-6
+
+        # save + load and pickling give the same predictions
+
+        outData = np.digitize(score, [-0.5, 0.5]).astype(np.uint8)
+        predictor = jrboost.MultinomialTrainer(inData, outData).train(options)
+        pred = predictor.predict(inData)
+
+        path = os.path.join(dirPath, 'multinomial.jrboost')
+        predictor.save(path)
+        maxDiff = np.abs(jrboost.MultinomialPredictor.load(path).predict(inData) - pred).max()
+        print(f'save + load: max difference = {maxDiff:.2e}' + ('' if maxDiff < 1e-10 else ' FAILED'))
+        ok = ok and maxDiff < 1e-10
+
+        maxDiff = np.abs(pickle.loads(pickle.dumps(predictor)).predict(inData) - pred).max()
+        print(f'pickle: max difference = {maxDiff:.2e}' + ('' if maxDiff < 1e-10 else ' FAILED'))
+        ok = ok and maxDiff < 1e-10
+
+        # a multinomial predictor needs at least two classes, each with a boost predictor
+
+        try:
+            jrboost.MultinomialPredictor.create([binaryPredictor])
+            print('one class: no exception FAILED')
+            ok = False
+        except ValueError as e:
+            print(f'one class: {e}')
+
+    print()
+    if ok:
+        print('Test multinomial passed\n\n')
+    else:
+        print('Test multinomial failed\n\n')
+    return ok
+
+
+if (__name__ == '__main__'):
+    test()
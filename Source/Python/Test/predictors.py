@@ -0,0 +1,136 @@
+
+import sys
+sys.path += ['.', '../..']
+
+import os, shutil, tempfile
+import numpy as np
+import jrboost
+
+from agaricus import loadData
+
+
+dataPath = 'Data/Agaricus.csv'
+
+
+def test():
+
+    print('Predictor test -------------------------\n')
+
+    threadCount = os.cpu_count() // 2
+    jrboost.setThreadCount(threadCount)
+
+    # the agaricus variables with 10% missing values
+
+    inDataFrame, outDataSeries = loadData(dataPath)
+    inData = inDataFrame.to_numpy(copy = True)
+    outData = outDataSeries.to_numpy()
+    sampleCount, variableCount = inData.shape
+
+    rng = np.random.default_rng(0)
+    inData[rng.random(inData.shape) < 0.1] = np.nan
+    print(f'{sampleCount} samples, {variableCount} variables\n')
+
+    folds = jrboost.stratifiedRandomFolds(outData, 2)
+    trainSamples, testSamples = folds[0]
+    trainInData = np.ascontiguousarray(inData[trainSamples, :])
+    trainOutData = outData[trainSamples]
+    testInData = np.ascontiguousarray(inData[testSamples, :])
+
+    ok = True
+    k = 0
+    with tempfile.TemporaryDirectory() as dirPath:
+        for useCategorical in [False, True]:
+            # all variables numeric (quantize() only changes the numeric splits), or half of them categorical
+            categorical = ((np.arange(variableCount) % 2 == 0) & useCategorical).astype(np.uint8)
+            routingTestInData = np.concatenate([testInData, routingInData(testInData, categorical)])
+            for maxTreeDepth in [1, 3]:
+                print(f'categorical variables = {categorical.sum()}, maxTreeDepth = {maxTreeDepth}')
+                trainer = jrboost.BoostTrainer(trainInData, trainOutData, categorical = categorical)
+                predictor = trainer.train({'iterationCount': 100, 'eta': 0.1, 'maxTreeDepth': maxTreeDepth})
+                ok = checkDerivedPredictors(predictor, routingTestInData, dirPath, f'predictor{k}') and ok
+                k += 1
+                print()
+
+    if ok:
+        print('Test derived predictors passed\n\n')
+    else:
+        print('Test derived predictors failed\n\n')
+    return ok
+
+
+# samples that exercise the routing of missing values (the default directions of the splits)
+# and of all categories (the bitsets of the categorical splits), also categories not seen in training
+
+def routingInData(testInData, categorical):
+
+    variableCount = testInData.shape[1]
+
+    nanInData = testInData[:variableCount, :].copy()
+    nanInData[np.arange(variableCount), np.arange(variableCount)] = np.nan
+    allNanInData = np.full((1, variableCount), np.nan, dtype = testInData.dtype)
+
+    categoryInData = testInData[:64, :].copy()
+    categoryInData[:, categorical != 0] = np.arange(64)[:, np.newaxis]
+
+    return np.concatenate([nanInData, allNanInData, categoryInData])
+
+
+# returns the predictors that should give the same predictions as the source predictor, with their names
+
+def derivedPredictors(predictor, dirPath, name):
+
+    path = os.path.join(dirPath, name + '.jrboost')
+    predictor.save(path)
+    yield 'save + load', jrboost.Predictor.load(path)
+
+    flatPredictor = predictor.flatten()
+    yield 'flatten', flatPredictor
+
+    flatPath = os.path.join(dirPath, name + '_flat.jrboost')
+    flatPredictor.save(flatPath)
+    yield 'flatten + save + load', jrboost.Predictor.load(flatPath)
+    yield 'flatten + save + loadMapped', jrboost.Predictor.loadMapped(flatPath)
+
+    yield 'quantize', predictor.quantize()
+    yield 'flatten + quantize', flatPredictor.quantize()
+
+    # each predictor gets a library with its own name, since a library that is still loaded is not reloaded
+    if shutil.which('cl' if os.name == 'nt' else 'cc') is None:
+        print('compile: skipped, no C compiler found')
+    else:
+        yield 'saveCode + compile', jrboost.compilePredictor(predictor, dirPath, name)
+
+
+# the predictions are checked with C order and Fortran order test indata,
+# and predictOne() is also checked, on test samples with missing values;
+# the derived predictors are released before returning, so that their files (mapped files and libraries) can be deleted
+
+def checkDerivedPredictors(predictor, testInData, dirPath, name):
+
+    fortranTestInData = np.asfortranarray(testInData)
+    pred = predictor.predict(testInData)
+    ok = True
+
+    nanSamples = np.flatnonzero(np.isnan(testInData).any(axis = 1))[:100]
+    predOne = np.array([predictor.predictOne(testInData[i, :]) for i in nanSamples])
+    maxDiff = max(
+        np.abs(predictor.predict(fortranTestInData) - pred).max(),
+        np.abs(predOne - pred[nanSamples]).max()
+    )
+    print(f'source (Fortran order, predictOne): max difference = {maxDiff:.2e}' + ('' if maxDiff < 1e-10 else ' FAILED'))
+    ok = ok and maxDiff < 1e-10
+
+    for derivedName, derivedPredictor in derivedPredictors(predictor, dirPath, name):
+        predOne = np.array([derivedPredictor.predictOne(testInData[i, :]) for i in nanSamples])
+        maxDiff = max(
+            np.abs(derivedPredictor.predict(testInData) - pred).max(),
+            np.abs(derivedPredictor.predict(fortranTestInData) - pred).max(),
+            np.abs(predOne - pred[nanSamples]).max()
+        )
+        print(f'{derivedName}: max difference = {maxDiff:.2e}' + ('' if maxDiff < 1e-10 else ' FAILED'))
+        ok = ok and maxDiff < 1e-10
+    return ok
+
+
+if (__name__ == '__main__'):
+    test()
@@ -1,13 +1,17 @@
 
 import agaricus
 import iris
+import multinomial
+import predictors
 import titanic
 
 ok1 = agaricus.test()
 ok2 = iris.test()
 ok3 = titanic.test()
+ok4 = predictors.test()
+ok5 = multinomial.test()
 
-if ok1 and ok2 and ok3:
+if ok1 and ok2 and ok3 and ok4 and ok5:
     print('ALL TESTS PASSED\n')
 else:
     print('AT LEAST ONE TEST FAILED\n')